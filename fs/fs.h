@@ -44,6 +44,10 @@ void	fs_sync(void);
 bool	block_is_free(uint32_t blockno);
 int	alloc_block(void);
 
+/* pager.c */
+int	pager_attach(struct File *f, envid_t envid);
+void	pager_fault(envid_t envid);
+
 /* test.c */
 void	fs_test(void);
 
@@ -0,0 +1,228 @@
+/*
+ * Demand paging of executables.  spawn registers each child it creates
+ * with FSREQ_PAGER and makes us its pager; the kernel then hands us
+ * the child's page faults as PAGER_FAULT messages.
+ *
+ * Pages of read-only segments are block cache pages, mapped read-only,
+ * so all instances of a program share them; those already in the cache
+ * are mapped as soon as spawn registers the child.  Pages of writable
+ * segments lying wholly within the file are mapped from the block
+ * cache copy-on-write, marked PTE_PAGER so that the writes come back to
+ * us; all other pages, and writes, get a private copy built in a
+ * scratch page.
+ */
+
+#include "fs.h"
+#include <inc/elf.h>
+
+#define debug 0
+
+// Executables paged in at once, and their loadable segments
+#define MAXIMAGE	64
+#define MAXSEG		8
+
+// Copy-on-write PTEs, as in lib/fork.c
+#define PTE_COW		0x800
+
+// Where private copies are built, just below the request page
+#define PAGERVA		0x0fffe000
+
+struct Segment {
+	uintptr_t s_va;
+	size_t s_memsz;
+	size_t s_filesz;
+	off_t s_offset;
+	bool s_write;
+};
+
+struct Image {
+	envid_t i_tag;		// env spawned from it, 0 if unused
+	struct File *i_file;
+	int i_nseg;
+	struct Segment i_seg[MAXSEG];
+};
+
+static struct Image images[MAXIMAGE];
+
+// Is the env spawned from img, or any of its forks, still around?
+static bool
+image_live(struct Image *img)
+{
+	int i;
+
+	if (envs[ENVX(img->i_tag)].env_id == img->i_tag &&
+	    envs[ENVX(img->i_tag)].env_status != ENV_FREE)
+		return 1;
+	for (i = 0; i < NENV; i++)
+		if (envs[i].env_status != ENV_FREE &&
+		    envs[i].env_pager_tag == img->i_tag)
+			return 1;
+	return 0;
+}
+
+static struct Image *
+image_alloc(void)
+{
+	int i;
+
+	for (i = 0; i < MAXIMAGE; i++)
+		if (!images[i].i_tag)
+			return &images[i];
+	for (i = 0; i < MAXIMAGE; i++)
+		if (!image_live(&images[i]))
+			return &images[i];
+	return 0;
+}
+
+static struct Image *
+image_lookup(envid_t tag)
+{
+	int i;
+
+	for (i = 0; tag && i < MAXIMAGE; i++)
+		if (images[i].i_tag == tag)
+			return &images[i];
+	return 0;
+}
+
+// Find the block cache page holding the page at va of segment s.
+static int
+seg_block(struct Image *img, struct Segment *s, uintptr_t va, char **blk)
+{
+	// PGOFF(s_offset) == PGOFF(s_va), so pages line up with blocks
+	return file_get_block(img->i_file,
+			      (ROUNDDOWN(s->s_offset, BLKSIZE) + va -
+			       ROUNDDOWN(s->s_va, PGSIZE)) / BLKSIZE, blk);
+}
+
+// Map the pages of img's read-only segments that are in the block cache
+// already into envid, sparing it the faults.
+static void
+image_premap(struct Image *img, envid_t envid)
+{
+	struct Segment *s;
+	uintptr_t va;
+	char *blk;
+	int i;
+
+	for (i = 0; i < img->i_nseg; i++) {
+		s = &img->i_seg[i];
+		if (s->s_write)
+			continue;
+		for (va = ROUNDDOWN(s->s_va, PGSIZE); va < s->s_va + s->s_filesz;
+		     va += PGSIZE) {
+			if (seg_block(img, s, va, &blk) < 0)
+				break;
+			if (va_is_mapped(blk) &&
+			    sys_page_map(0, blk, envid, (void *) va,
+					 PTE_P|PTE_U) < 0)
+				return;
+		}
+	}
+}
+
+// Record the loadable segments of the ELF executable f for envid.
+int
+pager_attach(struct File *f, envid_t envid)
+{
+	struct Image *img;
+	struct Proghdr ph;
+	struct Elf elf;
+	int i;
+
+	if (file_read(f, &elf, sizeof(elf), 0) != sizeof(elf)
+	    || elf.e_magic != ELF_MAGIC)
+		return -E_NOT_EXEC;
+	if (!(img = image_alloc()))
+		return -E_NO_MEM;
+
+	img->i_tag = 0;
+	img->i_file = f;
+	img->i_nseg = 0;
+	for (i = 0; i < elf.e_phnum; i++) {
+		if (file_read(f, &ph, sizeof(ph), elf.e_phoff + i * sizeof(ph))
+		    != sizeof(ph))
+			return -E_NOT_EXEC;
+		if (ph.p_type != ELF_PROG_LOAD)
+			continue;
+		if (img->i_nseg == MAXSEG)
+			return -E_NOT_EXEC;
+		img->i_seg[img->i_nseg].s_va = ph.p_va;
+		img->i_seg[img->i_nseg].s_memsz = ph.p_memsz;
+		img->i_seg[img->i_nseg].s_filesz = ph.p_filesz;
+		img->i_seg[img->i_nseg].s_offset = ph.p_offset;
+		img->i_seg[img->i_nseg].s_write = ph.p_flags & ELF_PROG_FLAG_WRITE;
+		img->i_nseg++;
+	}
+	img->i_tag = envid;
+	image_premap(img, envid);
+	return 0;
+}
+
+// Build a private copy of the page at va of segment s in PAGERVA.
+static int
+page_copy(struct File *f, struct Segment *s, uintptr_t va)
+{
+	uintptr_t lo, hi;
+	int r;
+
+	if ((r = sys_page_alloc(0, (void *) PAGERVA, PTE_P|PTE_U|PTE_W)) < 0)
+		return r;
+	lo = MAX(va, s->s_va);
+	hi = MIN(va + PGSIZE, s->s_va + s->s_filesz);
+	if (lo < hi && (r = file_read(f, (char *) PAGERVA + (lo - va), hi - lo,
+				      s->s_offset + (lo - s->s_va))) < 0)
+		return r;
+	return 0;
+}
+
+// Map in the page envid faulted on, or refuse the fault.
+void
+pager_fault(envid_t envid)
+{
+	const volatile struct Env *e = &envs[ENVX(envid)];
+	uintptr_t va = ROUNDDOWN(e->env_pager_va, PGSIZE);
+	bool write = e->env_pager_err & FEC_WR;
+	struct Segment *s = 0;
+	struct Image *img;
+	char *blk;
+	int i, r;
+
+	if (debug)
+		cprintf("pager_fault %08x va %08x err %x\n",
+			envid, e->env_pager_va, e->env_pager_err);
+
+	if ((img = image_lookup(e->env_pager_tag)))
+		for (i = 0; i < img->i_nseg; i++)
+			if (ROUNDDOWN(img->i_seg[i].s_va, PGSIZE) <= va
+			    && va < img->i_seg[i].s_va + img->i_seg[i].s_memsz)
+				s = &img->i_seg[i];
+	if (!s || (write && !s->s_write))
+		goto refuse;
+
+	if (!s->s_write && va < s->s_va + s->s_filesz) {
+		if ((r = seg_block(img, s, va, &blk)) < 0)
+			goto refuse;
+		// fault the block in
+		(void) *(volatile char *) blk;
+		r = sys_pager_map(envid, blk, PTE_P|PTE_U);
+	} else if (s->s_write && !write && s->s_va <= va
+		   && va + PGSIZE <= s->s_va + s->s_filesz) {
+		if ((r = seg_block(img, s, va, &blk)) < 0)
+			goto refuse;
+		(void) *(volatile char *) blk;
+		r = sys_pager_map(envid, blk, PTE_P|PTE_U|PTE_COW|PTE_PAGER);
+	} else {
+		if ((r = page_copy(img->i_file, s, va)) < 0)
+			goto refuse;
+		r = sys_pager_map(envid, (void *) PAGERVA, PTE_P|PTE_U|PTE_W);
+		sys_page_unmap(0, (void *) PAGERVA);
+	}
+	if (r >= 0)
+		return;
+
+refuse:
+	if (debug)
+		cprintf("pager_fault %08x va %08x refused\n", envid, va);
+	sys_pager_map(envid, (void *) UTOP, 0);
+}
@@ -303,6 +303,52 @@ serve_sync(envid_t envid, union Fsipc *req)
 	return 0;
 }
 
+// Page req->req_envid in on demand from the ELF executable open as
+// req->req_fileid.  The caller then makes us its pager.
+int
+serve_pager(envid_t envid, struct Fsreq_pager *req)
+{
+	struct OpenFile *o;
+	int r;
+
+	if (debug)
+		cprintf("serve_pager %08x %08x %08x\n", envid, req->req_fileid, req->req_envid);
+
+	if ((r = openfile_lookup(envid, req->req_fileid, &o)) < 0)
+		return r;
+	return pager_attach(o->o_file, req->req_envid);
+}
+
+// Map the block cache page holding byte req_offset of the file into the
+// client read-only, and return the number of file bytes in it, or 0 at
+// end of file.  Like open, this passes a page back.
+int
+serve_map(envid_t envid, struct Fsreq_map *req,
+	  void **pg_store, int *perm_store)
+{
+	struct OpenFile *o;
+	char *blk;
+	int r;
+
+	if (debug)
+		cprintf("serve_map %08x %08x %08x\n", envid, req->req_fileid, req->req_offset);
+
+	if ((r = openfile_lookup(envid, req->req_fileid, &o)) < 0)
+		return r;
+	if (req->req_offset < 0)
+		return -E_INVAL;
+	if (req->req_offset >= o->o_file->f_size)
+		return 0;
+	if ((r = file_get_block(o->o_file, req->req_offset / BLKSIZE, &blk)) < 0)
+		return r;
+	// fault the block in, so there is a page to send
+	(void) *(volatile char *) blk;
+
+	*pg_store = blk;
+	*perm_store = PTE_P|PTE_U;
+	return MIN(BLKSIZE, o->o_file->f_size - ROUNDDOWN(req->req_offset, BLKSIZE));
+}
+
 typedef int (*fshandler)(envid_t envid, union Fsipc *req);
 
 fshandler handlers[] = {
@@ -313,10 +359,30 @@ fshandler handlers[] = {
 	[FSREQ_FLUSH] =		(fshandler)serve_flush,
 	[FSREQ_WRITE] =		(fshandler)serve_write,
 	[FSREQ_SET_SIZE] =	(fshandler)serve_set_size,
-	[FSREQ_SYNC] =		serve_sync
+	[FSREQ_SYNC] =		serve_sync,
+	[FSREQ_PAGER] =		(fshandler)serve_pager
 };
 #define NHANDLERS (sizeof(handlers)/sizeof(handlers[0]))
 
+// Send the reply to a request.  A demand-paged client may fault on its
+// way back to ipc_recv, and then waits for us to page it in.
+static void
+serve_reply(envid_t whom, int r, void *pg, int perm)
+{
+	const volatile struct Env *e = &envs[ENVX(whom)];
+	int err;
+
+	while ((err = sys_ipc_try_send(whom, r, pg ? pg : (void *) UTOP,
+				       perm)) == -E_IPC_NOT_RECV) {
+		if (e->env_pager_waiting && e->env_pager == thisenv->env_id)
+			pager_fault(whom);
+		else
+			sys_yield();
+	}
+	if (err < 0)
+		panic("serve_reply: %e", err);
+}
+
 void
 serve(void)
 {
@@ -331,6 +397,12 @@ serve(void)
 			cprintf("fs req %d from %08x [page %08x: %s]\n",
 				req, whom, uvpt[PGNUM(fsreq)], fsreq);
 
+		// Page faults come from the kernel, without a page
+		if (req == PAGER_FAULT) {
+			pager_fault(whom);
+			continue;
+		}
+
 		// All requests must contain an argument page
 		if (!(perm & PTE_P)) {
 			cprintf("Invalid request from %08x: no argument page\n",
@@ -341,13 +413,15 @@ serve(void)
 		pg = NULL;
 		if (req == FSREQ_OPEN) {
 			r = serve_open(whom, (struct Fsreq_open*)fsreq, &pg, &perm);
+		} else if (req == FSREQ_MAP) {
+			r = serve_map(whom, (struct Fsreq_map*)fsreq, &pg, &perm);
 		} else if (req < NHANDLERS && handlers[req]) {
 			r = handlers[req](whom, fsreq);
 		} else {
 			cprintf("Invalid request code %d from %08x\n", req, whom);
 			r = -E_INVAL;
 		}
-		ipc_send(whom, r, pg, perm);
+		serve_reply(whom, r, pg, perm);
 		sys_page_unmap(0, fsreq);
 	}
 }
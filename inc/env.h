@@ -45,6 +45,23 @@ enum EnvType {
 	ENV_TYPE_NS,		// Network server
 };
 
+// Scheduling classes, most urgent first
+enum {
+	ENV_PRIO_SERVER = 0,	// File and network servers
+	ENV_PRIO_NORMAL,	// Ordinary user environments
+	ENV_PRIO_BATCH,		// Background work, given a small share
+	NENVPRIO
+};
+
+// IPC value with which the kernel hands an env's page fault to its
+// pager.  The faulting env's env_pager_va and env_pager_err say where.
+#define PAGER_FAULT	0xffffffff
+
+// A PTE_AVAIL bit a pager adds to the pages it maps copy-on-write.
+// Writes to them go to the pager even if the env has a page fault
+// upcall of its own; fork's copy-on-write mappings do not carry it.
+#define PTE_PAGER	0x400
+
 struct Env {
 	struct Trapframe env_tf;	// Saved registers
 	struct Env *env_link;		// Next free Env
@@ -67,6 +84,39 @@ struct Env {
 	uint32_t env_ipc_value;		// Data value sent to us
 	envid_t env_ipc_from;		// envid of the sender
 	int env_ipc_perm;		// Perm of page mapping received
+
+	// Sleeping
+	unsigned int env_timer_expires;	// Tick at which the timer fires
+	struct Env *env_timer_next;	// Next env in the same wheel slot
+	struct Env **env_timer_pprev;	// Link to us, or null if not armed
+
+	// Scheduling
+	int env_base_prio;		// Class set by sys_env_set_priority
+	int env_prio;			// Class scheduled at, maybe inherited
+	uint32_t env_cpumask;		// CPUs the env may run on, one bit each
+
+	// Exit status and waiters
+	int env_exit_status;		// Status passed to sys_env_exit
+	struct Env *env_waiters;	// Envs blocked in sys_env_wait on us
+	struct Env *env_wait_next;	// Next env waiting on the same env
+	struct Env *env_wait_on;	// Env we are blocked waiting on
+
+	// Futex wait
+	physaddr_t env_futex_pa;	// Word we are blocked on
+	struct Env *env_futex_next;	// Next env in the same hash bucket
+	struct Env **env_futex_pprev;	// Link to us, or null if not waiting
+
+	// Demand paging
+	envid_t env_pager;		// Env that maps in our pages, or 0
+	envid_t env_pager_tag;		// Image the pager maps them from
+	uintptr_t env_pager_va;		// Last fault handed to the pager
+	uint32_t env_pager_err;		// Its FEC_* error code
+	bool env_pager_waiting;		// Blocked until the pager is done
+	bool env_pager_queued;		// Pager has not been told yet
+	bool env_pager_refused;		// Pager could not map env_pager_va
+
+	// Lab 6 networking
+	int env_net_queue;		// NIC queue used by the net syscalls
 };
 
 #endif // !JOS_INC_ENV_H
@@ -29,6 +29,9 @@ enum {
 	//E1000 error
 	E_NO_TX ,
 	E_NO_RX ,
+
+	E_TIMEOUT	,	// Timed out waiting
+	E_AGAIN		,	// Non-blocking operation would block
 	MAXERROR
 };
 
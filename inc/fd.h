@@ -21,6 +21,8 @@ struct Dev {
 	int (*dev_close)(struct Fd *fd);
 	int (*dev_stat)(struct Fd *fd, struct Stat *stat);
 	int (*dev_trunc)(struct Fd *fd, off_t length);
+	// Which poll events the fd is ready for, without blocking
+	int (*dev_poll)(struct Fd *fd, int events);
 };
 
 struct FdFile {
@@ -50,6 +52,23 @@ struct Stat {
 	struct Dev *st_dev;
 };
 
+// Open mode flag, defined here ahead of lwIP's clashing one: reads and
+// writes on the fd fail with -E_AGAIN instead of blocking
+#define O_NONBLOCK	0x1000
+
+// Events for poll
+#define POLLIN		0x0001		/* data to read, or end of file */
+#define POLLOUT		0x0004		/* writing would not block */
+#define POLLERR		0x0008		/* error, always reported */
+#define POLLHUP		0x0010		/* other end closed, always reported */
+#define POLLNVAL	0x0020		/* fd not open, always reported */
+
+struct pollfd {
+	int fd;
+	short events;		// requested events
+	short revents;		// returned events
+};
+
 char*	fd2data(struct Fd *fd);
 int	fd2num(struct Fd *fd);
 int	fd_alloc(struct Fd **fd_store);
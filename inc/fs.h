@@ -70,7 +70,11 @@ enum {
 	FSREQ_STAT,
 	FSREQ_FLUSH,
 	FSREQ_REMOVE,
-	FSREQ_SYNC
+	FSREQ_SYNC,
+	// Demand page an env spawned from an ELF file; see fs/pager.c
+	FSREQ_PAGER,
+	// Map returns the block cache page holding req_offset, read-only
+	FSREQ_MAP
 };
 
 union Fsipc {
@@ -108,6 +112,14 @@ union Fsipc {
 	struct Fsreq_remove {
 		char req_path[MAXPATHLEN];
 	} remove;
+	struct Fsreq_pager {
+		int req_fileid;
+		int32_t req_envid;
+	} pager;
+	struct Fsreq_map {
+		int req_fileid;
+		off_t req_offset;
+	} map;
 
 	// Ensure Fsipc is one page
 	char _pad[PGSIZE];
@@ -36,6 +36,7 @@ extern const volatile struct PageInfo pages[];
 
 // exit.c
 void	exit(void);
+void	exit_with(int status);
 
 // pgfault.c
 void	set_pgfault_handler(void (*handler)(struct UTrapframe *utf));
@@ -48,6 +49,15 @@ void	sys_cputs(const char *string, size_t len);
 int	sys_cgetc(void);
 envid_t	sys_getenvid(void);
 int	sys_env_destroy(envid_t);
+void	sys_env_exit(int status);
+int	sys_env_wait(envid_t envid);
+int	sys_env_set_priority(envid_t envid, int prio);
+int	sys_env_set_affinity(envid_t envid, uint32_t mask);
+int	sys_futex_wait(volatile uint32_t *va, uint32_t expected,
+		       unsigned int deadline);
+int	sys_futex_wake(volatile uint32_t *va, int n);
+int	sys_env_set_pager(envid_t envid, envid_t pager);
+int	sys_pager_map(envid_t envid, void *pg, int perm);
 void	sys_yield(void);
 static envid_t sys_exofork(void);
 int	sys_env_set_status(envid_t env, int status);
@@ -59,9 +69,15 @@ int	sys_page_map(envid_t src_env, void *src_pg,
 int	sys_page_unmap(envid_t env, void *pg);
 int	sys_ipc_try_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int	sys_ipc_recv(void *rcv_pg);
+int	sys_ipc_recv_until(void *rcv_pg, unsigned int deadline);
 unsigned int sys_time_msec(void);
+uint64_t sys_time_usec(void);
 int sys_net_try_transmit(const char *s, size_t len);
 int sys_net_try_receive(char *s);
+int sys_net_try_transmit_tso(const char *s, size_t len, int hdrlen, int mss);
+int sys_net_queues(void);
+int sys_net_set_queue(int queue);
+int sys_sleep_until(unsigned int msec);
 // This must be inlined.  Exercise for reader: why?
 static __inline envid_t __attribute__((always_inline))
 sys_exofork(void)
@@ -78,6 +94,8 @@ sys_exofork(void)
 // ipc.c
 void	ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int32_t ipc_recv(envid_t *from_env_store, void *pg, int *perm_store);
+int32_t ipc_recv_until(envid_t *from_env_store, void *pg, int *perm_store,
+		       unsigned int deadline);
 envid_t	ipc_find_env(enum EnvType type);
 
 // fork.c
@@ -95,12 +113,16 @@ ssize_t	readn(int fd, void *buf, size_t nbytes);
 int	dup(int oldfd, int newfd);
 int	fstat(int fd, struct Stat *statbuf);
 int	stat(const char *path, struct Stat *statbuf);
+int	fcntl(int fd, int cmd, int arg);
+int	poll(struct pollfd *fds, int nfds, int timeout);
 
 // file.c
 int	open(const char *path, int mode);
 int	ftruncate(int fd, off_t size);
 int	remove(const char *path);
 int	sync(void);
+int	file_pager(int fd, envid_t envid);
+int	file_map_page(int fd, off_t offset, void *dstva);
 
 // pageref.c
 int	pageref(void *addr);
@@ -112,9 +134,14 @@ int     shutdown(int s, int how);
 int     connect(int s, const struct sockaddr *name, socklen_t namelen);
 int     listen(int s, int backlog);
 int     socket(int domain, int type, int protocol);
+ssize_t sendfile(int sockfd, int filefd, off_t offset, size_t len);
+int     sock_poll(struct pollfd *fds, int nfds, unsigned int deadline);
+int     sendmmsg(int s, const struct mmsg *msgs, int n);
+int     recvmmsg(int s, struct mmsg *msgs, int n);
 
 // nsipc.c
-int     nsipc_accept(int s, struct sockaddr *addr, socklen_t *addrlen);
+int     nsipc_accept(int s, struct sockaddr *addr, socklen_t *addrlen,
+		     unsigned int flags);
 int     nsipc_bind(int s, struct sockaddr *name, socklen_t namelen);
 int     nsipc_shutdown(int s, int how);
 int     nsipc_close(int s);
@@ -123,6 +150,11 @@ int     nsipc_listen(int s, int backlog);
 int     nsipc_recv(int s, void *mem, int len, unsigned int flags);
 int     nsipc_send(int s, const void *buf, int size, unsigned int flags);
 int     nsipc_socket(int domain, int type, int protocol);
+int     nsipc_poll(struct pollfd *fds, int nfds, unsigned int deadline);
+int     nsipc_stats(struct Nsret_stats *st);
+int     nsipc_sendmmsg(int s, const struct mmsg *msgs, int n,
+		       unsigned int flags);
+int     nsipc_recvmmsg(int s, struct mmsg *msgs, int n, unsigned int flags);
 
 // spawn.c
 envid_t	spawn(const char *program, const char **argv);
@@ -136,10 +168,11 @@ int	opencons(void);
 
 // pipe.c
 int	pipe(int pipefds[2]);
+int	pipe_sized(int pipefds[2], size_t bufsize);
 int	pipeisclosed(int pipefd);
 
 // wait.c
-void	wait(envid_t env);
+int	wait(envid_t env);
 
 /* File open modes */
 #define	O_RDONLY	0x0000		/* open for reading only */
@@ -151,5 +184,10 @@ void	wait(envid_t env);
 #define	O_TRUNC		0x0200		/* truncate to zero length */
 #define	O_EXCL		0x0400		/* error if already exists */
 #define O_MKDIR		0x0800		/* create directory, not regular file */
+// O_NONBLOCK is in inc/fd.h
+
+/* fcntl commands */
+#define F_GETFL		3		/* get the open mode */
+#define F_SETFL		4		/* set O_NONBLOCK */
 
 #endif	// !JOS_INC_LIB_H
@@ -5,13 +5,74 @@
 
 #include <inc/types.h>
 #include <inc/mmu.h>
+#include <inc/env.h>
+#include <inc/fd.h>
 #include <lwip/sockets.h>
+#include <lwip/stats.h>
 
 struct jif_pkt {
 	int jp_len;
 	char jp_data[0];
 };
 
+// Packets move between the network server and its input and output
+// environments through single-producer/single-consumer rings of
+// page-sized slots in PTE_SHARE memory.  A record takes one or more
+// consecutive slots and never wraps; jr_span[] at the record's first
+// slot holds its length in slots, or JIF_RING_SKIP plus the number of
+// slots to jump over at the end of the ring.  IPC is only used to wake
+// a consumer that has set jr_sleeping and blocked in ipc_recv.
+// The consumer may hold on to several records and give them back out
+// of order; jr_tail only moves past a record once it and all older
+// ones have been given back, or kept.  A kept record may be held for
+// as long as the consumer likes: the tail moves on past it, and the
+// producer skips its slots until it is given back.
+#define JIF_RING_MAXSLOTS	64
+#define JIF_RING_SKIP		0x80
+
+// Values of jr_held[]
+#define JIF_RING_TAKEN		1
+#define JIF_RING_KEPT		2
+
+struct jif_ring {
+	volatile uint32_t jr_head;	// slots produced so far
+	volatile uint32_t jr_tail;	// slots consumed so far
+	volatile uint32_t jr_sleeping;	// consumer is blocking in ipc_recv
+	volatile uint32_t jr_full;	// producer is blocking on jr_tail
+	volatile envid_t jr_consumer;	// env to wake
+	uint32_t jr_wakereq;		// IPC value of a wakeup
+	uint32_t jr_nslots;
+	volatile uint8_t jr_span[JIF_RING_MAXSLOTS];
+	// record taken or kept, not given back; the producer reads it
+	volatile uint8_t jr_held[JIF_RING_MAXSLOTS];
+	// consumer-private
+	uint32_t jr_next;		// slots taken so far
+	uint32_t jr_nkept;		// records kept
+};
+
+// Slot i of a ring lives in the i+1'th page after the control page.
+#define JIF_RING_SLOT(r, i)	((void *)((uintptr_t)(r) + ((i) + 1) * PGSIZE))
+
+// There is one ring of each kind per NIC queue, each served by its
+// own input or output environment.
+#define JIF_MAXQUEUES		4
+#define JIF_RING_STRIDE		0x80000
+// Received frames: one struct jif_pkt per slot.
+#define JIF_RXRING(q)		((struct jif_ring *)(0x10200000 + (q) * JIF_RING_STRIDE))
+// Frames to transmit: one struct jif_txpkt per record.
+#define JIF_TXRING(q)		((struct jif_ring *)(0x10400000 + (q) * JIF_RING_STRIDE))
+
+// A frame for the output environment.  With TCP segmentation offload
+// it may be a super-segment that the NIC cuts into jp_mss-sized frames.
+struct jif_txpkt {
+	int jp_len;		// frame length, headers included
+	int jp_hdrlen;		// Ethernet + IP + TCP header bytes
+	int jp_mss;		// payload bytes per wire frame, 0 if not cut
+	char jp_data[0];
+};
+
+#define JIF_TSO_MAXPAYLOAD	0xffff
+
 // Definitions for requests from clients to network server
 enum {
 	// The following messages pass a page containing an Nsipc.
@@ -27,7 +88,27 @@ enum {
 	NSREQ_SEND,
 	NSREQ_SOCKET,
 
-	// The following two messages pass a page containing a struct jif_pkt
+	// SendPage passes a page holding nothing but the data to send, from
+	// its first byte; the socket and length are packed into the IPC
+	// value by NSREQ_SENDPAGE_VALUE.
+	NSREQ_SENDPAGE,
+
+	// Poll fills in the revents of the request's sockets, waiting
+	// until one is ready or req_deadline passes.  It returns the
+	// number of ready ones.
+	NSREQ_POLL,
+
+	// Stats returns a Nsret_stats on the request page.
+	NSREQ_STATS,
+
+	// SendMmsg and RecvMmsg carry a batch of datagrams as struct Nsmsg
+	// records after a Nsreq_mmsg.  Both return the number of datagrams
+	// sent or received; RecvMmsg writes them back on the request page.
+	NSREQ_SENDMMSG,
+	NSREQ_RECVMMSG,
+
+	// The following two messages pass a page containing a struct jif_pkt,
+	// or no page if they only wake up the consumer of a jif_ring
 	NSREQ_INPUT,
 	// NSREQ_OUTPUT, unlike all other messages, is sent *from* the
 	// network server, to the output environment
@@ -37,10 +118,36 @@ enum {
 	NSREQ_TIMER,
 };
 
+// Most sockets one poll request can hold
+#define NSPOLL_MAXFDS	((PGSIZE - 8) / sizeof(struct pollfd))
+
+// A datagram of a SendMmsg or RecvMmsg batch.  Records follow each
+// other, each starting on a 4-byte boundary.
+struct Nsmsg {
+	struct sockaddr_in m_addr;	// sin_family 0: the connected peer
+	int m_len;
+	char m_data[0];
+};
+
+#define NSMSG_SIZE(len)		ROUNDUP(sizeof(struct Nsmsg) + (len), 4)
+
+// One datagram for sendmmsg() or recvmmsg() in lib/sockets.c.
+struct mmsg {
+	void *mm_buf;
+	int mm_len;			// recvmmsg: buffer size in, length out
+	struct sockaddr_in mm_addr;	// destination, or where it came from
+};
+
+#define NSREQ_TYPE(v)			((v) & 0xff)
+#define NSREQ_SENDPAGE_VALUE(s, len)	(NSREQ_SENDPAGE | (s) << 8 | (len) << 16)
+#define NSREQ_SENDPAGE_SOCK(v)		(((v) >> 8) & 0xff)
+#define NSREQ_SENDPAGE_LEN(v)		((v) >> 16)
+
 union Nsipc {
 	struct Nsreq_accept {
 		int req_s;
 		socklen_t req_addrlen;
+		unsigned int req_flags;
 	} accept;
 
 	struct Nsret_accept {
@@ -91,16 +198,41 @@ union Nsipc {
 		char req_buf[0];
 	} send;
 
+	struct Nsreq_mmsg {
+		int req_s;
+		int req_n;		// datagrams, or most to receive
+		int req_len;		// RecvMmsg: longest datagram kept whole
+		unsigned int req_flags;
+		char req_msgs[0];	// struct Nsmsg records
+	} mmsg;
+
 	struct Nsreq_socket {
 		int req_domain;
 		int req_type;
 		int req_protocol;
 	} socket;
 
+	struct Nsreq_poll {
+		unsigned int req_deadline;	// sys_time_msec(), ~0 for never
+		int req_nfds;
+		struct pollfd req_fds[0];	// fd is the socket id
+	} poll;
+
+	struct Nsret_stats {
+		unsigned int ret_msec;		// sys_time_msec() when taken
+		struct stats_ ret_lwip;
+		// usage of lwIP's memp pools, named by ret_pool_name
+		struct memp_pool_stats ret_pool[MEMP_MAX];
+		char ret_pool_name[MEMP_MAX][16];
+	} statsRet;
+
 	struct jif_pkt pkt;
 
 	// Ensure Nsipc is one page
 	char _pad[PGSIZE];
 };
 
+// Room for struct Nsmsg records in a SendMmsg or RecvMmsg request
+#define NSMMSG_SPACE	(PGSIZE - sizeof(struct Nsreq_mmsg))
+
 #endif // !JOS_INC_NS_H
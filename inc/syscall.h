@@ -20,6 +20,19 @@ enum {
 	SYS_time_msec,
 	SYS_net_try_transmit,		//15
 	SYS_net_try_receive,
+	SYS_net_try_transmit_tso,
+	SYS_net_queues,
+	SYS_net_set_queue,				//20
+	SYS_sleep_until,
+	SYS_time_usec,
+	SYS_env_exit,
+	SYS_env_wait,				//25
+	SYS_env_set_priority,
+	SYS_env_set_affinity,
+	SYS_futex_wait,
+	SYS_futex_wake,
+	SYS_env_set_pager,			//30
+	SYS_pager_map,
 	NSYSCALLS
 };
 
@@ -42,6 +55,19 @@ static char *syscall_name_table[] = {
 	"SYS_time_msec",
 	"SYS_net_try_transmit",		//15
 	"SYS_net_try_receive",
+	"SYS_net_try_transmit_tso",
+	"SYS_net_queues",
+	"SYS_net_set_queue",			//20
+	"SYS_sleep_until",
+	"SYS_time_usec",
+	"SYS_env_exit",
+	"SYS_env_wait",				//25
+	"SYS_env_set_priority",
+	"SYS_env_set_affinity",
+	"SYS_futex_wait",
+	"SYS_futex_wake",
+	"SYS_env_set_pager",			//30
+	"SYS_pager_map",
 	"NSYSCALLS"
 };
 
@@ -23,6 +23,7 @@ struct CpuInfo {
 	volatile unsigned cpu_status;   // The status of the CPU
 	struct Env *cpu_env;            // The currently-running environment.
 	struct Taskstate cpu_ts;        // Used by x86 to find stack for interrupt
+	uint32_t cpu_migrations;        // Envs taken over from another CPU
 };
 
 // Initialized in mpconfig.c
@@ -42,5 +43,7 @@ void lapic_init(void);
 void lapic_startap(uint8_t apicid, uint32_t addr);
 void lapic_eoi(void);
 void lapic_ipi(int vector);
+void lapic_ipi_cpu(int apicid, int vector);
+void lapic_timer(unsigned int usec);
 
 #endif
@@ -11,11 +11,18 @@
 volatile uint32_t e1000_bar0;
 e1000_status status;
 
-// transmit and receive rings
-volatile struct tx_desc *tx_desc_rings;
-char tx_buff[TDLEN][TX_BUFF_SIZE];
-struct rx_desc *rx_desc_rings;
-char rx_buff[RDLEN][RX_BUFF_SIZE];
+// transmit and receive rings, one pair per queue
+static int nqueues;
+volatile struct tx_desc *tx_desc_rings[E1000_MAXQUEUES];
+// a TSO context descriptor overwrites its slot's buffer address, so
+// remember where each transmit buffer is
+static physaddr_t tx_buff[E1000_MAXQUEUES][TDLEN];
+struct rx_desc *rx_desc_rings[E1000_MAXQUEUES];
+// the 82574 writes the buffer address over with extended write-back
+// fields, so remember where each receive buffer is
+static physaddr_t rx_buff[E1000_MAXQUEUES][RDLEN];
+static int rx_next[E1000_MAXQUEUES];
+static int rx_extended;
 
 static inline uint32_t get_e1000_register(unsigned reg_inx){
 	return *(uint32_t *)(e1000_bar0 + reg_inx);
@@ -29,10 +36,12 @@ static inline void set_e1000_register(unsigned reg_inx, unsigned val) {
 void check_transmit(){
 	int i = 0;
 	for(i = 0; i < 100; i++){
-		e1000_transmit("debug", 6);
+		e1000_transmit(0, "debug", 6);
 	}
 }
 static void check_e1000(struct pci_func *pcif, int is_enable){
+	int q;
+
 	if(!is_enable){
 		assert(!pcif->reg_base[0]);
 		assert(!pcif->reg_size[0]);
@@ -42,68 +51,83 @@ static void check_e1000(struct pci_func *pcif, int is_enable){
 	assert(pcif->reg_base[0]);
 	assert(pcif->reg_size[0]);
 	assert(e1000_bar0);
-	assert(get_e1000_register(E1000_STATUS) == INITIAL_STATUS);
-	assert(get_e1000_register(E1000_TDH) == 0);
-	assert(get_e1000_register(E1000_TDT) == 0);
-	assert(tx_desc_rings);
-	assert((uint32_t)tx_desc_rings % PGSIZE == 0);
+	if(!rx_extended)
+		assert(get_e1000_register(E1000_STATUS) == INITIAL_STATUS);
+	for(q = 0; q < nqueues; q++){
+		assert(get_e1000_register(E1000_QUEUE(E1000_TDH, q)) == 0);
+		assert(get_e1000_register(E1000_QUEUE(E1000_TDT, q)) == 0);
+		assert(tx_desc_rings[q]);
+		assert((uint32_t)tx_desc_rings[q] % PGSIZE == 0);
+	}
 	assert(get_e1000_register(E1000_MTA) == 0);
 	assert(get_e1000_register(E1000_MTA + 4) == 0);
 	assert(get_e1000_register(E1000_MTA + 8) == 0);
 	assert(sizeof(struct rx_desc) == sizeof(struct tx_desc));
+	assert(sizeof(struct rx_desc_ext) == sizeof(struct rx_desc));
 	assert(RDLEN >= 128);
 }
+int e1000_queues(void){
+	return nqueues;
+}
+
 /**************** receive ****************/
-static inline int get_rx_ring_tail(){
-	int tail = get_e1000_register(E1000_RDT);
+static inline int get_rx_ring_tail(int queue){
+	int tail = get_e1000_register(E1000_QUEUE(E1000_RDT, queue));
 	tail = tail % RDLEN;
 	return tail;
 }
 
-int e1000_receive(char *s) {
-	static int real_tail = 0;
-	//int tail = get_rx_ring_tail();
-	int tail = real_tail;
+int e1000_receive(int queue, char *s) {
+	int tail = rx_next[queue];
 	//cprintf("tail is %d\n", tail);
-	struct rx_desc *desc = &rx_desc_rings[tail];
-	if(desc->status.dd == 0){
-		return -E_NO_RX;
+	struct rx_desc *desc = &rx_desc_rings[queue][tail];
+	uint32_t length;
+	if(rx_extended){
+		struct rx_desc_ext *ext = (struct rx_desc_ext *)desc;
+		if(!(ext->status_error & E1000_RXDEXT_STAT_DD))
+			return -E_NO_RX;
+		length = ext->length;
+	}else{
+		if(desc->status.dd == 0)
+			return -E_NO_RX;
+		length = desc->length;
 	}
-	char *buff = (char *)KADDR((uint32_t)desc->addr);
-	uint32_t length = desc->length;
+	char *buff = (char *)KADDR(rx_buff[queue][tail]);
 
 	memmove(s, buff, length);
-	desc->status.dd = 0;
-	set_e1000_register(E1000_RDT, tail);
-	real_tail = (tail + 1) % RDLEN;
-	//cprintf("real_tail is %d tail is %d head is %d\n", real_tail, get_e1000_register(E1000_RDT), get_e1000_register(E1000_RDH));
+	// hand the descriptor back in read format, which clears dd
+	memset(desc, 0, sizeof(*desc));
+	desc->addr = rx_buff[queue][tail];
+	set_e1000_register(E1000_QUEUE(E1000_RDT, queue), tail);
+	rx_next[queue] = (tail + 1) % RDLEN;
 	return length;
 }
 /**************** transmit ****************/
-static inline int get_tx_ring_tail() {
-	int tail = get_e1000_register(E1000_TDT);
+static inline int get_tx_ring_tail(int queue) {
+	int tail = get_e1000_register(E1000_QUEUE(E1000_TDT, queue));
 	assert(tail < TDLEN);
 	return tail;
 }
 
 /* are there enough buff to trans size bytes data?? */
-static int e1000_transmit_check_free(int size){
+static int e1000_transmit_check_free(int queue, int size){
+	volatile struct tx_desc *tx_ring = tx_desc_rings[queue];
 	size = ROUNDUP(size, TX_BUFF_SIZE);
 	int need_nbuffs = size / TX_BUFF_SIZE;
 	need_nbuffs = need_nbuffs > TDLEN ? TDLEN : need_nbuffs;
-	int tail = get_tx_ring_tail();
+	int tail = get_tx_ring_tail(queue);
 
 	// check 
 	int i;
 	for(i = 0; i < need_nbuffs; i++){
 		int idx = (tail + i) % TDLEN;
-		if(!tx_desc_rings[idx].status.dd)
+		if(!tx_ring[idx].status.dd)
 			return 0;
 	}
 	return 1;
 }
 
-int e1000_transmit(const char *data, int size){
+int e1000_transmit(int queue, const char *data, int size){
 	int i = 0;
 	/*
 	while(i++ < TRANS_CHECK_TIME){
@@ -112,16 +136,16 @@ int e1000_transmit(const char *data, int size){
 	}
 	*/
 
-	if(!e1000_transmit_check_free(size))
+	if(!e1000_transmit_check_free(queue, size))
 		return -E_NO_TX;
-	int tail = get_tx_ring_tail();
+	int tail = get_tx_ring_tail(queue);
 	struct tx_desc *desc;
 	int size_want_to_trans = size;
 	int size_has_trans = 0;
 	while(size) {
 		// wait a free buff
-		assert(tail == get_tx_ring_tail());
-		desc = (struct tx_desc *)&tx_desc_rings[tail];
+		assert(tail == get_tx_ring_tail(queue));
+		desc = (struct tx_desc *)&tx_desc_rings[queue][tail];
 		
 		// still need to wait, because size may beyond TDLEN * TX_BUFF_SIZE
 		while(!desc->status.dd);
@@ -131,25 +155,90 @@ int e1000_transmit(const char *data, int size){
 		//prepare this buff
 		int size_ready_to_trans = size > TX_BUFF_SIZE ? TX_BUFF_SIZE : size;
 		size -= size_ready_to_trans;
-		char *buff = (char *)KADDR((uint32_t)desc->addr);
+		desc->addr = tx_buff[queue][tail];
+		char *buff = (char *)KADDR(tx_buff[queue][tail]);
 		memmove(buff, data + size_has_trans, size_ready_to_trans);
 		size_has_trans += size_ready_to_trans;
 
 		//fill in desc
 		desc->length = size_ready_to_trans;
 		desc->cso = 0;
+		desc->css = 0;
 		desc->special = 0;
-		// end the packet?
-		desc->cmd.eop = size == 0? 1 : 0;
+		// rewrite the whole cmd byte: a TSO send may have left
+		// dext/tse set in this slot. end the packet?
+		desc->cmd = (struct _cmd){ .rs = 1, .eop = size == 0 ? 1 : 0 };
 		
 		// tail++ and send the buff
 		tail = (tail + 1) % TDLEN;
-		set_e1000_register(E1000_TDT, tail);
+		set_e1000_register(E1000_QUEUE(E1000_TDT, queue), tail);
 	}
 	assert(size_has_trans == size_want_to_trans);
 	return size_has_trans;
 }
 
+/**************** TCP segmentation offload ****************/
+// Send one TCP super-segment: 'data' holds the Ethernet, IPv4 and TCP
+// headers ('hdrlen' bytes in total) followed by up to TSO_MAX_PAYLOAD
+// bytes of payload.  The NIC replicates the headers onto every 'mss'
+// sized piece of payload, fixing up IP length/id, TCP sequence numbers
+// and both checksums.  The caller must leave the IP checksum zero and
+// seed the TCP checksum with the pseudo-header sum excluding length.
+int e1000_transmit_tso(int queue, const char *data, int size, int hdrlen, int mss){
+	int ipcss = ETH_HLEN;
+	int tucss;
+	int paylen = size - hdrlen;
+
+	if(hdrlen < ETH_HLEN + 40 || hdrlen > TX_BUFF_SIZE || paylen <= 0
+	   || paylen > TSO_MAX_PAYLOAD || mss <= 0 || mss + hdrlen > TX_BUFF_SIZE)
+		return -E_INVAL;
+	tucss = ipcss + (data[ipcss] & 0xf) * 4;
+	if(tucss + 20 > hdrlen)
+		return -E_INVAL;
+
+	// one context descriptor plus the data buffers
+	if(!e1000_transmit_check_free(queue, size + TX_BUFF_SIZE))
+		return -E_NO_TX;
+
+	int tail = get_tx_ring_tail(queue);
+	struct tx_ctx_desc *ctx = (struct tx_ctx_desc *)&tx_desc_rings[queue][tail];
+	ctx->ipcss = ipcss;
+	ctx->ipcso = ipcss + 10;
+	ctx->ipcse = tucss - 1;
+	ctx->tucss = tucss;
+	ctx->tucso = tucss + 16;
+	ctx->tucse = 0;
+	ctx->cmd_len = paylen | E1000_TXD_DTYP_C | E1000_TXD_CMD_DEXT |
+		E1000_TXD_CMD_TSE | E1000_TXD_CMD_RS | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP;
+	ctx->status = 0;
+	ctx->hdrlen = hdrlen;
+	ctx->mss = mss;
+	tail = (tail + 1) % TDLEN;
+
+	int size_has_trans = 0;
+	while(size_has_trans < size) {
+		struct tx_data_desc *desc = (struct tx_data_desc *)&tx_desc_rings[queue][tail];
+		while(!(desc->status & E1000_TXD_STAT_DD));
+
+		int n = MIN(size - size_has_trans, TX_BUFF_SIZE);
+		desc->addr = tx_buff[queue][tail];
+		memmove(KADDR(tx_buff[queue][tail]), data + size_has_trans, n);
+		size_has_trans += n;
+
+		desc->cmd_len = n | E1000_TXD_DTYP_D | E1000_TXD_CMD_DEXT |
+			E1000_TXD_CMD_TSE | E1000_TXD_CMD_RS | E1000_TXD_CMD_IFCS;
+		if(size_has_trans == size)
+			desc->cmd_len |= E1000_TXD_CMD_EOP;
+		desc->status = 0;
+		desc->popts = E1000_TXD_POPTS_IXSM | E1000_TXD_POPTS_TXSM;
+		desc->special = 0;
+		tail = (tail + 1) % TDLEN;
+	}
+	// hand the context and all data descriptors over at once
+	set_e1000_register(E1000_QUEUE(E1000_TDT, queue), tail);
+	return size;
+}
+
 /**************** init ****************/
 static inline void init_e1000_tctl(){
 	uint32_t tctl_value = 0;
@@ -166,27 +255,40 @@ static inline void init_e1000_tipg(){
 	set_e1000_register(E1000_TIPG, tipg_value);
 }
 
-static inline void init_e1000_tx(){
+// Fill in n descriptor buffer addresses, two buffers per page.
+static void alloc_e1000_buffs(physaddr_t *pa, int n, int stride){
+	struct PageInfo *pp = NULL;
+	int i;
+	for(i = 0; i < n; i++) {
+		if(i % (PGSIZE / stride) == 0){
+			pp = page_alloc(ALLOC_ZERO);
+			assert(pp);
+			pp->pp_ref++;
+		}
+		pa[i] = page2pa(pp) + (i % (PGSIZE / stride)) * stride;
+	}
+}
+
+static inline void init_e1000_tx(int queue){
 	//cprintf("debug begin\n");
 	struct PageInfo *pp = page_alloc(ALLOC_ZERO);
 	assert(pp);
 	pp->pp_ref++;
-	tx_desc_rings = (struct tx_desc *)page2kva(pp);
-	set_e1000_register(E1000_TDBAL, page2pa(pp));
-	set_e1000_register(E1000_TDBAH, 0);
+	tx_desc_rings[queue] = (struct tx_desc *)page2kva(pp);
+	set_e1000_register(E1000_QUEUE(E1000_TDBAL, queue), page2pa(pp));
+	set_e1000_register(E1000_QUEUE(E1000_TDBAH, queue), 0);
+	alloc_e1000_buffs(tx_buff[queue], TDLEN, RX_BUFF_SIZE);
 	int i;
 	for(i = 0; i < TDLEN; i++) {
-		tx_desc_rings[i].addr = PADDR(tx_buff[i]);
-		tx_desc_rings[i].cmd.rs = 1;
-		tx_desc_rings[i].status.dd = 1;
+		tx_desc_rings[queue][i].addr = tx_buff[queue][i];
+		tx_desc_rings[queue][i].cmd.rs = 1;
+		tx_desc_rings[queue][i].status.dd = 1;
 	}
 
 	/* 大坑!!! 存的是字节数 没好好看文档 T_T */
-	set_e1000_register(E1000_TDLEN, TDLEN * sizeof(struct tx_desc));
-	set_e1000_register(E1000_TDH, 0);
-	set_e1000_register(E1000_TDT, 0);
-	init_e1000_tctl();
-	init_e1000_tipg();
+	set_e1000_register(E1000_QUEUE(E1000_TDLEN, queue), TDLEN * sizeof(struct tx_desc));
+	set_e1000_register(E1000_QUEUE(E1000_TDH, queue), 0);
+	set_e1000_register(E1000_QUEUE(E1000_TDT, queue), 0);
 }
 
 static inline void init_e1000_rctl(){
@@ -207,36 +309,73 @@ static inline void init_e1000_rctl(){
 	set_e1000_register(E1000_RCTL, rctl_value);
 }
 
-static inline void init_e1000_rx(){
-	set_e1000_register(E1000_RCTL, 0);
+static inline void init_e1000_rx(int queue){
 	struct PageInfo *pp = page_alloc(ALLOC_ZERO);
 	assert(pp);
 	pp->pp_ref++;
-	rx_desc_rings = (struct rx_desc *)page2kva(pp);
-	set_e1000_register(E1000_RDBAL, page2pa(pp));
-	set_e1000_register(E1000_RDBAH, 0);
+	rx_desc_rings[queue] = (struct rx_desc *)page2kva(pp);
+	set_e1000_register(E1000_QUEUE(E1000_RDBAL, queue), page2pa(pp));
+	set_e1000_register(E1000_QUEUE(E1000_RDBAH, queue), 0);
+	alloc_e1000_buffs(rx_buff[queue], RDLEN, RX_BUFF_SIZE);
 	int i;
 	for(i = 0; i < RDLEN; i++) {
-		rx_desc_rings[i].addr = PADDR(rx_buff[i]);
+		rx_desc_rings[queue][i].addr = rx_buff[queue][i];
 	}
-	// 52:54:00:12:34:56
-	// Receive Address Register
-	set_e1000_register(E1000_RAL0, 0x12005452);
-	set_e1000_register(E1000_RAH0, (0x00005634 | E1000_RAH_AV));
 	// Set the Receive Descriptor Length
-	set_e1000_register(E1000_RDLEN, RDLEN * sizeof(struct rx_desc));
+	set_e1000_register(E1000_QUEUE(E1000_RDLEN, queue), RDLEN * sizeof(struct rx_desc));
 
 	//Head should point to the first valid receive descriptor in the descriptor ring and 
 	//tail should point to one descriptor beyond the last valid descriptor in the descriptor ring.
-	set_e1000_register(E1000_RDH, 0);
-	set_e1000_register(E1000_RDT, RDLEN);
-	init_e1000_rctl();
+	set_e1000_register(E1000_QUEUE(E1000_RDH, queue), 0);
+	set_e1000_register(E1000_QUEUE(E1000_RDT, queue), RDLEN);
+	rx_next[queue] = 0;
 }
 
-static void init_e1000() {
-	init_e1000_rx();
-	init_e1000_tx();
-	cprintf("e1000 init successed!\n");
+// Spread received flows over the queues by their RSS hash.  QEMU's
+// e1000e only hashes with extended descriptors and the packet checksum
+// disabled, since both share the write-back field with the hash.
+static void init_e1000_rss(){
+	// the default key from the Microsoft RSS specification
+	static const uint8_t key[E1000_RSSRK_SIZE] = {
+		0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+		0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+		0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+		0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+		0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+	};
+	int i;
+
+	set_e1000_register(E1000_RFCTL, get_e1000_register(E1000_RFCTL) | E1000_RFCTL_EXTEN);
+	set_e1000_register(E1000_RXCSUM, E1000_RXCSUM_PCSD);
+	for(i = 0; i < E1000_RSSRK_SIZE; i += 4)
+		set_e1000_register(E1000_RSSRK + i, *(uint32_t *)&key[i]);
+	// entries alternate between queue 0 and queue 1
+	for(i = 0; i < E1000_RETA_SIZE; i += 4)
+		set_e1000_register(E1000_RETA + i,
+				   (E1000_RETA_QUEUE1 << 8) | (E1000_RETA_QUEUE1 << 24));
+	set_e1000_register(E1000_MRQC, E1000_MRQC_ENABLE_RSS_2Q |
+			   E1000_MRQC_RSS_FIELD_IPV4_TCP | E1000_MRQC_RSS_FIELD_IPV4);
+	rx_extended = 1;
+}
+
+static void init_e1000(int queues) {
+	int q;
+	set_e1000_register(E1000_RCTL, 0);
+	nqueues = queues;
+	for(q = 0; q < nqueues; q++){
+		init_e1000_rx(q);
+		init_e1000_tx(q);
+	}
+	if(nqueues > 1)
+		init_e1000_rss();
+	// 52:54:00:12:34:56
+	// Receive Address Register
+	set_e1000_register(E1000_RAL0, 0x12005452);
+	set_e1000_register(E1000_RAH0, (0x00005634 | E1000_RAH_AV));
+	init_e1000_rctl();
+	init_e1000_tctl();
+	init_e1000_tipg();
+	cprintf("e1000 init successed! %d queue(s)\n", nqueues);
 }
 
 int attach_e1000(struct pci_func *pcif) {
@@ -246,8 +385,21 @@ int attach_e1000(struct pci_func *pcif) {
 	pci_func_enable(pcif);
 
 	e1000_bar0 = (uint32_t)mmio_map_region(pcif->reg_base[0], pcif->reg_size[0]);
-	init_e1000();
+	init_e1000(1);
 	check_e1000(pcif, 1);
 	//check_transmit();
 	return 0;
+}
+
+// The 82574 (QEMU's e1000e) is programmed like the 82540EM, plus a
+// second receive and transmit queue with RSS spreading flows over them.
+int attach_e1000e(struct pci_func *pcif) {
+	if(debug)
+		cprintf("begin attach_e1000e\n");
+	pci_func_enable(pcif);
+
+	e1000_bar0 = (uint32_t)mmio_map_region(pcif->reg_base[0], pcif->reg_size[0]);
+	init_e1000(E1000_MAXQUEUES);
+	check_e1000(pcif, 1);
+	return 0;
 }
\ No newline at end of file
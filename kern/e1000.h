@@ -7,11 +7,17 @@
 
 #define E1000_VENDOR_ID_82540EM	    0x8086
 #define E1000_DEV_ID_82540EM		0x100E
+#define E1000_DEV_ID_82574L		0x10D3
 #define MIN_RECEIVE_BUFF_SIZE		RX_BUFF_SIZE
+/* the 82574 has two receive and two transmit queues */
+#define E1000_MAXQUEUES			2
 typedef uint32_t e1000_status;  
 int attach_e1000(struct pci_func *pcif);
-int e1000_transmit(const char *data, int size);
-int e1000_receive(char *s);
+int attach_e1000e(struct pci_func *pcif);
+int e1000_queues(void);
+int e1000_transmit(int queue, const char *data, int size);
+int e1000_transmit_tso(int queue, const char *data, int size, int hdrlen, int mss);
+int e1000_receive(int queue, char *s);
 /* transmit desc 128 bits */
 struct tx_desc{
 	uint64_t addr;
@@ -38,6 +44,29 @@ struct tx_desc{
 	uint16_t special;
 } __attribute__((__packed__));
 
+/* TCP/IP context desc 128 bits, programs the offload engine for TSO */
+struct tx_ctx_desc{
+	uint8_t ipcss;		/* IP checksum start */
+	uint8_t ipcso;		/* IP checksum offset */
+	uint16_t ipcse;		/* IP checksum end */
+	uint8_t tucss;		/* TCP checksum start */
+	uint8_t tucso;		/* TCP checksum offset */
+	uint16_t tucse;		/* TCP checksum end, 0 means end of packet */
+	uint32_t cmd_len;	/* PAYLEN[19:0] DTYP[23:20] TUCMD[31:24] */
+	uint8_t status;
+	uint8_t hdrlen;
+	uint16_t mss;
+}__attribute__((__packed__));
+
+/* extended data desc 128 bits, used for the payload of a TSO send */
+struct tx_data_desc{
+	uint64_t addr;
+	uint32_t cmd_len;	/* DTALEN[19:0] DTYP[23:20] DCMD[31:24] */
+	uint8_t status;
+	uint8_t popts;
+	uint16_t special;
+}__attribute__((__packed__));
+
 /* receive desc 128 bits */
 struct rx_desc{
 	uint64_t addr;
@@ -57,10 +86,24 @@ struct rx_desc{
 	uint8_t errors;
 	uint16_t special;
 }__attribute__((__packed__));
+/* extended receive desc 128 bits (82574), as written back by the NIC.
+   the NIC reads it as the buffer address followed by 64 zero bits */
+struct rx_desc_ext{
+	uint32_t mrq;		/* RSS type and queue */
+	uint32_t rss;		/* RSS hash */
+	uint32_t status_error;
+	uint16_t length;
+	uint16_t vlan;
+}__attribute__((__packed__));
+#define E1000_RXDEXT_STAT_DD	0x00000001	/* descriptor done */
 //#define TDLEN  			(PGSIZE/sizeof(struct tx_desc))
 #define TDLEN 64
 #define RDLEN (PGSIZE/sizeof(struct rx_desc))
 #define TX_BUFF_SIZE	1518
+#define ETH_HLEN	14
+/* largest TCP payload one TSO send may carry, limited by the PAYLEN field
+   and by how many TX_BUFF_SIZE buffers the ring can hand to one packet */
+#define TSO_MAX_PAYLOAD	0xffff
 #define RX_BUFF_SIZE	2048
 #define E1000_RAH_AV  0x80000000        /* Receive descriptor valid */
 /* E1000 register */
@@ -83,6 +126,15 @@ struct rx_desc{
 #define E1000_RAL0     0x05400  /* Receive Address - RW Array */
 #define E1000_RAH0     0x05404  /* Receive Address - RW Array */
 #define E1000_MTA      0x05200  /* Multicast Table Array - RW Array */
+#define E1000_RXCSUM   0x05000  /* RX Checksum Control - RW */
+#define E1000_RFCTL    0x05008  /* Receive Filter Control - RW */
+#define E1000_MRQC     0x05818  /* Multiple Receive Control - RW */
+#define E1000_RETA     0x05C00  /* Redirection Table - RW Array */
+#define E1000_RSSRK    0x05C80  /* RSS Random Key - RW Array */
+/* queue n of the 82574 has its descriptor registers at reg + n * 0x100 */
+#define E1000_QUEUE(reg, n)	((reg) + (n) * 0x100)
+#define E1000_RETA_SIZE		128	/* entries, one byte each */
+#define E1000_RSSRK_SIZE	40	/* bytes */
 /* Transmit Control */
 #define E1000_TCTL_RST    0x00000001    /* software reset */
 #define E1000_TCTL_EN     0x00000002    /* enable tx */
@@ -100,6 +152,20 @@ struct rx_desc{
 #define E1000_TCTL_NRTU   0x02000000    /* No Re-transmit on underrun */
 #define E1000_TCTL_MULR   0x10000000    /* Multiple request support */
 
+/* Context and extended data descriptor fields */
+#define E1000_TXD_DTYP_C        0x00000000      /* context descriptor */
+#define E1000_TXD_DTYP_D        0x00100000      /* data descriptor */
+#define E1000_TXD_CMD_EOP       0x01000000      /* end of packet */
+#define E1000_TXD_CMD_IFCS      0x02000000      /* insert FCS */
+#define E1000_TXD_CMD_TSE       0x04000000      /* TCP segmentation enable */
+#define E1000_TXD_CMD_RS        0x08000000      /* report status */
+#define E1000_TXD_CMD_DEXT      0x20000000      /* descriptor extension */
+#define E1000_TXD_CMD_IP        0x02000000      /* context: IPv4 packet */
+#define E1000_TXD_CMD_TCP       0x01000000      /* context: TCP packet */
+#define E1000_TXD_POPTS_IXSM    0x01            /* insert IP checksum */
+#define E1000_TXD_POPTS_TXSM    0x02            /* insert TCP checksum */
+#define E1000_TXD_STAT_DD       0x01            /* descriptor done */
+
 /* Receive Control */
 #define E1000_RCTL_RST            0x00000001    /* Software reset */
 #define E1000_RCTL_EN             0x00000002    /* enable */
@@ -141,6 +207,15 @@ struct rx_desc{
 #define E1000_RCTL_SECRC          0x04000000    /* Strip Ethernet CRC */
 #define E1000_RCTL_FLXBUF_MASK    0x78000000    /* Flexible buffer size */
 #define E1000_RCTL_FLXBUF_SHIFT   27            /* Flexible buffer shift */
+/* Receive Checksum Control */
+#define E1000_RXCSUM_PCSD         0x00002000    /* packet checksum disabled */
+/* Receive Filter Control */
+#define E1000_RFCTL_EXTEN         0x00008000    /* extended rx descriptors */
+/* Multiple Receive Queues */
+#define E1000_MRQC_ENABLE_RSS_2Q  0x00000001    /* RSS over two queues */
+#define E1000_MRQC_RSS_FIELD_IPV4_TCP 0x00010000 /* hash IPv4 + TCP ports */
+#define E1000_MRQC_RSS_FIELD_IPV4 0x00020000    /* hash IPv4 addresses */
+#define E1000_RETA_QUEUE1         0x80          /* entry selects queue 1 */
 /* TIPG */
 #define E1000_TIPG_IPGT_SHIFT     0
 #define E1000_TIPG_IPGT_VAL       (10 << E1000_TIPG_IPGT_SHIFT)
@@ -14,6 +14,9 @@
 #include <kern/sched.h>
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
+#include <kern/time.h>
+#include <kern/futex.h>
+#include <kern/pager.h>
 
 struct Env *envs = NULL;		// All environments
 static struct Env *env_free_list;	// Free environment list
@@ -234,6 +237,9 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	e->env_type = ENV_TYPE_USER;
 	e->env_status = ENV_RUNNABLE;
 	e->env_runs = 0;
+	e->env_net_queue = 0;
+	e->env_base_prio = e->env_prio = ENV_PRIO_NORMAL;
+	e->env_cpumask = ~0;
 
 	// Clear out all the saved register state,
 	// to prevent the register values
@@ -264,6 +270,16 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 
 	// Also clear the IPC receiving flag.
 	e->env_ipc_recving = 0;
+	e->env_timer_pprev = NULL;
+	e->env_futex_pprev = NULL;
+	e->env_pager = e->env_pager_tag = 0;
+	e->env_pager_waiting = e->env_pager_queued = 0;
+	e->env_pager_refused = 0;
+
+	// Envs that die any other way than sys_env_exit report -E_FAULT.
+	e->env_exit_status = -E_FAULT;
+	e->env_waiters = NULL;
+	e->env_wait_on = NULL;
 
 	// commit the allocation
 	env_free_list = e->env_link;
@@ -439,6 +455,49 @@ env_create(uint8_t *binary, enum EnvType type)
 	}
 	load_icode(e, binary);
 	e->env_type = type;	
+	if (type != ENV_TYPE_USER)
+		e->env_base_prio = e->env_prio = ENV_PRIO_SERVER;
+}
+
+//
+// Take e off the waiter list of the env it is waiting on in
+// sys_env_wait, if any.
+//
+void
+env_wait_cancel(struct Env *e)
+{
+	struct Env **wp;
+
+	if (e->env_wait_on) {
+		for (wp = &e->env_wait_on->env_waiters; *wp != e;
+		     wp = &(*wp)->env_wait_next)
+			;
+		*wp = e->env_wait_next;
+		e->env_wait_on = NULL;
+	}
+}
+
+//
+// Hand e's exit status to the envs blocked in sys_env_wait on it, and
+// take e off the waiter list of the env it was itself waiting on.
+// The status stays in e's slot, for waiters that come late, until the
+// slot is reused.
+//
+static void
+env_wait_wakeup(struct Env *e)
+{
+	struct Env *w;
+
+	while ((w = e->env_waiters)) {
+		e->env_waiters = w->env_wait_next;
+		w->env_wait_on = NULL;
+		if (w->env_status == ENV_NOT_RUNNABLE) {
+			w->env_tf.tf_regs.reg_eax = e->env_exit_status;
+			w->env_status = ENV_RUNNABLE;
+		}
+	}
+
+	env_wait_cancel(e);
 }
 
 //
@@ -457,6 +516,12 @@ env_free(struct Env *e)
 	if (e == curenv)
 		lcr3(PADDR(kern_pgdir));
 
+	// A sleeping environment must not be woken after it is gone.
+	timer_cancel(e);
+	futex_cancel(e);
+	pager_cancel(e);
+	env_wait_wakeup(e);
+
 	// Note the environment's demise.
 	// cprintf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
 
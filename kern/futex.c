@@ -0,0 +1,107 @@
+// Futexes: wait and wake on a word of user memory.  Waiters are keyed
+// by the word's physical address, so envs sharing a page find each
+// other wherever they map it.
+
+#include <inc/error.h>
+#include <inc/mmu.h>
+
+#include <kern/futex.h>
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/sched.h>
+#include <kern/time.h>
+
+// Envs blocked in futex_wait, hashed by physical address
+#define FUTEX_HASH	64
+static struct Env *futex_hash[FUTEX_HASH];
+
+static int
+futex_lookup(volatile uint32_t *va, physaddr_t *pa)
+{
+	struct PageInfo *pp;
+
+	if ((uintptr_t) va >= UTOP || (uintptr_t) va % sizeof(*va))
+		return -E_INVAL;
+	if (!(pp = page_lookup(curenv->env_pgdir, (void *) va, NULL)))
+		return -E_INVAL;
+	*pa = page2pa(pp) + PGOFF(va);
+	return 0;
+}
+
+static struct Env **
+futex_bucket(physaddr_t pa)
+{
+	return &futex_hash[(pa / sizeof(uint32_t)) % FUTEX_HASH];
+}
+
+// Block the current env until futex_wake is called on va, but only if
+// *va still holds 'expected'; the check and the sleep are atomic with
+// respect to futex_wake.  A nonzero 'deadline' bounds the wait like
+// sys_ipc_recv's.  Returns 0 when woken, or at once if *va has
+// changed, so callers must recheck their condition.  Errors are:
+//	-E_INVAL if va is not an aligned, mapped user address.
+//	-E_TIMEOUT if 'deadline' passed first.
+int
+futex_wait(volatile uint32_t *va, uint32_t expected, unsigned int deadline)
+{
+	struct Env **bucket;
+	physaddr_t pa;
+	int r;
+
+	if ((r = futex_lookup(va, &pa)) < 0)
+		return r;
+	user_mem_assert(curenv, (void *) va, sizeof(*va), PTE_U);
+	if (*va != expected)
+		return 0;
+	if (deadline && deadline <= time_msec())
+		return -E_TIMEOUT;
+
+	bucket = futex_bucket(pa);
+	curenv->env_futex_pa = pa;
+	curenv->env_futex_next = *bucket;
+	if (*bucket)
+		(*bucket)->env_futex_pprev = &curenv->env_futex_next;
+	curenv->env_futex_pprev = bucket;
+	*bucket = curenv;
+
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	curenv->env_tf.tf_regs.reg_eax = 0;
+	if (deadline)
+		timer_set(curenv, deadline);
+	sched_yield();
+}
+
+// Take e off the futex it is blocked on, if any.
+void
+futex_cancel(struct Env *e)
+{
+	if (!e->env_futex_pprev)
+		return;
+	*e->env_futex_pprev = e->env_futex_next;
+	if (e->env_futex_next)
+		e->env_futex_next->env_futex_pprev = e->env_futex_pprev;
+	e->env_futex_pprev = NULL;
+}
+
+// Wake up to n envs blocked in futex_wait on va.  Returns the number
+// woken, or -E_INVAL if va is not an aligned, mapped user address.
+int
+futex_wake(volatile uint32_t *va, int n)
+{
+	struct Env *e, *next;
+	physaddr_t pa;
+	int r, woken = 0;
+
+	if ((r = futex_lookup(va, &pa)) < 0)
+		return r;
+	for (e = *futex_bucket(pa); e && woken < n; e = next) {
+		next = e->env_futex_next;
+		if (e->env_futex_pa != pa)
+			continue;
+		futex_cancel(e);
+		timer_cancel(e);
+		e->env_status = ENV_RUNNABLE;
+		woken++;
+	}
+	return woken;
+}
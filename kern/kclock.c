@@ -1,6 +1,7 @@
 /* See COPYRIGHT for copyright information. */
 
-/* Support for reading the NVRAM from the real-time clock. */
+/* Support for reading the NVRAM from the real-time clock, and for timing
+ * short delays with the 8253 programmable interval timer. */
 
 #include <inc/x86.h>
 
@@ -20,3 +21,31 @@ mc146818_write(unsigned reg, unsigned datum)
 	outb(IO_RTC, reg);
 	outb(IO_RTC+1, datum);
 }
+
+#define	IO_PIT		0x040		/* 8253 PIT ports */
+#define	PIT_CH2		(IO_PIT + 2)
+#define	PIT_MODE	(IO_PIT + 3)
+#define	IO_PORTB	0x061		/* PIT channel 2 gate/output */
+#define	PIT_COUNTS_10MS	11932		/* 1.193182 MHz input clock */
+
+// Spin for usec microseconds using PIT channel 2, which keeps working
+// without interrupts.  Only meant for calibrating the other clocks.
+void
+pit_delay(unsigned int usec)
+{
+	unsigned int chunk, count;
+
+	while (usec) {
+		chunk = usec < 50000 ? usec : 50000;
+		count = chunk * PIT_COUNTS_10MS / 10000;
+		// gate channel 2 on with the speaker off, then count
+		// down once in mode 0; OUT goes high at zero
+		outb(IO_PORTB, (inb(IO_PORTB) & ~0x02) | 0x01);
+		outb(PIT_MODE, 0xb0);
+		outb(PIT_CH2, count & 0xff);
+		outb(PIT_CH2, count >> 8);
+		while (!(inb(IO_PORTB) & 0x20))
+			;
+		usec -= chunk;
+	}
+}
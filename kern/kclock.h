@@ -29,4 +29,6 @@
 unsigned mc146818_read(unsigned reg);
 void mc146818_write(unsigned reg, unsigned datum);
 
+void pit_delay(unsigned int usec);
+
 #endif	// !JOS_KERN_KCLOCK_H
@@ -9,6 +9,7 @@
 #include <inc/x86.h>
 #include <kern/pmap.h>
 #include <kern/cpu.h>
+#include <kern/kclock.h>
 
 // Local APIC registers, divided by 4 for use as uint32_t[] indices.
 #define ID      (0x0020/4)   // ID
@@ -45,6 +46,8 @@
 physaddr_t lapicaddr;        // Initialized in mpconfig.c
 volatile uint32_t *lapic;
 
+static uint32_t lapic_per_ms;	// Timer counts per millisecond
+
 static void
 lapicw(int index, int value)
 {
@@ -52,6 +55,36 @@ lapicw(int index, int value)
 	lapic[ID];  // wait for write to finish, by reading
 }
 
+#define CALIBRATE_MS	10
+
+static void
+lapic_calibrate(void)
+{
+	lapicw(TIMER, MASKED);
+	lapicw(TICR, 0xffffffff);
+	pit_delay(CALIBRATE_MS * 1000);
+	lapic_per_ms = (0xffffffff - lapic[TCCR]) / CALIBRATE_MS;
+	lapicw(TICR, 0);
+	cprintf("LAPIC timer: %u counts/ms\n", lapic_per_ms);
+}
+
+// Interrupt this CPU once, usec microseconds from now.  Zero stops the
+// timer, leaving the CPU to sleep until some other interrupt.
+void
+lapic_timer(unsigned int usec)
+{
+	uint64_t count;
+
+	if (!lapic)
+		return;
+	count = (uint64_t) usec * lapic_per_ms / 1000;
+	if (usec && count == 0)
+		count = 1;
+	if (count > 0xffffffff)
+		count = 0xffffffff;
+	lapicw(TICR, count);
+}
+
 void
 lapic_init(void)
 {
@@ -64,13 +97,14 @@ lapic_init(void)
 
 	// Enable local APIC; set spurious interrupt vector.
 	lapicw(SVR, ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS));
-	// The timer repeatedly counts down at bus frequency
-	// from lapic[TICR] and then issues an interrupt.  
-	// If we cared more about precise timekeeping,
-	// TICR would be calibrated using an external time source.
+	// The timer counts down once at bus frequency from lapic[TICR]
+	// and then issues an interrupt; lapic_timer arms it.  All CPUs
+	// share the bus clock, so measure it once against the PIT.
 	lapicw(TDCR, X1);
-	lapicw(TIMER, PERIODIC | (IRQ_OFFSET + IRQ_TIMER));
-	lapicw(TICR, 10000000); 
+	if (thiscpu == bootcpu)
+		lapic_calibrate();
+	lapicw(TIMER, IRQ_OFFSET + IRQ_TIMER);
+	lapicw(TICR, 0);
 
 	// Leave LINT0 of the BSP enabled so that it can get
 	// interrupts from the 8259A chip.
@@ -133,8 +167,6 @@ microdelay(int us)
 {
 }
 
-#define IO_RTC  0x70
-
 // Start additional processor running entry code at addr.
 // See Appendix B of MultiProcessor Specification.
 void
@@ -179,3 +211,13 @@ lapic_ipi(int vector)
 	while (lapic[ICRLO] & DELIVS)
 		;
 }
+
+// Send an interrupt to the CPU with local APIC ID apicid.
+void
+lapic_ipi_cpu(int apicid, int vector)
+{
+	lapicw(ICRHI, apicid << 24);
+	lapicw(ICRLO, FIXED | vector);
+	while (lapic[ICRLO] & DELIVS)
+		;
+}
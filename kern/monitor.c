@@ -11,6 +11,7 @@
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
 #include <kern/trap.h>
+#include <kern/cpu.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -27,6 +28,7 @@ static struct Command commands[] = {
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
 	{ "backtrace", "Display a listing of function call frames", mon_backtrace},
 	{ "showmappings", "Display VM to PM mapping", mon_showmappings},
+	{ "cpus", "Display per-CPU scheduling counters", mon_cpus},
 };
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
 
@@ -99,6 +101,20 @@ mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 	}
 	return 0;
 }
+int
+mon_cpus(int argc, char **argv, struct Trapframe *tf)
+{
+	static const char *status[] = { "unused", "started", "halted" };
+	int i;
+
+	for (i = 0; i < ncpu; i++)
+		cprintf("CPU %d: %s, env %08x, %u migrations\n", i,
+			status[cpus[i].cpu_status],
+			cpus[i].cpu_env ? cpus[i].cpu_env->env_id : 0,
+			cpus[i].cpu_migrations);
+	return 0;
+}
+
 /**
 00000000ef000000-00000000ef021000 0000000000021000 ur-
 00000000ef7bc000-00000000ef7be000 0000000000002000 ur-
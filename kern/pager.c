@@ -0,0 +1,186 @@
+// External pagers: an env can be given a pager env that maps in the
+// pages it faults on, so its image can be loaded on demand.  The
+// kernel hands each fault to the pager as an IPC with value
+// PAGER_FAULT from the faulting env, which stays blocked until the
+// pager answers with sys_pager_map.  A pager may also answer a fault
+// it has not received yet, if it finds the env waiting on it.
+
+#include <inc/error.h>
+#include <inc/mmu.h>
+
+#include <kern/pager.h>
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/sched.h>
+#include <kern/time.h>
+
+// Faults waiting for a busy pager, so pager_recv can skip the search
+static int npager_queued;
+
+// Make 'pager' resolve envid's page faults from now on, or stop
+// demand paging envid if 'pager' is 0.  Envid's forks inherit it.
+// Errors are:
+//	-E_BAD_ENV if envid or pager does not exist, or the caller may
+//		not change envid.
+int
+pager_set(envid_t envid, envid_t pager)
+{
+	struct Env *e, *p;
+	int r;
+
+	if ((r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	if (pager && (r = envid2env(pager, &p, 0)) < 0)
+		return r;
+	e->env_pager = pager;
+	e->env_pager_tag = pager ? e->env_id : 0;
+	return 0;
+}
+
+// Called by a pager: map the page at srcva with 'perm' over the page
+// envid faulted on, and let envid retry.  If srcva >= UTOP, refuse the
+// fault instead; envid then takes it as though it had no pager.
+// Errors are:
+//	-E_BAD_ENV if envid does not exist.
+//	-E_INVAL if we are not envid's pager, envid is not waiting for
+//		us, or srcva and perm are wrong as for sys_page_map.
+//	-E_NO_MEM if there's no memory for a page table.
+int
+pager_map(envid_t envid, void *srcva, int perm)
+{
+	struct PageInfo *pp;
+	struct Env *e;
+	pte_t *pte;
+	int r;
+
+	if ((r = envid2env(envid, &e, 0)) < 0)
+		return r;
+	if (e->env_pager != curenv->env_id || !e->env_pager_waiting)
+		return -E_INVAL;
+
+	if ((uintptr_t) srcva < UTOP) {
+		if ((uintptr_t) srcva % PGSIZE)
+			return -E_INVAL;
+		if (!(perm & PTE_U) || !(perm & PTE_P) || (perm & ~PTE_SYSCALL))
+			return -E_INVAL;
+		pp = page_lookup(curenv->env_pgdir, srcva, &pte);
+		if (!pp || ((perm & PTE_W) && !(*pte & PTE_W)))
+			return -E_INVAL;
+		if ((r = page_insert(e->env_pgdir, pp,
+				     (void *) ROUNDDOWN(e->env_pager_va, PGSIZE),
+				     perm)) < 0)
+			return r;
+	} else
+		e->env_pager_refused = 1;
+
+	pager_cancel(e);
+	e->env_pager_waiting = 0;
+	e->env_status = ENV_RUNNABLE;
+	return 0;
+}
+
+// Pass e's outstanding fault to its pager p, which is in sys_ipc_recv.
+static void
+pager_deliver(struct Env *p, struct Env *e)
+{
+	p->env_ipc_recving = 0;
+	p->env_ipc_from = e->env_id;
+	p->env_ipc_value = PAGER_FAULT;
+	p->env_ipc_perm = 0;
+	p->env_status = ENV_RUNNABLE;
+	timer_cancel(p);
+	if (p->env_type != ENV_TYPE_USER && e->env_prio < p->env_prio)
+		p->env_prio = e->env_prio;
+}
+
+// Hand e's fault at va to its pager and run something else.  Returns
+// only if e has no pager, the pager refused this page already, or the
+// fault is for e's own page fault upcall (a write to a present page
+// the pager did not map copy-on-write).
+void
+pager_fault(struct Env *e, uintptr_t va, uint32_t err)
+{
+	struct Env *p;
+	pte_t *pte;
+
+	if (!e->env_pager || va >= UTOP)
+		return;
+	if ((err & FEC_PR) && e->env_pgfault_upcall
+	    && !((pte = pgdir_walk(e->env_pgdir, (void *) va, 0))
+		 && (*pte & PTE_PAGER)))
+		return;
+	if (e->env_pager_refused) {
+		e->env_pager_refused = 0;
+		if (ROUNDDOWN(va, PGSIZE) == ROUNDDOWN(e->env_pager_va, PGSIZE))
+			return;
+	}
+	if (envid2env(e->env_pager, &p, 0) < 0)
+		return;
+
+	e->env_pager_va = va;
+	e->env_pager_err = err;
+	e->env_pager_waiting = 1;
+	e->env_status = ENV_NOT_RUNNABLE;
+	if (p->env_ipc_recving)
+		pager_deliver(p, e);
+	else {
+		// The pager is busy: it picks the fault up when it next
+		// receives, and finishes its work at our priority.
+		e->env_pager_queued = 1;
+		npager_queued++;
+		if (p->env_type != ENV_TYPE_USER && e->env_prio < p->env_prio)
+			p->env_prio = e->env_prio;
+	}
+	sched_yield();
+}
+
+// Called when pager p starts to receive: hand it a queued fault, if
+// there is one, and return 1, or else return 0.
+int
+pager_recv(struct Env *p)
+{
+	int i;
+
+	for (i = 0; npager_queued && i < NENV; i++)
+		if (envs[i].env_pager_queued &&
+		    envs[i].env_pager == p->env_id) {
+			envs[i].env_pager_queued = 0;
+			npager_queued--;
+			pager_deliver(p, &envs[i]);
+			return 1;
+		}
+	return 0;
+}
+
+// Forget e's queued fault, as e is going away.
+void
+pager_cancel(struct Env *e)
+{
+	if (e->env_pager_queued) {
+		e->env_pager_queued = 0;
+		npager_queued--;
+	}
+}
+
+// A system call found user memory at va missing (or read-only, if
+// 'write').  If the current env is demand paged, have its pager map the
+// page and restart the system call once it has.
+void
+pager_syscall_fault(uintptr_t va, int write)
+{
+	struct Trapframe *tf = &curenv->env_tf;
+	uint32_t err = FEC_U;
+	pte_t *pte;
+
+	if (!curenv->env_pager || tf->tf_trapno != T_SYSCALL)
+		return;
+	if ((pte = pgdir_walk(curenv->env_pgdir, (void *) va, 0)) &&
+	    (*pte & PTE_P))
+		err |= FEC_PR;
+	if (write)
+		err |= FEC_WR;
+	// back up over the two-byte int $T_SYSCALL
+	tf->tf_eip -= 2;
+	pager_fault(curenv, va, err);
+	tf->tf_eip += 2;
+}
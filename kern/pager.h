@@ -0,0 +1,16 @@
+#ifndef JOS_KERN_PAGER_H
+#define JOS_KERN_PAGER_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+
+int pager_set(envid_t envid, envid_t pager);
+int pager_map(envid_t envid, void *srcva, int perm);
+void pager_fault(struct Env *e, uintptr_t va, uint32_t err);
+int pager_recv(struct Env *p);
+void pager_cancel(struct Env *e);
+void pager_syscall_fault(uintptr_t va, int write);
+
+#endif /* JOS_KERN_PAGER_H */
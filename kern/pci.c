@@ -32,6 +32,7 @@ struct pci_driver pci_attach_class[] = {
 // and key2 should be the vendor ID and device ID respectively
 struct pci_driver pci_attach_vendor[] = {
 	{ E1000_VENDOR_ID_82540EM, E1000_DEV_ID_82540EM, attach_e1000},
+	{ E1000_VENDOR_ID_82540EM, E1000_DEV_ID_82574L, attach_e1000e},
 	{ 0, 0, 0 },
 };
 
@@ -4,71 +4,169 @@
 #include <kern/env.h>
 #include <kern/pmap.h>
 #include <kern/monitor.h>
+#include <kern/time.h>
+
+// Length of a scheduling quantum.
+#define SCHED_QUANTUM_MS	10
 
 void sched_halt(void);
 
+// Every SCHED_BATCH_SHARE-th scheduling decision prefers batch envs
+// over normal ones, so that batch work still gets a share of the CPU.
+#define SCHED_BATCH_SHARE	8
+
+static unsigned int sched_rounds;
+
+static void
+sched_run(struct Env *e)
+{
+	if (e->env_runs && e->env_cpunum != cpunum())
+		thiscpu->cpu_migrations++;
+	time_arm(SCHED_QUANTUM_MS);
+	env_run(e);
+}
+
+// May e run on this CPU at all?
+static bool
+sched_allowed(struct Env *e)
+{
+	return e->env_cpumask & (1 << cpunum());
+}
+
+// Is e's cache and TLB state on this CPU, as far as we can tell?  An
+// env whose last CPU went idle is nobody else's, so it counts as ours.
+static bool
+sched_local(struct Env *e)
+{
+	return !e->env_runs || e->env_cpunum == cpunum()
+		|| cpus[e->env_cpunum].cpu_status == CPU_HALTED;
+}
+
+// Wake a halted CPU in 'mask' to run the envs that this one will not.
+// Idle CPUs take no timer interrupts, so they would not notice.
+static void
+sched_kick(uint32_t mask)
+{
+	int i;
+
+	for (i = 0; i < ncpu; i++)
+		if (&cpus[i] != thiscpu && (mask & (1 << i))
+		    && cpus[i].cpu_status == CPU_HALTED) {
+			lapic_ipi_cpu(cpus[i].cpu_id, IRQ_OFFSET + IRQ_TIMER);
+			return;
+		}
+}
+
 // Choose a user environment to run and run it.
+//
+// Envs are scheduled by class (env_prio): the most urgent class with a
+// runnable env wins, and envs of one class take turns round-robin,
+// searching 'envs' in circular fashion starting just after the env
+// this CPU was last running.  The env previously running on this CPU
+// keeps the CPU if it is still ENV_RUNNING and no env of its class or
+// a more urgent one is runnable.
+//
+// Envs stay on the CPU they last ran on: this CPU only steals an env
+// from a busy CPU when it has nothing of its own to run, and never
+// takes one outside the env's env_cpumask.
+//
+// Never choose an environment that's currently running on another CPU
+// (env_status == ENV_RUNNING).  If there are no runnable environments,
+// halt the CPU.
 void
 sched_yield(void)
 {
-	struct Env *idle;
-
-	// Implement simple round-robin scheduling.
-	//
-	// Search through 'envs' for an ENV_RUNNABLE environment in
-	// circular fashion starting just after the env this CPU was
-	// last running.  Switch to the first such environment found.
-	//
-	// If no envs are runnable, but the environment previously
-	// running on this CPU is still ENV_RUNNING, it's okay to
-	// choose that environment.
-	//
-	// Never choose an environment that's currently running on
-	// another CPU (env_status == ENV_RUNNING). If there are
-	// no runnable environments, simply drop through to the code
-	// below to halt the cpu.
-
-	// LAB 4: Your code here.
-	//cprintf("in sched\n"); //debug
-	struct Env * next;
-	if(curenv == NULL) {
-		//cprintf("curenv is NULL\n");
-		next = &envs[0];
-	}
-	else {
-		next = curenv + 1;
-	}
-	int times = 0;
-	while(times < NENV) {
-		times++;
-		if(next >= (envs + NENV)) {
-			next = envs;
+	struct Env *local[NENVPRIO] = { 0 }, *remote[NENVPRIO] = { 0 };
+	struct Env *e, *pick = NULL;
+	int order[NENVPRIO] = { ENV_PRIO_SERVER, ENV_PRIO_NORMAL, ENV_PRIO_BATCH };
+	uint32_t others = 0;
+	int i, running, ours, nrunnable = 0, nallowed = 0;
+
+	// An env whose affinity just excluded this CPU must go elsewhere
+	if (curenv && curenv->env_status == ENV_RUNNING && !sched_allowed(curenv))
+		curenv->env_status = ENV_RUNNABLE;
+
+	e = curenv ? curenv + 1 : envs;
+	for (i = 0; i < NENV; i++, e++) {
+		if (e >= envs + NENV)
+			e = envs;
+		if (e->env_status != ENV_RUNNABLE)
+			continue;
+		nrunnable++;
+		others |= e->env_cpumask;
+		if (!sched_allowed(e))
+			continue;
+		nallowed++;
+		if (!sched_local(e)) {
+			if (!remote[e->env_prio])
+				remote[e->env_prio] = e;
+			continue;
 		}
-		//cprintf("debug i is %d curenv is %d\n", next - envs, curenv == NULL ? -1 : curenv - envs); //debug
-		assert(next != NULL && (next - envs) >= 0 && (next - envs) < NENV);
-		if(next->env_status == ENV_RUNNABLE) {
+		if (local[e->env_prio])
+			continue;
+		local[e->env_prio] = e;
+		if (e->env_prio == ENV_PRIO_SERVER)
 			break;
-		}
-		next++;
 	}
-	//cprintf("break the while\n");
-	if(next != NULL) {
-		//cprintf("debug\n");
-		if(next->env_status == ENV_RUNNABLE){
-			//cprintf("choose %d to run\n", next->env_id);
-			env_run(next);
-		}
-		else if (curenv && curenv->env_status == ENV_RUNNING) {
-			env_run(curenv);
-		}
+
+	if (++sched_rounds % SCHED_BATCH_SHARE == 0) {
+		order[1] = ENV_PRIO_BATCH;
+		order[2] = ENV_PRIO_NORMAL;
+	}
+	for (i = 0; i < NENVPRIO && !pick; i++)
+		pick = local[order[i]];
+
+	// More work than this CPU can take on?  It takes one env if it
+	// is running one or may run one of the runnable ones, and none
+	// otherwise; kick the others if anything is left over.
+	running = curenv && curenv->env_status == ENV_RUNNING;
+	ours = (running || nallowed > 0) ? 1 : 0;
+	if (nrunnable + running > ours)
+		sched_kick(others);
+
+	if (curenv && curenv->env_status == ENV_RUNNING) {
+		for (i = 0; order[i] != curenv->env_prio; i++)
+			if (local[order[i]])
+				sched_run(pick);
+		if (!local[order[i]])
+			sched_run(curenv);
 	}
+
+	// Nothing of our own to run: steal rather than halt
+	if (!pick)
+		for (i = 0; i < NENVPRIO && !pick; i++)
+			pick = remote[order[i]];
+	if (pick)
+		sched_run(pick);
+
 	// sched_halt never returns
-	//cprintf("no runnable??\n");	//debug
+	sched_halt();
+}
+
+// Like sched_yield, but give the next runnable env a turn whatever
+// its class, for envs that give up the CPU to let someone else make
+// progress.
+void
+sched_yield_any(void)
+{
+	struct Env *e;
+	int i;
+
+	e = curenv ? curenv + 1 : envs;
+	for (i = 0; i < NENV; i++, e++) {
+		if (e >= envs + NENV)
+			e = envs;
+		if (e->env_status == ENV_RUNNABLE && sched_allowed(e))
+			sched_run(e);
+	}
+	if (curenv && curenv->env_status == ENV_RUNNING && sched_allowed(curenv))
+		sched_run(curenv);
 	sched_halt();
 }
 
 // Halt this CPU when there is nothing to do. Wait until the
-// timer interrupt wakes it up. This function never returns.
+// timer interrupt wakes it up, which with no sleepers to wake never
+// happens; some other interrupt must. This function never returns.
 //
 void
 sched_halt(void)
@@ -107,6 +205,9 @@ sched_halt(void)
 	// big kernel lock
 	xchg(&thiscpu->cpu_status, CPU_HALTED);
 
+	// No scheduling quantum while idle, only the timer wheel
+	time_arm(0);
+
 	// Release the big kernel lock as if we were "leaving" the kernel
 	unlock_kernel();
 
@@ -6,7 +6,8 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
-// This function does not return.
+// These functions do not return.
 void sched_yield(void) __attribute__((noreturn));
+void sched_yield_any(void) __attribute__((noreturn));
 
 #endif	// !JOS_KERN_SCHED_H
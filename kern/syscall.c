@@ -12,6 +12,8 @@
 #include <kern/console.h>
 #include <kern/sched.h>
 #include <kern/time.h>
+#include <kern/futex.h>
+#include <kern/pager.h>
 #include <kern/e1000.h>
 
 /* print syscall's name */
@@ -67,11 +69,88 @@ sys_env_destroy(envid_t envid)
 	return 0;
 }
 
+// Destroy the current environment, leaving 'status' for sys_env_wait.
+static void
+sys_env_exit(int status)
+{
+	curenv->env_exit_status = status;
+	env_destroy(curenv);
+}
+
+// Block until environment envid has been freed, without using the CPU
+// meanwhile, and return its exit status: the value it passed to
+// sys_env_exit, or -E_FAULT if it was destroyed any other way.
+// Returns at once if envid has already gone and its slot has not been
+// reused since.  Errors are:
+//	-E_BAD_ENV if envid is not, and was not recently, an environment.
+//	-E_INVAL if envid is the current environment.
+static int
+sys_env_wait(envid_t envid)
+{
+	struct Env *e = &envs[ENVX(envid)];
+
+	if (envid == 0 || e->env_id != envid)
+		return -E_BAD_ENV;
+	if (e->env_status == ENV_FREE)
+		return e->env_exit_status;
+	if (e == curenv)
+		return -E_INVAL;
+
+	env_wait_cancel(curenv);
+	curenv->env_wait_on = e;
+	curenv->env_wait_next = e->env_waiters;
+	e->env_waiters = curenv;
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	sched_yield();
+}
+
 // Deschedule current environment and pick a different one to run.
+// Envs yield while waiting on someone else, so give every runnable
+// env a turn, whatever its class.
 static void
 sys_yield(void)
 {
-	sched_yield();
+	sched_yield_any();
+}
+
+// Put envid in scheduling class prio (one of the ENV_PRIO_ values).
+// Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if prio is not a class, or is more urgent than the
+//		caller's own class.
+static int
+sys_env_set_priority(envid_t envid, int prio)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	if (prio < 0 || prio >= NENVPRIO || prio < curenv->env_base_prio)
+		return -E_INVAL;
+	e->env_base_prio = e->env_prio = prio;
+	return 0;
+}
+
+// Restrict envid to the CPUs whose bits are set in 'mask'; bit i stands
+// for cpus[i].  The env moves at its next scheduling decision.
+// Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if 'mask' contains none of the system's CPUs.
+static int
+sys_env_set_affinity(envid_t envid, uint32_t mask)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	if (ncpu < 32 && !(mask & ((1 << ncpu) - 1)))
+		return -E_INVAL;
+	e->env_cpumask = mask;
+	return 0;
 }
 
 // Allocate a new environment.
@@ -96,6 +175,11 @@ sys_exofork(void)
 		new_env->env_status = ENV_NOT_RUNNABLE;
 		memcpy( &(new_env->env_tf), &(curenv->env_tf), sizeof(struct Trapframe) );
 		new_env->env_tf.tf_regs.reg_eax = 0;
+		new_env->env_base_prio = new_env->env_prio = curenv->env_base_prio;
+		new_env->env_cpumask = curenv->env_cpumask;
+		// a forked child shares our unfaulted image pages
+		new_env->env_pager = curenv->env_pager;
+		new_env->env_pager_tag = curenv->env_pager_tag;
 		r = new_env->env_id;
 	}
 
@@ -127,6 +211,8 @@ sys_env_set_status(envid_t envid, int status)
 	}
 	assert(target_env != NULL);
 	assert(target_env->env_id == envid);
+	// an env woken this way is no longer waiting in sys_env_wait
+	env_wait_cancel(target_env);
 	target_env->env_status = status;
 	return 0;
 }
@@ -275,6 +361,10 @@ sys_page_map(envid_t srcenvid, void *srcva,
 	assert(srcenvid == 0 || src_env->env_id == srcenvid);
 	struct Env *dst_env = NULL;
 	r = envid2env(dstenvid, &dst_env, true);
+	// a pager may also map pages into the envs it pages in
+	if (r < 0 && envid2env(dstenvid, &dst_env, false) == 0 &&
+	    dst_env->env_pager == curenv->env_id)
+		r = 0;
 	if( r != 0 ) { /* fail */
 		return r;
 	}
@@ -393,6 +483,11 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 	}
 	
 	if(recv_env->env_ipc_recving == false) {
+		// Priority inheritance: the server is busy with someone
+		// else's request, so finish it at our priority.
+		if (recv_env->env_type != ENV_TYPE_USER &&
+		    curenv->env_prio < recv_env->env_prio)
+			recv_env->env_prio = curenv->env_prio;
 		return -E_IPC_NOT_RECV;
 	}
 	//cprintf("%d try to fuck env %d\n", curenv->env_id, envid);
@@ -424,6 +519,13 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 	//assert(value != 0);
 	recv_env->env_ipc_value = value;
 	recv_env->env_status = ENV_RUNNABLE;
+	timer_cancel(recv_env);
+	// A server handles each request at least at its client's
+	// priority; it may still hold more urgent clients' work, so a
+	// less urgent client never lowers it.
+	if (recv_env->env_type != ENV_TYPE_USER &&
+	    curenv->env_prio < recv_env->env_prio)
+		recv_env->env_prio = curenv->env_prio;
 	//recv_env->env_tf.tf_regs.reg_eax = 0;
 	//cprintf("%d finish fucking env %d\n", curenv->env_id,envid);
 	return 0;
@@ -437,18 +539,23 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 // If 'dstva' is < UTOP, then you are willing to receive a page of data.
 // 'dstva' is the virtual address at which the sent page should be mapped.
 //
+// If 'deadline' is nonzero, give up once time_msec() reaches it.
+//
 // This function only returns on error, but the system call will eventually
 // return 0 on success.
 // Return < 0 on error.  Errors are:
 //	-E_INVAL if dstva < UTOP but dstva is not page-aligned.
+//	-E_TIMEOUT if nothing was received before 'deadline'.
 static int
-sys_ipc_recv(void *dstva)
+sys_ipc_recv(void *dstva, unsigned int deadline)
 {
 	// LAB 4: Your code here.
 	if( (uintptr_t)dstva < UTOP && (uintptr_t)dstva % PGSIZE != 0) {
 		cprintf("dstva is not page-aligned\n");
 		return -E_INVAL;
 	}
+	if (deadline && deadline <= time_msec())
+		return -E_TIMEOUT;
 
 	//assert(curenv->env_ipc_recving == false);
 	curenv->env_status = ENV_NOT_RUNNABLE;
@@ -457,10 +564,27 @@ sys_ipc_recv(void *dstva)
 	curenv->env_tf.tf_regs.reg_eax = 0;
 	//cprintf("%d is ready to be fucked\n", curenv->env_id);
 	curenv->env_ipc_recving = true;
+	curenv->env_prio = curenv->env_base_prio;
+	// a page fault may be waiting for us already
+	if (!pager_recv(curenv) && deadline)
+		timer_set(curenv, deadline);
 	sched_yield();
 	return 0;
 }
 
+// Sleep until time_msec() reaches 'msec', off the run queue.
+// Returns 0 (at once, if 'msec' has already passed).
+static int
+sys_sleep_until(unsigned int msec)
+{
+	if (msec <= time_msec())
+		return 0;
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	curenv->env_tf.tf_regs.reg_eax = 0;
+	timer_set(curenv, msec);
+	sched_yield();
+}
+
 // Return the current time.
 static int
 sys_time_msec(void)
@@ -469,18 +593,49 @@ sys_time_msec(void)
 	return time_msec();
 }
 
+// Store the time in microseconds since boot in *usec.
+static int
+sys_time_usec(uint64_t *usec)
+{
+	user_mem_assert(curenv, usec, sizeof(*usec), PTE_U | PTE_W);
+	*usec = time_usec();
+	return 0;
+}
+
 static int sys_net_try_transmit(const char *s, int len){
 	// Check that the user has permission to read memory [s, s+len).
 	// Destroy the environment if not.
 	user_mem_assert(curenv, (void *)s, len, PTE_U|PTE_P);
-	return e1000_transmit(s, len);
+	return e1000_transmit(curenv->env_net_queue, s, len);
+}
+
+// Transmit a TCP super-segment of 'len' bytes whose first 'hdrlen'
+// bytes are the Ethernet/IP/TCP headers; the NIC cuts it into
+// 'mss'-sized frames.
+static int sys_net_try_transmit_tso(const char *s, int len, int hdrlen, int mss){
+	user_mem_assert(curenv, (void *)s, len, PTE_U|PTE_P);
+	return e1000_transmit_tso(curenv->env_net_queue, s, len, hdrlen, mss);
 }
 
 static int sys_net_try_receive(char *s){
 	//extern RX_BUFF_SIZE;
 	user_mem_assert(curenv, (void *)s, MIN_RECEIVE_BUFF_SIZE, PTE_U|PTE_P|PTE_W);
 	//cprintf("in sys_net_try_receive\n");
-	return e1000_receive(s);
+	return e1000_receive(curenv->env_net_queue, s);
+}
+
+// Return the number of receive/transmit queue pairs of the NIC.
+static int sys_net_queues(void){
+	return e1000_queues();
+}
+
+// Make the net syscalls of the current environment use NIC queue
+// 'queue' from now on.
+static int sys_net_set_queue(int queue){
+	if (queue < 0 || queue >= e1000_queues())
+		return -E_INVAL;
+	curenv->env_net_queue = queue;
+	return 0;
 }
 
 // Dispatches to the correct kernel function, passing the arguments.
@@ -568,7 +723,7 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 		break;
 	}
 	case SYS_ipc_recv: {
-		r = sys_ipc_recv((void *)a1);
+		r = sys_ipc_recv((void *)a1, a2);
 		break;
 	}
 	case SYS_time_msec: {
@@ -583,6 +738,58 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 		r = sys_net_try_receive((char *)a1);
 		break;
 	}
+	case SYS_net_try_transmit_tso: {
+		r = sys_net_try_transmit_tso((char *)a1, a2, a3, a4);
+		break;
+	}
+	case SYS_net_queues: {
+		r = sys_net_queues();
+		break;
+	}
+	case SYS_net_set_queue: {
+		r = sys_net_set_queue(a1);
+		break;
+	}
+	case SYS_sleep_until: {
+		r = sys_sleep_until(a1);
+		break;
+	}
+	case SYS_time_usec: {
+		r = sys_time_usec((uint64_t *)a1);
+		break;
+	}
+	case SYS_env_exit: {
+		sys_env_exit(a1);
+		break;
+	}
+	case SYS_env_wait: {
+		r = sys_env_wait(a1);
+		break;
+	}
+	case SYS_env_set_priority: {
+		r = sys_env_set_priority(a1, a2);
+		break;
+	}
+	case SYS_env_set_affinity: {
+		r = sys_env_set_affinity(a1, a2);
+		break;
+	}
+	case SYS_futex_wait: {
+		r = futex_wait((uint32_t *)a1, a2, a3);
+		break;
+	}
+	case SYS_futex_wake: {
+		r = futex_wake((uint32_t *)a1, a2);
+		break;
+	}
+	case SYS_env_set_pager: {
+		r = pager_set(a1, a2);
+		break;
+	}
+	case SYS_pager_map: {
+		r = pager_map(a1, (void *)a2, a3);
+		break;
+	}
 	default:
 		cprintf("syscallno is %d\n", syscallno);	//for debug
 		r = -E_INVAL;
@@ -1,26 +1,230 @@
 #include <kern/time.h>
+#include <kern/env.h>
+#include <kern/cpu.h>
+#include <kern/kclock.h>
+#include <kern/futex.h>
 #include <inc/assert.h>
+#include <inc/error.h>
+#include <inc/x86.h>
 
+// Time is read from the TSC, calibrated at boot against the PIT.
+static uint64_t tsc_base;
+static uint64_t tsc_per_ms;
+
+// The timer wheel has caught up with this millisecond.
 static unsigned int ticks;
+static unsigned int nr_timers;
+
+// Sleeping environments hang off a hierarchical timer wheel.  tw1 has
+// one slot per millisecond for the next TW1_SIZE ms; each slot of tw2
+// and tw3 covers a whole turn of the level below, and is cascaded down
+// a level when that level wraps around.  Adding, cancelling and
+// expiring a timer are all O(1); each timer is cascaded at most twice.
+#define TW1_BITS	8
+#define TW_BITS		6
+#define TW1_SIZE	(1 << TW1_BITS)
+#define TW_SIZE		(1 << TW_BITS)
+#define TW_RANGE	(1 << (TW1_BITS + 2 * TW_BITS))
+
+static struct Env *tw1[TW1_SIZE];
+static struct Env *tw2[TW_SIZE];
+static struct Env *tw3[TW_SIZE];
+
+#define CALIBRATE_MS	10
 
 void
 time_init(void)
 {
+	uint64_t tsc;
+
+	tsc = read_tsc();
+	pit_delay(CALIBRATE_MS * 1000);
+	tsc_base = read_tsc();
+	tsc_per_ms = (tsc_base - tsc) / CALIBRATE_MS;
+	if (tsc_per_ms == 0)
+		panic("time_init: TSC is not running");
+	cprintf("TSC: %u kHz\n", (unsigned int) tsc_per_ms);
 	ticks = 0;
 }
 
-// This should be called once per timer interrupt.  A timer interrupt
-// fires every 10 ms.
+static void
+timer_link(struct Env *e)
+{
+	unsigned int expires = e->env_timer_expires;
+	unsigned int delta = expires - ticks;
+	struct Env **slot;
+
+	if (delta < TW1_SIZE)
+		slot = &tw1[expires & (TW1_SIZE - 1)];
+	else if (delta < TW1_SIZE * TW_SIZE)
+		slot = &tw2[(expires >> TW1_BITS) & (TW_SIZE - 1)];
+	else {
+		// Too far out: park it in the last slot to be cascaded,
+		// and timer_run will put it back until it is due.
+		if (delta >= TW_RANGE)
+			expires = ticks + TW_RANGE - 1;
+		slot = &tw3[(expires >> (TW1_BITS + TW_BITS)) & (TW_SIZE - 1)];
+	}
+
+	e->env_timer_next = *slot;
+	if (*slot)
+		(*slot)->env_timer_pprev = &e->env_timer_next;
+	e->env_timer_pprev = slot;
+	*slot = e;
+}
+
+static void
+timer_unlink(struct Env *e)
+{
+	*e->env_timer_pprev = e->env_timer_next;
+	if (e->env_timer_next)
+		e->env_timer_next->env_timer_pprev = e->env_timer_pprev;
+	e->env_timer_pprev = NULL;
+}
+
+// Arrange for e, which the caller has marked ENV_NOT_RUNNABLE, to be
+// made runnable again once time_msec() reaches msec.  If e is then
+// blocked in sys_ipc_recv or sys_futex_wait, that fails with -E_TIMEOUT.
+void
+timer_set(struct Env *e, unsigned int msec)
+{
+	time_tick();
+	if (e->env_timer_pprev)
+		timer_unlink(e);
+	else
+		nr_timers++;
+	// this millisecond's slot has already been run
+	e->env_timer_expires = msec;
+	if ((int) (msec - ticks) <= 0)
+		e->env_timer_expires = ticks + 1;
+	timer_link(e);
+}
+
+// Disarm e's timer, if it has one.
+void
+timer_cancel(struct Env *e)
+{
+	if (e->env_timer_pprev) {
+		timer_unlink(e);
+		nr_timers--;
+	}
+}
+
+static void
+timer_expire(struct Env *e)
+{
+	if (e->env_status != ENV_NOT_RUNNABLE)
+		return;
+	if (e->env_ipc_recving) {
+		e->env_ipc_recving = false;
+		e->env_tf.tf_regs.reg_eax = -E_TIMEOUT;
+	}
+	if (e->env_futex_pprev) {
+		futex_cancel(e);
+		e->env_tf.tf_regs.reg_eax = -E_TIMEOUT;
+	}
+	e->env_status = ENV_RUNNABLE;
+}
+
+static void
+timer_cascade(struct Env **slot)
+{
+	struct Env *e, *next;
+
+	e = *slot;
+	*slot = NULL;
+	for (; e; e = next) {
+		next = e->env_timer_next;
+		timer_link(e);
+	}
+}
+
+static void
+timer_run(void)
+{
+	unsigned int idx = ticks & (TW1_SIZE - 1);
+	unsigned int idx2 = (ticks >> TW1_BITS) & (TW_SIZE - 1);
+	struct Env *e;
+
+	if (idx == 0) {
+		if (idx2 == 0)
+			timer_cascade(&tw3[(ticks >> (TW1_BITS + TW_BITS)) & (TW_SIZE - 1)]);
+		timer_cascade(&tw2[idx2]);
+	}
+
+	while ((e = tw1[idx])) {
+		timer_unlink(e);
+		if ((int) (e->env_timer_expires - ticks) > 0)
+			timer_link(e);
+		else {
+			nr_timers--;
+			timer_expire(e);
+		}
+	}
+}
+
+// Return the millisecond at which the wheel next has work to do:
+// the next non-empty slot of tw1, or else the next cascade.
+static unsigned int
+timer_next(void)
+{
+	unsigned int t;
+
+	for (t = ticks + 1; t & (TW1_SIZE - 1); t++)
+		if (tw1[t & (TW1_SIZE - 1)])
+			return t;
+	return t;
+}
+
+// Bring the timer wheel up to date, waking every environment whose
+// timer has expired.  Called on each timer interrupt, on any CPU.
 void
 time_tick(void)
 {
-	ticks++;
-	if (ticks * 10 < ticks)
-		panic("time_tick: time overflowed");
+	unsigned int now = time_msec();
+
+	if (!nr_timers) {
+		ticks = now;
+		return;
+	}
+	while ((int) (now - ticks) > 0) {
+		ticks++;
+		timer_run();
+	}
+}
+
+// Program this CPU's timer before leaving the kernel: for the end of
+// a quantum_ms scheduling quantum, or the next timer wheel event if
+// that is sooner.  An idle CPU passes 0 and gets no interrupts at all
+// while no timers are armed.
+void
+time_arm(unsigned int quantum_ms)
+{
+	uint64_t now = time_usec(), when = 0, next;
+
+	if (quantum_ms)
+		when = now + quantum_ms * 1000;
+	if (nr_timers) {
+		next = (uint64_t) timer_next() * 1000;
+		if (!when || next < when)
+			when = next;
+	}
+	if (!when)
+		lapic_timer(0);
+	else if (when <= now)
+		lapic_timer(1);
+	else
+		lapic_timer(when - now);
+}
+
+uint64_t
+time_usec(void)
+{
+	return (read_tsc() - tsc_base) * 1000 / tsc_per_ms;
 }
 
 unsigned int
 time_msec(void)
 {
-	return ticks * 10;
+	return (read_tsc() - tsc_base) / tsc_per_ms;
 }
@@ -4,8 +4,17 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
+#include <inc/types.h>
+
+struct Env;
+
 void time_init(void);
 void time_tick(void);
+void time_arm(unsigned int quantum_ms);
 unsigned int time_msec(void);
+uint64_t time_usec(void);
+
+void timer_set(struct Env *e, unsigned int msec);
+void timer_cancel(struct Env *e);
 
 #endif /* JOS_KERN_TIME_H */
@@ -14,6 +14,7 @@
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
 #include <kern/time.h>
+#include <kern/pager.h>
 
 static struct Taskstate ts;
 
@@ -253,10 +254,6 @@ trap_dispatch(struct Trapframe *tf)
 				panic("syscall failed %e", r);
 			}
 			*/
-			if(tf->tf_regs.reg_eax == SYS_ipc_recv) {
-				cprintf("return ?? value is %d, %e\n", r, r);
-				while(1);
-			}
 			tf->tf_regs.reg_eax = r;
 			break;
 		}
@@ -351,6 +348,9 @@ page_fault_handler(struct Trapframe *tf)
 	// We've already handled kernel-mode exceptions, so if we get here,
 	// the page fault happened in user mode.
 
+	// Demand-paged envs get missing pages from their pager.
+	pager_fault(curenv, fault_va, tf->tf_err);
+
 	// Call the environment's page fault upcall, if one exists.  Set up a
 	// page fault stack frame on the user exception stack (below
 	// UXSTACKTOP), then branch to curenv->env_pgfault_upcall.
@@ -38,6 +38,10 @@ static ssize_t devcons_read(struct Fd*, void*, size_t);
 static ssize_t devcons_write(struct Fd*, const void*, size_t);
 static int devcons_close(struct Fd*);
 static int devcons_stat(struct Fd*, struct Stat*);
+static int devcons_poll(struct Fd*, int);
+
+// A character devcons_poll took from the console, 0 if none
+static int cons_peeked;
 
 struct Dev devcons =
 {
@@ -46,7 +50,8 @@ struct Dev devcons =
 	.dev_read =	devcons_read,
 	.dev_write =	devcons_write,
 	.dev_close =	devcons_close,
-	.dev_stat =	devcons_stat
+	.dev_stat =	devcons_stat,
+	.dev_poll =	devcons_poll
 };
 
 int
@@ -83,8 +88,13 @@ devcons_read(struct Fd *fd, void *vbuf, size_t n)
 	if (n == 0)
 		return 0;
 
-	while ((c = sys_cgetc()) == 0)
+	if ((c = cons_peeked))
+		cons_peeked = 0;
+	while (c == 0 && (c = sys_cgetc()) == 0) {
+		if (fd->fd_omode & O_NONBLOCK)
+			return -E_AGAIN;
 		sys_yield();
+	}
 	if (c < 0)
 		return c;
 	if (c == 0x04)	// ctl-d is eof
@@ -111,6 +121,18 @@ devcons_write(struct Fd *fd, const void *vbuf, size_t n)
 	return tot;
 }
 
+// The console cannot be asked whether a character is waiting without
+// taking it, so keep it for devcons_read.
+static int
+devcons_poll(struct Fd *fd, int events)
+{
+	int c;
+
+	if (!cons_peeked && (events & POLLIN) && (c = sys_cgetc()) > 0)
+		cons_peeked = c;
+	return (cons_peeked ? POLLIN : 0) | POLLOUT;
+}
+
 static int
 devcons_close(struct Fd *fd)
 {
@@ -1,10 +1,15 @@
-
 #include <inc/lib.h>
 
 void
 exit(void)
 {
-	close_all();
-	sys_env_destroy(0);
+	exit_with(0);
 }
 
+// Exit, leaving 'status' for whoever waits for us.
+void
+exit_with(int status)
+{
+	close_all();
+	sys_env_exit(status);
+}
@@ -175,6 +175,7 @@ int
 dup(int oldfdnum, int newfdnum)
 {
 	int r;
+	size_t i = 0;
 	char *ova, *nva;
 	pte_t pte;
 	struct Fd *oldfd, *newfd;
@@ -187,9 +188,11 @@ dup(int oldfdnum, int newfdnum)
 	ova = fd2data(oldfd);
 	nva = fd2data(newfd);
 
-	if ((uvpd[PDX(ova)] & PTE_P) && (uvpt[PGNUM(ova)] & PTE_P))
-		if ((r = sys_page_map(0, ova, 0, nva, uvpt[PGNUM(ova)] & PTE_SYSCALL)) < 0)
-			goto err;
+	// share every page of the data area, which is mapped contiguously
+	if (uvpd[PDX(ova)] & PTE_P)
+		for (; i < PTSIZE && (uvpt[PGNUM(ova + i)] & PTE_P); i += PGSIZE)
+			if ((r = sys_page_map(0, ova + i, 0, nva + i, uvpt[PGNUM(ova + i)] & PTE_SYSCALL)) < 0)
+				goto err;
 	if ((r = sys_page_map(0, oldfd, 0, newfd, uvpt[PGNUM(oldfd)] & PTE_SYSCALL)) < 0)
 		goto err;
 
@@ -197,7 +200,10 @@ dup(int oldfdnum, int newfdnum)
 
 err:
 	sys_page_unmap(0, newfd);
-	sys_page_unmap(0, nva);
+	while (i > 0) {
+		i -= PGSIZE;
+		sys_page_unmap(0, nva + i);
+	}
 	return r;
 }
 
@@ -319,3 +325,85 @@ stat(const char *path, struct Stat *stat)
 	return r;
 }
 
+
+// Get the open mode of fdnum, or set its O_NONBLOCK flag.  Like the
+// rest of struct Fd, the mode is shared with dups and forked copies.
+int
+fcntl(int fdnum, int cmd, int arg)
+{
+	int r;
+	struct Fd *fd;
+
+	if ((r = fd_lookup(fdnum, &fd)) < 0)
+		return r;
+	switch (cmd) {
+	case F_GETFL:
+		return fd->fd_omode;
+	case F_SETFL:
+		fd->fd_omode = (fd->fd_omode & ~O_NONBLOCK) | (arg & O_NONBLOCK);
+		return 0;
+	default:
+		return -E_INVAL;
+	}
+}
+
+// While poll has fds other than sockets to watch, it waits for at most
+// this long at a time before looking at them again.
+#define POLL_SLICE_MSEC	5
+
+// Wait until one of the nfds fds in fds is ready for the events asked
+// for, or timeout milliseconds have passed (no time if 0, forever if
+// negative), and fill in their revents.  Fds without a dev_poll, like
+// files, are always ready.  Returns the number of ready fds.
+int
+poll(struct pollfd *fds, int nfds, int timeout)
+{
+	unsigned int now, until, deadline;
+	int i, n, r, nsock, nother;
+	struct Dev *dev;
+	struct Fd *fd;
+
+	deadline = timeout < 0 ? ~0U : sys_time_msec() + timeout;
+	while (1) {
+		n = nsock = nother = 0;
+		for (i = 0; i < nfds; i++) {
+			fds[i].revents = 0;
+			if (fds[i].fd < 0)
+				continue;
+			if (fd_lookup(fds[i].fd, &fd) < 0
+			    || dev_lookup(fd->fd_dev_id, &dev) < 0)
+				fds[i].revents = POLLNVAL;
+			else if (dev == &devsock) {
+				// left to sock_poll
+				nsock++;
+				continue;
+			} else if (dev->dev_poll)
+				fds[i].revents = (*dev->dev_poll)(fd, fds[i].events)
+					& (fds[i].events | POLLERR | POLLHUP);
+			else
+				fds[i].revents = fds[i].events & (POLLIN | POLLOUT);
+			nother++;
+			if (fds[i].revents)
+				n++;
+		}
+
+		// Sockets are waited for in the network server, in one
+		// request; fds of other kinds are looked at again every
+		// POLL_SLICE_MSEC.
+		now = sys_time_msec();
+		if (n > 0 || now >= deadline)
+			until = now;
+		else if (nother > 0)
+			until = MIN(deadline, now + POLL_SLICE_MSEC);
+		else
+			until = deadline;
+		if (nsock > 0) {
+			if ((r = sock_poll(fds, nfds, until)) < 0)
+				return r;
+			n += r;
+		} else if (until > now)
+			sys_sleep_until(until);
+		if (n > 0 || until >= deadline)
+			return n;
+	}
+}
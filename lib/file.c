@@ -189,6 +189,45 @@ devfile_trunc(struct Fd *fd, off_t newsize)
 }
 
 
+// Make the file server envid's pager, demand paging its program image
+// from the ELF executable open as fdnum.  On failure envid may be left
+// with the file server as its pager all the same.
+int
+file_pager(int fdnum, envid_t envid)
+{
+	struct Fd *fd;
+	int r;
+
+	if ((r = fd_lookup(fdnum, &fd)) < 0)
+		return r;
+	if (fd->fd_dev_id != devfile.dev_id)
+		return -E_INVAL;
+	// the file server maps cached pages in as soon as it has the request
+	if ((r = sys_env_set_pager(envid, ipc_find_env(ENV_TYPE_FS))) < 0)
+		return r;
+	fsipcbuf.pager.req_fileid = fd->fd_file.id;
+	fsipcbuf.pager.req_envid = envid;
+	return fsipc(FSREQ_PAGER, NULL);
+}
+
+// Map the file server's cache page holding byte offset of the file open
+// as fdnum read-only at dstva.  Returns the number of file bytes in the
+// page, counting from its start.
+int
+file_map_page(int fdnum, off_t offset, void *dstva)
+{
+	struct Fd *fd;
+	int r;
+
+	if ((r = fd_lookup(fdnum, &fd)) < 0)
+		return r;
+	if (fd->fd_dev_id != devfile.dev_id)
+		return -E_INVAL;
+	fsipcbuf.map.req_fileid = fd->fd_file.id;
+	fsipcbuf.map.req_offset = offset;
+	return fsipc(FSREQ_MAP, dstva);
+}
+
 // Synchronize disk with buffer cache
 int
 sync(void)
@@ -21,12 +21,21 @@
 //   a perfectly valid place to map a page.)
 int32_t
 ipc_recv(envid_t *from_env_store, void *pg, int *perm_store)
+{
+	return ipc_recv_until(from_env_store, pg, perm_store, 0);
+}
+
+// Like ipc_recv, but give up with -E_TIMEOUT once sys_time_msec()
+// reaches 'deadline'.  A zero deadline waits forever.
+int32_t
+ipc_recv_until(envid_t *from_env_store, void *pg, int *perm_store,
+	       unsigned int deadline)
 {
 	// LAB 4: Your code here.
 	if(pg == NULL) {
 		pg = (void *)UTOP;
 	}
-	int r = sys_ipc_recv(pg);
+	int r = sys_ipc_recv_until(pg, deadline);
 	if(r == 0){
 		if(from_env_store != NULL) { *from_env_store = thisenv->env_ipc_from; }
 		if(perm_store != NULL) { *perm_store = thisenv->env_ipc_perm; }
@@ -1,140 +1,263 @@
-
 #include <inc/lib.h>
 
 /*
- * Simple malloc/free.
+ * Size-class malloc/free.
+ *
+ * The heap is the address range from mbegin to mend, handed out in
+ * runs of whole pages tracked by the mused bitmap.
  *
- * Uses the address space to do most of the hard work.
- * The address space from mbegin to mend is scanned
- * in order.  Pages are allocated, used to fill successive
- * malloc requests, and then left alone.  Free decrements
- * a ref count maintained in the page; the page is freed
- * when the ref count hits zero.
+ * Requests of up to MAXSMALL bytes are rounded up to one of the sizes
+ * in sizes[] and carved out of single-page slabs of that size.  Each
+ * slab starts with a struct slab header and keeps its free chunks on
+ * a list threaded through the chunks themselves; the slabs of a size
+ * class with free chunks sit on that class's partial list.  Chunks are
+ * therefore never page aligned.
  *
- * If we need to allocate a large amount (more than a page)
- * we can't put a ref count at the end of each page,
- * so we mark the pte entry with the bit PTE_CONTINUED.
+ * Larger requests get a page-aligned run of their own, preceded by a
+ * header page recording the run's length, so free can tell the two
+ * apart by alignment alone.
+ *
+ * Freed pages stay mapped for reuse, up to MAXCACHED of them; beyond
+ * that they are returned to the kernel.
  */
-enum
-{
-	MAXMALLOC = 1024*1024	/* max size of one allocated chunk */
+
+#define HEAPPAGES	((mend - mbegin) / PGSIZE)
+#define MAXSMALL	2032
+#define MAXCACHED	256	/* free pages kept mapped */
+
+#define SLAB_MAGIC	0x51ab51ab
+#define RUN_MAGIC	0x5e9a5e9a
+
+struct slab {
+	uint32_t s_magic;
+	uint16_t s_class;		// index into sizes[]
+	uint16_t s_inuse;		// chunks handed out
+	void *s_free;			// freed chunks, linked through them
+	uint8_t *s_fresh;		// chunks never handed out start here
+	struct slab *s_next;		// partial list of the size class
+	struct slab *s_prev;
 };
 
-#define PTE_CONTINUED 0x200
+struct run {
+	uint32_t r_magic;
+	uint32_t r_npages;		// pages after the header page
+};
+
+#define SLAB_FIRST	ROUNDUP(sizeof(struct slab), 16)
+
+// The two largest are the most that fit 3 and 2 to a slab after its
+// SLAB_FIRST-byte header, rounded down to 16.
+static const uint16_t sizes[] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1344, 2032
+};
+#define NCLASSES	(sizeof(sizes) / sizeof(sizes[0]))
 
 static uint8_t *mbegin = (uint8_t*) 0x08000000;
 static uint8_t *mend   = (uint8_t*) 0x10000000;
-static uint8_t *mptr;
+
+static uint32_t mused[(0x10000000 - 0x08000000) / PGSIZE / 32];
+static size_t mhint;			// no free page below this index
+static size_t ncached;			// free pages still mapped
+static struct slab *partial[NCLASSES];
+static uint8_t class_of[MAXSMALL / 16 + 1];
 
 static int
-isfree(void *v, size_t n)
+page_used(size_t i)
 {
-	uintptr_t va, end_va = (uintptr_t) v + n;
+	return mused[i / 32] & (1 << (i % 32));
+}
 
-	for (va = (uintptr_t) v; va < end_va; va += PGSIZE)
-		if (va >= (uintptr_t) mend
-		    || ((uvpd[PDX(va)] & PTE_P) && (uvpt[PGNUM(va)] & PTE_P)))
-			return 0;
-	return 1;
+static int
+page_mapped(void *va)
+{
+	return (uvpd[PDX(va)] & PTE_P) && (uvpt[PGNUM(va)] & PTE_P);
 }
 
-void*
-malloc(size_t n)
+static void
+mark(size_t i, size_t n, int used)
 {
-	int i, cont;
-	int nwrap;
-	uint32_t *ref;
-	void *v;
+	for (; n > 0; i++, n--)
+		if (used)
+			mused[i / 32] |= 1 << (i % 32);
+		else
+			mused[i / 32] &= ~(1 << (i % 32));
+}
 
-	if (mptr == 0)
-		mptr = mbegin;
+// Give npages pages starting at va back: keep as many mapped as the
+// cache has room for, and return the rest to the kernel.
+static void
+run_free(void *va, size_t npages)
+{
+	size_t i, keep, first = ((uint8_t *) va - mbegin) / PGSIZE;
 
-	n = ROUNDUP(n, 4);
+	mark(first, npages, 0);
+	if (first < mhint)
+		mhint = first;
+	keep = MIN(npages, MAXCACHED - ncached);
+	ncached += keep;
+	for (i = keep; i < npages; i++)
+		sys_page_unmap(0, (uint8_t *) va + i * PGSIZE);
+}
 
-	if (n >= MAXMALLOC)
-		return 0;
+// Find and map a run of npages free pages, or return 0.
+static void *
+run_alloc(size_t npages)
+{
+	size_t i, start, len;
+	uint8_t *va;
 
-	if ((uintptr_t) mptr % PGSIZE){
-		/*
-		 * we're in the middle of a partially
-		 * allocated page - can we add this chunk?
-		 * the +4 below is for the ref count.
-		 */
-		ref = (uint32_t*) (ROUNDUP(mptr, PGSIZE) - 4);
-		if ((uintptr_t) mptr / PGSIZE == (uintptr_t) (mptr + n - 1 + 4) / PGSIZE) {
-			(*ref)++;
-			v = mptr;
-			mptr += n;
-			return v;
+	// first fit, skipping fully used bitmap words
+	start = mhint;
+	len = 0;
+	for (i = mhint; i < HEAPPAGES && len < npages; i++) {
+		if (i % 32 == 0 && mused[i / 32] == ~0U) {
+			i += 31;
+			len = 0;
+			start = i + 1;
+			continue;
 		}
-		/*
-		 * stop working on this page and move on.
-		 */
-		free(mptr);	/* drop reference to this page */
-		mptr = ROUNDDOWN(mptr + PGSIZE, PGSIZE);
+		if (page_used(i)) {
+			len = 0;
+			start = i + 1;
+		} else
+			len++;
 	}
+	if (len < npages)
+		return 0;	/* out of address space */
+	if (start == mhint)
+		mhint = start + npages;
 
-	/*
-	 * now we need to find some address space for this chunk.
-	 * if it's less than a page we leave it open for allocation.
-	 * runs of more than a page can't have ref counts so we
-	 * flag the PTE entries instead.
-	 */
-	nwrap = 0;
-	while (1) {
-		if (isfree(mptr, n + 4))
-			break;
-		mptr += PGSIZE;
-		if (mptr == mend) {
-			mptr = mbegin;
-			if (++nwrap == 2)
-				return 0;	/* out of address space */
+	va = mbegin + start * PGSIZE;
+	for (i = 0; i < npages; i++) {
+		if (page_mapped(va + i * PGSIZE)) {
+			ncached--;
+			continue;
+		}
+		if (sys_page_alloc(0, va + i * PGSIZE, PTE_P|PTE_U|PTE_W) < 0) {
+			// out of physical memory: give back what we got
+			run_free(va, i);
+			return 0;
 		}
 	}
+	mark(start, npages, 1);
+	return va;
+}
 
-	/*
-	 * allocate at mptr - the +4 makes sure we allocate a ref count.
-	 */
-	for (i = 0; i < n + 4; i += PGSIZE){
-		cont = (i + PGSIZE < n + 4) ? PTE_CONTINUED : 0;
-		if (sys_page_alloc(0, mptr + i, PTE_P|PTE_U|PTE_W|cont) < 0){
-			for (; i >= 0; i -= PGSIZE)
-				sys_page_unmap(0, mptr + i);
-			return 0;	/* out of physical memory */
-		}
+static void
+slab_unlink(struct slab *s)
+{
+	if (s->s_prev)
+		s->s_prev->s_next = s->s_next;
+	else
+		partial[s->s_class] = s->s_next;
+	if (s->s_next)
+		s->s_next->s_prev = s->s_prev;
+}
+
+static void
+slab_push(struct slab *s)
+{
+	s->s_prev = 0;
+	s->s_next = partial[s->s_class];
+	if (s->s_next)
+		s->s_next->s_prev = s;
+	partial[s->s_class] = s;
+}
+
+static void *
+small_alloc(int c)
+{
+	struct slab *s;
+	void *v;
+
+	if (!(s = partial[c])) {
+		if (!(s = run_alloc(1)))
+			return 0;
+		s->s_magic = SLAB_MAGIC;
+		s->s_class = c;
+		s->s_inuse = 0;
+		s->s_free = 0;
+		s->s_fresh = (uint8_t *) s + SLAB_FIRST;
+		slab_push(s);
+	}
+
+	if ((v = s->s_free))
+		s->s_free = *(void **) v;
+	else {
+		v = s->s_fresh;
+		s->s_fresh += sizes[c];
 	}
+	s->s_inuse++;
 
-	ref = (uint32_t*) (mptr + i - 4);
-	*ref = 2;	/* reference for mptr, reference for returned block */
-	v = mptr;
-	mptr += n;
+	// full: no more freed chunks and no room for a fresh one
+	if (!s->s_free && s->s_fresh + sizes[c] > (uint8_t *) s + PGSIZE)
+		slab_unlink(s);
 	return v;
 }
 
+static void
+small_free(struct slab *s, void *v)
+{
+	int c = s->s_class;
+
+	if (!s->s_free && s->s_fresh + sizes[c] > (uint8_t *) s + PGSIZE)
+		slab_push(s);
+	*(void **) v = s->s_free;
+	s->s_free = v;
+	// keep one empty slab per class around
+	if (--s->s_inuse == 0 && (s->s_next || s->s_prev)) {
+		slab_unlink(s);
+		s->s_magic = 0;
+		run_free(s, 1);
+	}
+}
+
+void*
+malloc(size_t n)
+{
+	struct run *r;
+	size_t m;
+	int c;
+
+	if (n <= MAXSMALL) {
+		if (!class_of[MAXSMALL / 16])
+			for (c = 0, m = 0; m <= MAXSMALL; m += 16) {
+				while (sizes[c] < m)
+					c++;
+				class_of[m / 16] = c;
+			}
+		return small_alloc(class_of[ROUNDUP(n, 16) / 16]);
+	}
+
+	if (n > (size_t) (mend - mbegin))
+		return 0;
+	n = ROUNDUP(n, PGSIZE) / PGSIZE;
+	if (!(r = run_alloc(n + 1)))
+		return 0;
+	r->r_magic = RUN_MAGIC;
+	r->r_npages = n;
+	return (uint8_t *) r + PGSIZE;
+}
+
 void
 free(void *v)
 {
-	uint8_t *c;
-	uint32_t *ref;
+	struct slab *s;
+	struct run *r;
 
 	if (v == 0)
 		return;
 	assert(mbegin <= (uint8_t*) v && (uint8_t*) v < mend);
 
-	c = ROUNDDOWN(v, PGSIZE);
-
-	while (uvpt[PGNUM(c)] & PTE_CONTINUED) {
-		sys_page_unmap(0, c);
-		c += PGSIZE;
-		assert(mbegin <= c && c < mend);
+	if ((uintptr_t) v % PGSIZE == 0) {
+		r = (struct run *) ((uint8_t *) v - PGSIZE);
+		assert(r->r_magic == RUN_MAGIC);
+		r->r_magic = 0;
+		run_free(r, r->r_npages + 1);
+		return;
 	}
 
-	/*
-	 * c is just a piece of this page, so dec the ref count
-	 * and maybe free the page.
-	 */
-	ref = (uint32_t*) (c + PGSIZE - 4);
-	if (--(*ref) == 0)
-		sys_page_unmap(0, c);
+	s = ROUNDDOWN(v, PGSIZE);
+	assert(s->s_magic == SLAB_MAGIC);
+	small_free(s, v);
 }
-
@@ -8,6 +8,22 @@
 #define REQVA		0x0ffff000
 union Nsipc nsipcbuf __attribute__((aligned(PGSIZE)));
 
+// Send a request on page pg to the network server, and wait for a reply.
+// value: the IPC value, starting with the request code.
+static int
+nsipc_page(uint32_t value, void *pg, int perm)
+{
+	static envid_t nsenv;
+	if (nsenv == 0)
+		nsenv = ipc_find_env(ENV_TYPE_NS);
+
+	if (debug)
+		cprintf("[%08x] nsipc %d\n", thisenv->env_id, NSREQ_TYPE(value));
+
+	ipc_send(nsenv, value, pg, perm);
+	return ipc_recv(NULL, NULL, NULL);
+}
+
 // Send an IP request to the network server, and wait for a reply.
 // The request body should be in nsipcbuf, and parts of the response
 // may be written back to nsipcbuf.
@@ -16,26 +32,29 @@ union Nsipc nsipcbuf __attribute__((aligned(PGSIZE)));
 static int
 nsipc(unsigned type)
 {
-	static envid_t nsenv;
-	if (nsenv == 0)
-		nsenv = ipc_find_env(ENV_TYPE_NS);
-
 	static_assert(sizeof(nsipcbuf) == PGSIZE);
 
-	if (debug)
-		cprintf("[%08x] nsipc %d\n", thisenv->env_id, type);
+	return nsipc_page(type, &nsipcbuf, PTE_P|PTE_W|PTE_U);
+}
 
-	ipc_send(nsenv, type, &nsipcbuf, PTE_P|PTE_W|PTE_U);
-	return ipc_recv(NULL, NULL, NULL);
+// Can the caller's buffer at pg be lent to the network server as a
+// whole page, instead of being copied through nsipcbuf?
+static bool
+nsipc_lendable(const void *pg, int perm)
+{
+	return PGOFF(pg) == 0 && (uvpd[PDX(pg)] & PTE_P)
+		&& (uvpt[PGNUM(pg)] & perm) == perm;
 }
 
 int
-nsipc_accept(int s, struct sockaddr *addr, socklen_t *addrlen)
+nsipc_accept(int s, struct sockaddr *addr, socklen_t *addrlen,
+	     unsigned int flags)
 {
 	int r;
 
 	nsipcbuf.accept.req_s = s;
 	nsipcbuf.accept.req_addrlen = *addrlen;
+	nsipcbuf.accept.req_flags = flags;
 	if ((r = nsipc(NSREQ_ACCEPT)) >= 0) {
 		struct Nsret_accept *ret = &nsipcbuf.acceptRet;
 		memmove(addr, &ret->ret_addr, ret->ret_addrlen);
@@ -90,12 +109,24 @@ nsipc_recv(int s, void *mem, int len, unsigned int flags)
 {
 	int r;
 
+	// The network server receives straight into a buffer that
+	// starts a writable page; the request goes in front of it.
+	if (len >= sizeof(struct Nsreq_recv)
+	    && nsipc_lendable(mem, PTE_P|PTE_W|PTE_U)) {
+		struct Nsreq_recv *req = mem;
+		req->req_s = s;
+		req->req_len = MIN(len, PGSIZE);
+		req->req_flags = flags;
+		return nsipc_page(NSREQ_RECV, mem, PTE_P|PTE_W|PTE_U);
+	}
+
+	// the reply comes back in ret_buf, which is all of nsipcbuf
 	nsipcbuf.recv.req_s = s;
-	nsipcbuf.recv.req_len = len;
+	nsipcbuf.recv.req_len = MIN(len, (int) sizeof(nsipcbuf));
 	nsipcbuf.recv.req_flags = flags;
 
 	if ((r = nsipc(NSREQ_RECV)) >= 0) {
-		assert(r < 1600 && r <= len);
+		assert(r <= len);
 		memmove(mem, nsipcbuf.recvRet.ret_buf, r);
 	}
 
@@ -105,8 +136,14 @@ nsipc_recv(int s, void *mem, int len, unsigned int flags)
 int
 nsipc_send(int s, const void *buf, int size, unsigned int flags)
 {
+	// Data that starts a page is sent from that page, the rest is
+	// copied through nsipcbuf; either way the count may come up short.
+	if (flags == 0 && s <= 0xff && nsipc_lendable(buf, PTE_P|PTE_U))
+		return nsipc_page(NSREQ_SENDPAGE_VALUE(s, MIN(size, PGSIZE)),
+				  (void *)buf, PTE_P|PTE_U);
+
+	size = MIN(size, 1024);
 	nsipcbuf.send.req_s = s;
-	assert(size < 1600);
 	memmove(&nsipcbuf.send.req_buf, buf, size);
 	nsipcbuf.send.req_size = size;
 	nsipcbuf.send.req_flags = flags;
@@ -121,3 +158,87 @@ nsipc_socket(int domain, int type, int protocol)
 	nsipcbuf.socket.req_protocol = protocol;
 	return nsipc(NSREQ_SOCKET);
 }
+
+// Send as many of the n datagrams of msgs as fit in one request page.
+// Returns the number sent.
+int
+nsipc_sendmmsg(int s, const struct mmsg *msgs, int n, unsigned int flags)
+{
+	char *p = nsipcbuf.mmsg.req_msgs, *end = (char *)&nsipcbuf + PGSIZE;
+	struct Nsmsg *m;
+	int i;
+
+	for (i = 0; i < n && msgs[i].mm_len >= 0
+		     && msgs[i].mm_len <= end - p - (int)sizeof(*m); i++) {
+		m = (struct Nsmsg *)p;
+		m->m_addr = msgs[i].mm_addr;
+		m->m_len = msgs[i].mm_len;
+		memmove(m->m_data, msgs[i].mm_buf, m->m_len);
+		p += NSMSG_SIZE(m->m_len);
+	}
+	if (i == 0)
+		return -E_INVAL;
+	nsipcbuf.mmsg.req_s = s;
+	nsipcbuf.mmsg.req_n = i;
+	nsipcbuf.mmsg.req_flags = flags;
+	return nsipc(NSREQ_SENDMMSG);
+}
+
+// Receive up to n datagrams into msgs in one request, waiting for the
+// first one unless flags has MSG_DONTWAIT.  Each is cut short to fit
+// its buffer.  Returns the number received.
+int
+nsipc_recvmmsg(int s, struct mmsg *msgs, int n, unsigned int flags)
+{
+	struct Nsmsg *m;
+	char *p;
+	int i, r, len = 0;
+
+	for (i = 0; i < n; i++)
+		len = MAX(len, msgs[i].mm_len);
+	nsipcbuf.mmsg.req_s = s;
+	nsipcbuf.mmsg.req_n = n;
+	nsipcbuf.mmsg.req_len = MIN(len, NSMMSG_SPACE - sizeof(*m));
+	nsipcbuf.mmsg.req_flags = flags;
+	if ((r = nsipc(NSREQ_RECVMMSG)) <= 0)
+		return r;
+
+	p = nsipcbuf.mmsg.req_msgs;
+	for (i = 0; i < r; i++) {
+		m = (struct Nsmsg *)p;
+		msgs[i].mm_addr = m->m_addr;
+		msgs[i].mm_len = MIN(msgs[i].mm_len, m->m_len);
+		memmove(msgs[i].mm_buf, m->m_data, msgs[i].mm_len);
+		p += NSMSG_SIZE(m->m_len);
+	}
+	return r;
+}
+
+// fds[i].fd are socket ids.  Waits in the network server until one of
+// them is ready, or until sys_time_msec() reaches deadline.
+int
+nsipc_poll(struct pollfd *fds, int nfds, unsigned int deadline)
+{
+	int i, r;
+
+	if (nfds > NSPOLL_MAXFDS)
+		return -E_INVAL;
+	nsipcbuf.poll.req_deadline = deadline;
+	nsipcbuf.poll.req_nfds = nfds;
+	memmove(nsipcbuf.poll.req_fds, fds, nfds * sizeof(*fds));
+	if ((r = nsipc(NSREQ_POLL)) >= 0)
+		for (i = 0; i < nfds; i++)
+			fds[i].revents = nsipcbuf.poll.req_fds[i].revents;
+	return r;
+}
+
+// Copy a snapshot of the network server's counters into st.
+int
+nsipc_stats(struct Nsret_stats *st)
+{
+	int r;
+
+	if ((r = nsipc(NSREQ_STATS)) >= 0)
+		memmove(st, &nsipcbuf.statsRet, sizeof(*st));
+	return r;
+}
@@ -1,4 +1,5 @@
 #include <inc/lib.h>
+#include <inc/x86.h>
 
 #define debug 0
 
@@ -6,6 +7,7 @@ static ssize_t devpipe_read(struct Fd *fd, void *buf, size_t n);
 static ssize_t devpipe_write(struct Fd *fd, const void *buf, size_t n);
 static int devpipe_stat(struct Fd *fd, struct Stat *stat);
 static int devpipe_close(struct Fd *fd);
+static int devpipe_poll(struct Fd *fd, int events);
 
 struct Dev devpipe =
 {
@@ -15,22 +17,58 @@ struct Dev devpipe =
 	.dev_write =	devpipe_write,
 	.dev_close =	devpipe_close,
 	.dev_stat =	devpipe_stat,
+	.dev_poll =	devpipe_poll,
 };
 
-#define PIPEBUFSIZ 32		// small to provoke races
+// Default size of a pipe's ring buffer.  pipe_sized picks another
+// power of two, up to PIPE_MAXBUFSIZ.
+#define PIPEBUFSIZ	(64 * 1024)
+#define PIPE_MAXBUFSIZ	(PTSIZE / 2)
 
+// Readers and writers block with sys_futex_wait on p_event, which
+// counts changes to the pipe, and are woken by whoever makes one.
+// Nothing is woken when an env holding one end dies without closing
+// it, so waiters also recheck every PIPE_RECHECK_MSEC.
+#define PIPE_RECHECK_MSEC 50
+
+// The control page is the first data page of both fds; the ring
+// buffer occupies the pages that follow it.
 struct Pipe {
-	off_t p_rpos;		// read position
-	off_t p_wpos;		// write position
-	uint8_t p_buf[PIPEBUFSIZ];	// data buffer
+	volatile uint32_t p_rpos;	// read position
+	volatile uint32_t p_wpos;	// write position
+	volatile uint32_t p_event;	// bumped on every change
+	volatile uint32_t p_waiters;	// envs blocked on p_event
+	uint32_t p_size;		// bytes in the ring, a power of two
 };
 
+#define PIPEBUF(p)	((uint8_t *) (p) + PGSIZE)
+
+static void
+pipe_unmap(void *va, size_t npages)
+{
+	while (npages-- > 0)
+		sys_page_unmap(0, (char *) va + npages * PGSIZE);
+}
+
 int
 pipe(int pfd[2])
+{
+	return pipe_sized(pfd, PIPEBUFSIZ);
+}
+
+// Like pipe, with a ring buffer of at least bufsize bytes.
+int
+pipe_sized(int pfd[2], size_t bufsize)
 {
 	int r;
 	struct Fd *fd0, *fd1;
+	struct Pipe *p;
 	void *va;
+	size_t size, i, npages;
+
+	for (size = PGSIZE; size < bufsize && size < PIPE_MAXBUFSIZ; size *= 2)
+		;
+	npages = 1 + size / PGSIZE;
 
 	// allocate the file descriptor table entries
 	if ((r = fd_alloc(&fd0)) < 0
@@ -41,12 +79,16 @@ pipe(int pfd[2])
 	    || (r = sys_page_alloc(0, fd1, PTE_P|PTE_W|PTE_U|PTE_SHARE)) < 0)
 		goto err1;
 
-	// allocate the pipe structure as first data page in both
+	// allocate the pipe structure and buffer as the data pages of both
 	va = fd2data(fd0);
-	if ((r = sys_page_alloc(0, va, PTE_P|PTE_W|PTE_U|PTE_SHARE)) < 0)
-		goto err2;
-	if ((r = sys_page_map(0, va, 0, fd2data(fd1), PTE_P|PTE_W|PTE_U|PTE_SHARE)) < 0)
-		goto err3;
+	for (i = 0; i < npages; i++)
+		if ((r = sys_page_alloc(0, (char *) va + i * PGSIZE, PTE_P|PTE_W|PTE_U|PTE_SHARE)) < 0)
+			goto err2;
+	for (i = 0; i < npages; i++)
+		if ((r = sys_page_map(0, (char *) va + i * PGSIZE, 0, (char *) fd2data(fd1) + i * PGSIZE, PTE_P|PTE_W|PTE_U|PTE_SHARE)) < 0)
+			goto err3;
+	p = (struct Pipe *) va;
+	p->p_size = size;
 
 	// set up fd structures
 	fd0->fd_dev_id = devpipe.dev_id;
@@ -63,8 +105,10 @@ pipe(int pfd[2])
 	return 0;
 
     err3:
-	sys_page_unmap(0, va);
+	pipe_unmap(fd2data(fd1), i);
+	i = npages;
     err2:
+	pipe_unmap(va, i);
 	sys_page_unmap(0, fd1);
     err1:
 	sys_page_unmap(0, fd0);
@@ -101,11 +145,42 @@ pipeisclosed(int fdnum)
 	return _pipeisclosed(fd, p);
 }
 
+// Tell waiters on the other end that we moved rpos or wpos, or closed.
+static void
+pipe_notify(struct Pipe *p)
+{
+	// the locked add orders our update of the pipe before the
+	// p_waiters check, pairing with pipe_wait
+	atomic_add(&p->p_event, 1);
+	if (p->p_waiters)
+		sys_futex_wake(&p->p_event, NENV);
+}
+
+// Block until the other end changes the pipe, unless it is already
+// ready: readable for a reader, writable for a writer, or closed.
+static void
+pipe_wait(struct Fd *fd, struct Pipe *p, bool writer)
+{
+	uint32_t event;
+	bool ready;
+
+	atomic_add(&p->p_waiters, 1);
+	event = p->p_event;
+	if (writer)
+		ready = p->p_wpos - p->p_rpos < p->p_size;
+	else
+		ready = p->p_rpos != p->p_wpos;
+	if (!ready && !_pipeisclosed(fd, p))
+		sys_futex_wait(&p->p_event, event,
+			       sys_time_msec() + PIPE_RECHECK_MSEC);
+	atomic_add(&p->p_waiters, -1);
+}
+
 static ssize_t
 devpipe_read(struct Fd *fd, void *vbuf, size_t n)
 {
 	uint8_t *buf;
-	size_t i;
+	size_t i, m, off;
 	struct Pipe *p;
 
 	p = (struct Pipe*)fd2data(fd);
@@ -114,25 +189,31 @@ devpipe_read(struct Fd *fd, void *vbuf, size_t n)
 			thisenv->env_id, uvpt[PGNUM(p)], n, p->p_rpos, p->p_wpos);
 
 	buf = vbuf;
-	for (i = 0; i < n; i++) {
+	for (i = 0; i < n; i += m) {
 		while (p->p_rpos == p->p_wpos) {
 			// pipe is empty
 			// if we got any data, return it
 			if (i > 0)
-				return i;
+				goto out;
 			// if all the writers are gone, note eof
 			if (_pipeisclosed(fd, p))
 				return 0;
-			// yield and see what happens
+			if (fd->fd_omode & O_NONBLOCK)
+				return -E_AGAIN;
+			// sleep until a writer does something
 			if (debug)
-				cprintf("devpipe_read yield\n");
-			sys_yield();
+				cprintf("devpipe_read wait\n");
+			pipe_wait(fd, p, 0);
 		}
-		// there's a byte.  take it.
-		// wait to increment rpos until the byte is taken!
-		buf[i] = p->p_buf[p->p_rpos % PIPEBUFSIZ];
-		p->p_rpos++;
+		// take as much as is there, up to the end of the ring.
+		// wait to advance rpos until the bytes are taken!
+		off = p->p_rpos & (p->p_size - 1);
+		m = MIN(MIN(n - i, p->p_wpos - p->p_rpos), p->p_size - off);
+		memmove(buf + i, PIPEBUF(p) + off, m);
+		p->p_rpos += m;
 	}
+out:
+	pipe_notify(p);
 	return i;
 }
 
@@ -140,7 +221,7 @@ static ssize_t
 devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 {
 	const uint8_t *buf;
-	size_t i;
+	size_t i, m, off;
 	struct Pipe *p;
 
 	p = (struct Pipe*) fd2data(fd);
@@ -149,25 +230,38 @@ devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 			thisenv->env_id, uvpt[PGNUM(p)], n, p->p_rpos, p->p_wpos);
 
 	buf = vbuf;
-	for (i = 0; i < n; i++) {
-		while (p->p_wpos >= p->p_rpos + sizeof(p->p_buf)) {
+	for (i = 0; i < n; i += m) {
+		while (p->p_wpos - p->p_rpos >= p->p_size) {
 			// pipe is full
 			// if all the readers are gone
 			// (it's only writers like us now),
 			// note eof
 			if (_pipeisclosed(fd, p))
 				return 0;
-			// yield and see what happens
+			// a non-blocking write takes what fits
+			if (fd->fd_omode & O_NONBLOCK) {
+				if (i == 0)
+					return -E_AGAIN;
+				goto out;
+			}
+			// let readers see what we wrote so far, and
+			// sleep until one makes room
 			if (debug)
-				cprintf("devpipe_write yield\n");
-			sys_yield();
+				cprintf("devpipe_write wait\n");
+			pipe_notify(p);
+			pipe_wait(fd, p, 1);
 		}
-		// there's room for a byte.  store it.
-		// wait to increment wpos until the byte is stored!
-		p->p_buf[p->p_wpos % PIPEBUFSIZ] = buf[i];
-		p->p_wpos++;
+		// fill as much room as there is, up to the end of the ring.
+		// wait to advance wpos until the bytes are stored!
+		off = p->p_wpos & (p->p_size - 1);
+		m = MIN(MIN(n - i, p->p_size - (p->p_wpos - p->p_rpos)),
+			p->p_size - off);
+		memmove(PIPEBUF(p) + off, buf + i, m);
+		p->p_wpos += m;
 	}
 
+out:
+	pipe_notify(p);
 	return i;
 }
 
@@ -182,10 +276,30 @@ devpipe_stat(struct Fd *fd, struct Stat *stat)
 	return 0;
 }
 
+static int
+devpipe_poll(struct Fd *fd, int events)
+{
+	struct Pipe *p = (struct Pipe*) fd2data(fd);
+	int revents = 0;
+
+	if (p->p_rpos != p->p_wpos)
+		revents |= POLLIN;
+	if (p->p_wpos - p->p_rpos < p->p_size)
+		revents |= POLLOUT;
+	if (_pipeisclosed(fd, p))
+		revents |= POLLHUP;
+	return revents;
+}
+
 static int
 devpipe_close(struct Fd *fd)
 {
+	struct Pipe *p = (struct Pipe *) fd2data(fd);
+
 	(void) sys_page_unmap(0, fd);
-	return sys_page_unmap(0, fd2data(fd));
+	pipe_unmap(PIPEBUF(p), p->p_size / PGSIZE);
+	// wake the other end to notice; if it checks before we unmap
+	// the control page, it notices after PIPE_RECHECK_MSEC instead
+	pipe_notify(p);
+	return sys_page_unmap(0, p);
 }
-
@@ -37,6 +37,8 @@ static const char * const error_string[MAXERROR] =
 	[E_NOT_SUPP]	= "operation not supported",
 	[E_NO_TX]		= "out of E1000 TX",
 	[E_NO_RX]		= "out of E1000 RX",
+	[E_TIMEOUT]	= "timed out",
+	[E_AGAIN]	= "operation would block",
 };
 
 /*
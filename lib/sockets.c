@@ -47,13 +47,25 @@ alloc_sockfd(int sockid)
 	return fd2num(sfd);
 }
 
+// Socket calls on an O_NONBLOCK fd fail with -E_AGAIN instead of
+// waiting for the peer.
+static unsigned int
+sock_flags(int fdnum)
+{
+	struct Fd *sfd;
+
+	if (fd_lookup(fdnum, &sfd) < 0 || !(sfd->fd_omode & O_NONBLOCK))
+		return 0;
+	return MSG_DONTWAIT;
+}
+
 int
 accept(int s, struct sockaddr *addr, socklen_t *addrlen)
 {
 	int r;
 	if ((r = fd2sockid(s)) < 0)
 		return r;
-	if ((r = nsipc_accept(r, addr, addrlen)) < 0)
+	if ((r = nsipc_accept(r, addr, addrlen, sock_flags(s))) < 0)
 		return r;
 	return alloc_sockfd(r);
 }
@@ -106,13 +118,24 @@ listen(int s, int backlog)
 static ssize_t
 devsock_read(struct Fd *fd, void *buf, size_t n)
 {
-	return nsipc_recv(fd->fd_sock.sockid, buf, n, 0);
+	return nsipc_recv(fd->fd_sock.sockid, buf, n,
+			  fd->fd_omode & O_NONBLOCK ? MSG_DONTWAIT : 0);
 }
 
 static ssize_t
 devsock_write(struct Fd *fd, const void *buf, size_t n)
 {
-	return nsipc_send(fd->fd_sock.sockid, buf, n, 0);
+	size_t sent;
+	int r;
+
+	if (fd->fd_omode & O_NONBLOCK)
+		return nsipc_send(fd->fd_sock.sockid, buf, n, MSG_DONTWAIT);
+	// a blocking write sends it all, one nsipc_send chunk at a time
+	for (sent = 0; sent < n; sent += r)
+		if ((r = nsipc_send(fd->fd_sock.sockid, (const char *) buf + sent,
+				    n - sent, 0)) <= 0)
+			return sent > 0 ? sent : r;
+	return sent;
 }
 
 static int
@@ -130,3 +153,101 @@ socket(int domain, int type, int protocol)
 		return r;
 	return alloc_sockfd(r);
 }
+
+// Send len bytes of the file open as filefd, starting at offset, on
+// sockfd.  Each file page is mapped from the file server's block cache
+// and lent on to the network server as it is, so nothing is copied on
+// the way and memory use does not depend on len.  Returns the number of
+// bytes sent, which is short at end of file.
+ssize_t
+sendfile(int sockfd, int filefd, off_t offset, size_t len)
+{
+	ssize_t sent = 0;
+	char *pg = (char *) UTEMP, *p;
+	int s, r = 0, n;
+
+	if ((s = fd2sockid(sockfd)) < 0)
+		return s;
+
+	while (len > 0) {
+		if ((r = file_map_page(filefd, offset, pg)) <= 0)
+			break;
+		p = pg + PGOFF(offset);
+		for (n = MIN(r - PGOFF(offset), len); n > 0; n -= r) {
+			// only whole pages are lent; the odd head of the
+			// first one goes through nsipcbuf
+			r = nsipc_send(s, p, n, 0);
+			if (r <= 0)
+				break;
+			p += r;
+			sent += r;
+			offset += r;
+			len -= r;
+		}
+		sys_page_unmap(0, pg);
+		if (r <= 0)
+			break;
+	}
+	return sent > 0 ? sent : r;
+}
+
+// Fill in revents for the socket fds among fds, leaving the others
+// alone.  All of them go to the network server in one request, which
+// waits until one is ready or sys_time_msec() reaches deadline.
+// Returns the number of ready sockets.
+int
+sock_poll(struct pollfd *fds, int nfds, unsigned int deadline)
+{
+	static struct pollfd sfds[NSPOLL_MAXFDS];
+	static int idx[NSPOLL_MAXFDS];
+	int i, n, r;
+
+	for (i = n = 0; i < nfds; i++) {
+		if (fds[i].fd < 0 || (r = fd2sockid(fds[i].fd)) < 0)
+			continue;
+		if (n == NSPOLL_MAXFDS)
+			return -E_INVAL;
+		sfds[n].fd = r;
+		sfds[n].events = fds[i].events;
+		idx[n++] = i;
+	}
+	if (n == 0)
+		return 0;
+	if ((r = nsipc_poll(sfds, n, deadline)) < 0)
+		return r;
+	for (i = 0; i < n; i++)
+		fds[idx[i]].revents = sfds[i].revents;
+	return r;
+}
+
+// Send the n datagrams of msgs on the UDP socket s, each to its mm_addr
+// or, if mm_addr.sin_family is 0, to the connected peer.  As many as
+// fit go to the network server in each request page, so a batch of
+// small datagrams costs one round trip instead of one per datagram.
+// Returns the number sent, which is short if one of them fails.
+int
+sendmmsg(int s, const struct mmsg *msgs, int n)
+{
+	int id, i, r = 0;
+
+	if ((id = fd2sockid(s)) < 0)
+		return id;
+	for (i = 0; i < n; i += r)
+		if ((r = nsipc_sendmmsg(id, msgs + i, n - i, sock_flags(s))) <= 0)
+			break;
+	return i > 0 ? i : r;
+}
+
+// Receive up to n datagrams from the UDP socket s into msgs, waiting
+// for the first one unless s is O_NONBLOCK, then taking whatever else
+// is already waiting.  Each mm_len is set to the datagram's length, cut
+// short to its buffer.  Returns the number received.
+int
+recvmmsg(int s, struct mmsg *msgs, int n)
+{
+	int r;
+
+	if ((r = fd2sockid(s)) < 0)
+		return r;
+	return nsipc_recvmmsg(r, msgs, n, sock_flags(s));
+}
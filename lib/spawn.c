@@ -9,6 +9,8 @@
 static int init_stack(envid_t child, const char **argv, uintptr_t *init_esp);
 static int map_segment(envid_t child, uintptr_t va, size_t memsz,
 		       int fd, size_t filesz, off_t fileoffset, int perm);
+static int map_bss(envid_t child, uintptr_t va, size_t memsz,
+		   size_t filesz, int perm);
 static int copy_shared_pages(envid_t child);
 
 // Spawn a child process from a program image loaded from the file system.
@@ -26,7 +28,7 @@ spawn(const char *prog, const char **argv)
 	int fd, i, r;
 	struct Elf *elf;
 	struct Proghdr *ph;
-	int perm;
+	int perm, lazy;
 
 	// This code follows this procedure:
 	//
@@ -110,7 +112,13 @@ spawn(const char *prog, const char **argv)
 	if ((r = init_stack(child, argv, &child_tf.tf_esp)) < 0)
 		return r;
 
-	// Set up program segments as defined in ELF header.
+	// Set up program segments as defined in ELF header.  If the
+	// file server will page the child in on demand, only the bss
+	// needs mapping now; otherwise load everything.
+	lazy = file_pager(fd, child) >= 0;
+	// sys_exofork left the child with our own pager, if any
+	if (!lazy && (r = sys_env_set_pager(child, 0)) < 0)
+		goto error;
 	ph = (struct Proghdr*) (elf_buf + elf->e_phoff);
 	for (i = 0; i < elf->e_phnum; i++, ph++) {
 		if (ph->p_type != ELF_PROG_LOAD)
@@ -118,8 +126,13 @@ spawn(const char *prog, const char **argv)
 		perm = PTE_P | PTE_U;
 		if (ph->p_flags & ELF_PROG_FLAG_WRITE)
 			perm |= PTE_W;
-		if ((r = map_segment(child, ph->p_va, ph->p_memsz,
-				     fd, ph->p_filesz, ph->p_offset, perm)) < 0)
+		if (lazy)
+			r = map_bss(child, ph->p_va, ph->p_memsz,
+				    ph->p_filesz, perm);
+		else
+			r = map_segment(child, ph->p_va, ph->p_memsz,
+					fd, ph->p_filesz, ph->p_offset, perm);
+		if (r < 0)
 			goto error;
 	}
 	close(fd);
@@ -296,6 +309,21 @@ map_segment(envid_t child, uintptr_t va, size_t memsz,
 	return 0;
 }
 
+// Allocate the pages of a demand-paged segment that hold no file data.
+// Mapping them up front keeps page-aligned bss buffers, like fsipcbuf,
+// usable in system calls from the start.
+static int
+map_bss(envid_t child, uintptr_t va, size_t memsz, size_t filesz, int perm)
+{
+	uintptr_t pg;
+	int r;
+
+	for (pg = ROUNDUP(va + filesz, PGSIZE); pg < va + memsz; pg += PGSIZE)
+		if ((r = sys_page_alloc(child, (void*) pg, perm)) < 0)
+			return r;
+	return 0;
+}
+
 // Copy the mappings for shared pages into the child address space.
 static int
 copy_shared_pages(envid_t child)
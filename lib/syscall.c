@@ -55,6 +55,54 @@ sys_env_destroy(envid_t envid)
 	return syscall(SYS_env_destroy, 1, envid, 0, 0, 0, 0);
 }
 
+void
+sys_env_exit(int status)
+{
+	syscall(SYS_env_exit, 0, status, 0, 0, 0, 0);
+}
+
+int
+sys_env_wait(envid_t envid)
+{
+	return syscall(SYS_env_wait, 0, envid, 0, 0, 0, 0);
+}
+
+int
+sys_env_set_priority(envid_t envid, int prio)
+{
+	return syscall(SYS_env_set_priority, 1, envid, prio, 0, 0, 0);
+}
+
+int
+sys_env_set_affinity(envid_t envid, uint32_t mask)
+{
+	return syscall(SYS_env_set_affinity, 1, envid, mask, 0, 0, 0);
+}
+
+int
+sys_futex_wait(volatile uint32_t *va, uint32_t expected, unsigned int deadline)
+{
+	return syscall(SYS_futex_wait, 0, (uint32_t) va, expected, deadline, 0, 0);
+}
+
+int
+sys_futex_wake(volatile uint32_t *va, int n)
+{
+	return syscall(SYS_futex_wake, 0, (uint32_t) va, n, 0, 0, 0);
+}
+
+int
+sys_env_set_pager(envid_t envid, envid_t pager)
+{
+	return syscall(SYS_env_set_pager, 1, envid, pager, 0, 0, 0);
+}
+
+int
+sys_pager_map(envid_t envid, void *pg, int perm)
+{
+	return syscall(SYS_pager_map, 1, envid, (uint32_t) pg, perm, 0, 0);
+}
+
 envid_t
 sys_getenvid(void)
 {
@@ -117,15 +165,42 @@ sys_ipc_recv(void *dstva)
 	return syscall(SYS_ipc_recv, 1, (uint32_t)dstva, 0, 0, 0, 0);
 }
 
+int
+sys_ipc_recv_until(void *dstva, unsigned int deadline)
+{
+	return syscall(SYS_ipc_recv, 0, (uint32_t)dstva, deadline, 0, 0, 0);
+}
+
 unsigned int
 sys_time_msec(void)
 {
 	return (unsigned int) syscall(SYS_time_msec, 0, 0, 0, 0, 0, 0);
 }
 
+uint64_t
+sys_time_usec(void)
+{
+	uint64_t usec;
+
+	syscall(SYS_time_usec, 1, (uint32_t) &usec, 0, 0, 0, 0);
+	return usec;
+}
+
 int sys_net_try_transmit(const char *s, size_t len) {
 	return syscall(SYS_net_try_transmit, 0, (uint32_t)s, len, 0, 0, 0);
 }
 int sys_net_try_receive(char *s) {
 	return syscall(SYS_net_try_receive, 0, (uint32_t)s, 0, 0, 0, 0);
-}
\ No newline at end of file
+}
+int sys_net_try_transmit_tso(const char *s, size_t len, int hdrlen, int mss) {
+	return syscall(SYS_net_try_transmit_tso, 0, (uint32_t)s, len, hdrlen, mss, 0);
+}
+int sys_net_queues(void) {
+	return syscall(SYS_net_queues, 0, 0, 0, 0, 0, 0);
+}
+int sys_net_set_queue(int queue) {
+	return syscall(SYS_net_set_queue, 0, queue, 0, 0, 0, 0);
+}
+int sys_sleep_until(unsigned int msec) {
+	return syscall(SYS_sleep_until, 0, msec, 0, 0, 0, 0);
+}
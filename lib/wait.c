@@ -1,13 +1,9 @@
 #include <inc/lib.h>
 
-// Waits until 'envid' exits.
-void
+// Waits until 'envid' exits, and returns its exit status.
+int
 wait(envid_t envid)
 {
-	const volatile struct Env *e;
-
 	assert(envid != 0);
-	e = &envs[ENVX(envid)];
-	while (e->env_id == envid && e->env_status != ENV_FREE)
-		sys_yield();
+	return sys_env_wait(envid);
 }
@@ -1,8 +1,28 @@
 #include "ns.h"
 #include <inc/assert.h>
 #include <inc/lib.h>
+#include <jif/jif.h>
 extern union Nsipc nsipcbuf;
 
+// Receive straight into the shared receive ring; the network server
+// only hears from us when it went to sleep on an empty ring.
+static void
+input_ring(struct jif_ring *ring)
+{
+	struct jif_pkt *pkt;
+	int r;
+
+	while (1) {
+		pkt = jif_ring_reserve(ring, PGSIZE);
+		while ((r = sys_net_try_receive(pkt->jp_data)) == -E_NO_RX)
+			sys_yield();
+		if (r < 0)
+			panic("sys_net_try_receive: %e", r);
+		pkt->jp_len = r;
+		jif_ring_commit(ring, PGSIZE);
+	}
+}
+
 void
 input(envid_t ns_envid)
 {
@@ -14,6 +34,10 @@ input(envid_t ns_envid)
 	// Hint: When you IPC a page to the network server, it will be
 	// reading from it for a while, so don't immediately receive
 	// another packet in to the same physical page.
+	// the network server picked our NIC queue before starting us
+	if (jif_ring_producer(JIF_RXRING(thisenv->env_net_queue)))
+		input_ring(JIF_RXRING(thisenv->env_net_queue));
+
 	while(1) {
 		/* safe: alloc a page on the same va multi times will unmap previous page */
 		if((r = sys_page_alloc(0, &nsipcbuf, PTE_U | PTE_P | PTE_W)) != 0){
@@ -1914,6 +1914,28 @@ lwip_ioctl(int s, long cmd, void *argp)
     sock_set_errno(sock, 0);
     return 0;
 
+#if LWIP_TCP
+  case FIONSPACE:
+    /* How many bytes a send on a TCP socket queues without waiting
+       for the peer: what fits in the send buffer, in segments that
+       fit in the send queue (each taking up to two pbufs). */
+    if (!argp || NETCONNTYPE_GROUP(sock->conn->type) != NETCONN_TCP ||
+        sock->conn->pcb.tcp == NULL) {
+      sock_set_errno(sock, EINVAL);
+      return -1;
+    }
+    if (sock->conn->pcb.tcp->snd_queuelen >= TCP_SND_QUEUELEN) {
+      *((int*)argp) = 0;
+    } else {
+      *((int*)argp) = LWIP_MIN(tcp_sndbuf(sock->conn->pcb.tcp),
+        (TCP_SND_QUEUELEN - sock->conn->pcb.tcp->snd_queuelen) / 2 *
+        sock->conn->pcb.tcp->mss);
+    }
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_ioctl(%d, FIONSPACE, %p) = %d\n", s, argp, *((int*)argp)));
+    sock_set_errno(sock, 0);
+    return 0;
+#endif /* LWIP_TCP */
+
   default:
     LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_ioctl(%d, UNIMPL: 0x%lx, %p)\n", s, cmd, argp));
     sock_set_errno(sock, ENOSYS); /* not yet implemented */
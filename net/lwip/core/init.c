@@ -94,9 +94,21 @@
 #if (LWIP_TCP && (MEMP_NUM_TCP_PCB<=0))
   #error "If you want to use TCP, you have to define MEMP_NUM_TCP_PCB>=1 in your lwipopts.h"
 #endif
-#if (LWIP_TCP && (TCP_WND > 0xffff))
+#if (LWIP_TCP && !LWIP_WND_SCALE && (TCP_WND > 0xffff))
   #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
+#if (LWIP_TCP && !LWIP_WND_SCALE && (TCP_SND_BUF > 0xffff))
+  #error "If you want to use TCP, TCP_SND_BUF must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_WND_SCALE && ((TCP_RCV_SCALE > 14) || (TCP_WND > (0xffffUL << TCP_RCV_SCALE))))
+  #error "If you want to use TCP window scaling, TCP_RCV_SCALE must be at most 14 and TCP_WND must fit in an u16_t after scaling, so, you have to change them in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_WND_SCALE && (TCP_SNDLOWAT >= 0xffff))
+  #error "If you want to use TCP window scaling, TCP_SNDLOWAT must fit in an u16_t (tcp_sndbuf() is clamped to 0xffff), so, you have to reduce it in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_TCP_SACK_OUT && ((LWIP_TCP_MAX_SACK_NUM < 1) || (LWIP_TCP_MAX_SACK_NUM > 4)))
+  #error "If you want to send TCP SACKs, LWIP_TCP_MAX_SACK_NUM must be between 1 and 4 in your lwipopts.h"
+#endif
 #if (LWIP_TCP && (TCP_SND_QUEUELEN > 0xffff))
   #error "If you want to use TCP, TCP_SND_QUEUELEN must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
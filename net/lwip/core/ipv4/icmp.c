@@ -119,7 +119,7 @@ icmp_input(struct pbuf *p, struct netif *inp)
        */
       struct pbuf *r;
       /* switch p->payload to ip header */
-      if (pbuf_header(p, hlen)) {
+      if (pbuf_header_force(p, hlen)) {
         LWIP_ASSERT("icmp_input: moving p->payload to ip header failed\n", 0);
         goto memerr;
       }
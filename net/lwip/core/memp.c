@@ -105,9 +105,11 @@ struct memp {
 
 #endif /* MEMP_OVERFLOW_CHECK */
 
+#if !MEMP_GROW
 /** This array holds the first free element of each pool.
  *  Elements form a linked list. */
 static struct memp *memp_tab[MEMP_MAX];
+#endif /* !MEMP_GROW */
 
 /** This array holds the element sizes of each pool. */
 #if !MEM_USE_POOLS
@@ -125,18 +127,42 @@ static const u16_t memp_num[MEMP_MAX] = {
 };
 
 /** This array holds a textual description of each pool. */
-#ifdef LWIP_DEBUG
+#if defined(LWIP_DEBUG) || MEMP_GROW
 static const char *memp_desc[MEMP_MAX] = {
 #define LWIP_MEMPOOL(name,num,size,desc)  (desc),
 #include "lwip/memp_std.h"
 };
-#endif /* LWIP_DEBUG */
+#endif /* LWIP_DEBUG || MEMP_GROW */
 
+#if MEMP_GROW
+#if MEMP_OVERFLOW_CHECK || MEMP_SANITY_CHECK
+#error "MEMP_GROW does not support MEMP_OVERFLOW_CHECK or MEMP_SANITY_CHECK"
+#endif
+
+/** Header at the start of each slab; its elements follow. */
+struct memp_slab {
+  struct memp_slab *next;  /* partial list of the pool */
+  struct memp_slab *prev;
+  struct memp *free;       /* free elements of this slab */
+  u16_t type;
+  u16_t inuse;             /* elements handed out */
+};
+
+#define MEMP_SLAB_HDR      LWIP_MEM_ALIGN_SIZE(sizeof(struct memp_slab))
+#define MEMP_SLAB_OF(mem)  ((struct memp_slab *)((mem_ptr_t)(mem) & ~(mem_ptr_t)(MEMP_GROW_SLAB - 1)))
+
+/** The slabs of each pool that have free elements */
+static struct memp_slab *memp_partial[MEMP_MAX];
+/** Number of elements in a slab of each pool */
+static u16_t memp_perslab[MEMP_MAX];
+static struct memp_pool_stats memp_pstats[MEMP_MAX];
+#else /* MEMP_GROW */
 /** This is the actual memory used by the pools. */
 static u8_t memp_memory[MEM_ALIGNMENT - 1 
 #define LWIP_MEMPOOL(name,num,size,desc) + ( (num) * (MEMP_SIZE + MEMP_ALIGN_SIZE(size) ) )
 #include "lwip/memp_std.h"
 ];
+#endif /* MEMP_GROW */
 
 #if MEMP_SANITY_CHECK
 /**
@@ -241,6 +267,200 @@ memp_overflow_init(void)
 }
 #endif /* MEMP_OVERFLOW_CHECK */
 
+#if MEMP_GROW
+static void
+memp_slab_unlink(struct memp_slab *slab)
+{
+  if (slab->prev != NULL) {
+    slab->prev->next = slab->next;
+  } else {
+    memp_partial[slab->type] = slab->next;
+  }
+  if (slab->next != NULL) {
+    slab->next->prev = slab->prev;
+  }
+}
+
+static void
+memp_slab_push(struct memp_slab *slab)
+{
+  slab->prev = NULL;
+  slab->next = memp_partial[slab->type];
+  if (slab->next != NULL) {
+    slab->next->prev = slab;
+  }
+  memp_partial[slab->type] = slab;
+}
+
+/**
+ * Get a new slab for pool type from the port and put all its elements
+ * on its free list.
+ */
+static struct memp_slab *
+memp_slab_new(memp_t type)
+{
+  struct memp_slab *slab;
+  struct memp *memp;
+  u16_t j;
+
+  slab = memp_slab_alloc();
+  if (slab == NULL) {
+    return NULL;
+  }
+  LWIP_ASSERT("memp_slab_new: slab properly aligned",
+              MEMP_SLAB_OF(slab) == slab);
+  slab->type = type;
+  slab->inuse = 0;
+  slab->free = NULL;
+  memp = (struct memp *)((u8_t *)slab + MEMP_SLAB_HDR);
+  for (j = 0; j < memp_perslab[type]; ++j) {
+    memp->next = slab->free;
+    slab->free = memp;
+    memp = (struct memp *)((u8_t *)memp + MEMP_SIZE + memp_sizes[type]);
+  }
+  memp_slab_push(slab);
+  if (++memp_pstats[type].slabs > memp_pstats[type].max_slabs) {
+    memp_pstats[type].max_slabs = memp_pstats[type].slabs;
+  }
+  return slab;
+}
+
+/**
+ * Report the usage of one pool.
+ *
+ * @param type the pool to report on
+ * @param st where to store the statistics
+ */
+void
+memp_pool_stats(memp_t type, struct memp_pool_stats *st)
+{
+  LWIP_ERROR("memp_pool_stats: type < MEMP_MAX", (type < MEMP_MAX), return;);
+  *st = memp_pstats[type];
+}
+
+/**
+ * Initialize this module.
+ *
+ * All pools start out empty.
+ */
+void
+memp_init(void)
+{
+  u16_t i;
+
+  for (i = 0; i < MEMP_MAX; ++i) {
+    MEMP_STATS_AVAIL(used, i, 0);
+    MEMP_STATS_AVAIL(max, i, 0);
+    MEMP_STATS_AVAIL(err, i, 0);
+    MEMP_STATS_AVAIL(avail, i, memp_num[i]);
+    memp_partial[i] = NULL;
+    memp_perslab[i] = (MEMP_GROW_SLAB - MEMP_SLAB_HDR) / (MEMP_SIZE + memp_sizes[i]);
+    LWIP_ASSERT("memp_init: pool element larger than a slab", memp_perslab[i] > 0);
+    memset(&memp_pstats[i], 0, sizeof(memp_pstats[i]));
+    memp_pstats[i].name = memp_desc[i];
+    memp_pstats[i].size = memp_sizes[i];
+    memp_pstats[i].limit = memp_num[i];
+  }
+}
+
+/**
+ * Get an element from a specific pool, growing it by a slab if it has
+ * no free element left.
+ *
+ * @param type the pool to get an element from
+ *
+ * @return a pointer to the allocated memory or a NULL pointer on error
+ */
+void *
+memp_malloc(memp_t type)
+{
+  struct memp_slab *slab = NULL;
+  struct memp *memp = NULL;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  LWIP_ERROR("memp_malloc: type < MEMP_MAX", (type < MEMP_MAX), return NULL;);
+
+  SYS_ARCH_PROTECT(old_level);
+
+  if (memp_pstats[type].used < memp_num[type]) {
+    slab = memp_partial[type];
+    if (slab == NULL) {
+      slab = memp_slab_new(type);
+    }
+  }
+
+  if (slab != NULL) {
+    memp = slab->free;
+    slab->free = memp->next;
+    if (slab->free == NULL) {
+      memp_slab_unlink(slab);
+    }
+    slab->inuse++;
+    if (++memp_pstats[type].used > memp_pstats[type].max) {
+      memp_pstats[type].max = memp_pstats[type].used;
+    }
+    MEMP_STATS_INC_USED(used, type);
+    LWIP_ASSERT("memp_malloc: memp properly aligned",
+                ((mem_ptr_t)memp % MEM_ALIGNMENT) == 0);
+    memp = (struct memp*)((u8_t*)memp + MEMP_SIZE);
+  } else {
+    LWIP_DEBUGF(MEMP_DEBUG | 2, ("memp_malloc: out of memory in pool %s\n", memp_desc[type]));
+    memp_pstats[type].err++;
+    MEMP_STATS_INC(err, type);
+  }
+
+  SYS_ARCH_UNPROTECT(old_level);
+
+  return memp;
+}
+
+/**
+ * Put an element back into its pool, and the slab it came from back to
+ * the port if it was the last element in use and the pool has another
+ * slab with free elements.
+ *
+ * @param type the pool where to put mem
+ * @param mem the memp element to free
+ */
+void
+memp_free(memp_t type, void *mem)
+{
+  struct memp_slab *slab;
+  struct memp *memp;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  if (mem == NULL) {
+    return;
+  }
+  LWIP_ASSERT("memp_free: mem properly aligned",
+                ((mem_ptr_t)mem % MEM_ALIGNMENT) == 0);
+
+  memp = (struct memp *)((u8_t*)mem - MEMP_SIZE);
+  slab = MEMP_SLAB_OF(memp);
+  LWIP_ASSERT("memp_free: mem belongs to pool type", slab->type == type);
+
+  SYS_ARCH_PROTECT(old_level);
+
+  MEMP_STATS_DEC(used, type);
+  memp_pstats[type].used--;
+
+  if (slab->free == NULL) {
+    memp_slab_push(slab);
+  }
+  memp->next = slab->free;
+  slab->free = memp;
+
+  if (--slab->inuse == 0 && (slab->next != NULL || slab->prev != NULL)) {
+    memp_slab_unlink(slab);
+    memp_pstats[type].slabs--;
+    memp_slab_free(slab);
+  }
+
+  SYS_ARCH_UNPROTECT(old_level);
+}
+
+#else /* MEMP_GROW */
+
 /**
  * Initialize this module.
  * 
@@ -368,3 +588,5 @@ memp_free(memp_t type, void *mem)
 
   SYS_ARCH_UNPROTECT(old_level);
 }
+
+#endif /* MEMP_GROW */
@@ -563,6 +563,8 @@ netif_loop_output(struct netif *netif, struct pbuf *p,
     r = NULL;
     return err;
   }
+  /* it never leaves memory, so the receiver may trust its checksum */
+  r->flags |= PBUF_FLAG_LOOPBACK;
 
   /* Put the packet on a linked list which gets emptied through calling
      netif_poll(). */
@@ -391,9 +391,9 @@ tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog)
 void
 tcp_recved(struct tcp_pcb *pcb, u16_t len)
 {
-  if ((u32_t)pcb->rcv_wnd + len > TCP_WND) {
-    pcb->rcv_wnd = TCP_WND;
-    pcb->rcv_ann_wnd = TCP_WND;
+  if ((u32_t)pcb->rcv_wnd + len > TCP_WND_MAX(pcb)) {
+    pcb->rcv_wnd = TCP_WND_MAX(pcb);
+    pcb->rcv_ann_wnd = TCP_WND_MAX(pcb);
   } else {
     pcb->rcv_wnd += len;
     if (pcb->rcv_wnd >= pcb->mss) {
@@ -415,7 +415,7 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
      */
     tcp_ack(pcb);
   } 
-  else if (pcb->flags & TF_ACK_DELAY && pcb->rcv_wnd >= TCP_WND/2) {
+  else if (pcb->flags & TF_ACK_DELAY && pcb->rcv_wnd >= TCP_WND_MAX(pcb)/2) {
     /* If we can send a window update such that there is a full
      * segment available in the window, do so now.  This is sort of
      * nagle-like in its goals, and tries to hit a compromise between
@@ -426,8 +426,8 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
     tcp_ack_now(pcb);
   }
 
-  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U16_F" (%"U16_F").\n",
-         len, pcb->rcv_wnd, TCP_WND - pcb->rcv_wnd));
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"TCPWNDSIZE_F" (%"TCPWNDSIZE_F").\n",
+         len, pcb->rcv_wnd, TCP_WND_MAX(pcb) - pcb->rcv_wnd));
 }
 
 /**
@@ -485,7 +485,7 @@ err_t
 tcp_connect(struct tcp_pcb *pcb, struct ip_addr *ipaddr, u16_t port,
       err_t (* connected)(void *arg, struct tcp_pcb *tpcb, err_t err))
 {
-  u32_t optdata;
+  u32_t optdata[TCP_SYN_OPTIONS_MAXLEN / 4];
   err_t ret;
   u32_t iss;
 
@@ -506,9 +506,10 @@ tcp_connect(struct tcp_pcb *pcb, struct ip_addr *ipaddr, u16_t port,
   pcb->snd_nxt = iss;
   pcb->lastack = iss - 1;
   pcb->snd_lbb = iss - 1;
-  pcb->rcv_wnd = TCP_WND;
-  pcb->rcv_ann_wnd = TCP_WND;
-  pcb->snd_wnd = TCP_WND;
+  /* no scaling until the SYN|ACK says the remote host scales too */
+  pcb->rcv_wnd = TCPWND16(TCP_WND);
+  pcb->rcv_ann_wnd = TCPWND16(TCP_WND);
+  pcb->snd_wnd = TCPWND16(TCP_WND);
   /* As initial send MSS, we use TCP_MSS but limit it to 536.
      The send MSS is updated when an MSS option is received. */
   pcb->mss = (TCP_MSS > 536) ? 536 : TCP_MSS;
@@ -526,10 +527,9 @@ tcp_connect(struct tcp_pcb *pcb, struct ip_addr *ipaddr, u16_t port,
 
   snmp_inc_tcpactiveopens();
   
-  /* Build an MSS option */
-  optdata = TCP_BUILD_MSS_OPTION();
-
-  ret = tcp_enqueue(pcb, NULL, 0, TCP_SYN, 0, (u8_t *)&optdata, 4);
+  /* Build the MSS, window scale and SACK-permitted options */
+  ret = tcp_enqueue(pcb, NULL, 0, TCP_SYN, 0, (u8_t *)optdata,
+                    tcp_syn_options(pcb, optdata));
   if (ret == ERR_OK) { 
     tcp_output(pcb);
   }
@@ -547,7 +547,7 @@ void
 tcp_slowtmr(void)
 {
   struct tcp_pcb *pcb, *pcb2, *prev;
-  u16_t eff_wnd;
+  tcpwnd_size_t eff_wnd;
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   err_t err;
 
@@ -615,8 +615,8 @@ tcp_slowtmr(void)
             pcb->ssthresh = pcb->mss * 2;
           }
           pcb->cwnd = pcb->mss;
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"U16_F
-                                       " ssthresh %"U16_F"\n",
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
+                                       " ssthresh %"TCPWNDSIZE_F"\n",
                                        pcb->cwnd, pcb->ssthresh));
  
           /* The following needs to be called AFTER cwnd is set to one
@@ -988,8 +988,8 @@ tcp_alloc(u8_t prio)
     pcb->prio = TCP_PRIO_NORMAL;
     pcb->snd_buf = TCP_SND_BUF;
     pcb->snd_queuelen = 0;
-    pcb->rcv_wnd = TCP_WND;
-    pcb->rcv_ann_wnd = TCP_WND;
+    pcb->rcv_wnd = TCPWND16(TCP_WND);
+    pcb->rcv_ann_wnd = TCPWND16(TCP_WND);
     pcb->tos = 0;
     pcb->ttl = TCP_TTL;
     /* As initial send MSS, we use TCP_MSS but limit it to 536.
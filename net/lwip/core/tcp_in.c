@@ -131,8 +131,8 @@ tcp_input(struct pbuf *p, struct netif *inp)
   }
 
 #if CHECKSUM_CHECK_TCP
-  /* Verify TCP checksum. */
-  if (inet_chksum_pseudo(p, (struct ip_addr *)&(iphdr->src),
+  /* Verify TCP checksum, unless the segment was looped back in memory. */
+  if (!(p->flags & PBUF_FLAG_LOOPBACK) && inet_chksum_pseudo(p, (struct ip_addr *)&(iphdr->src),
       (struct ip_addr *)&(iphdr->dest),
       IP_PROTO_TCP, p->tot_len) != 0) {
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packet discarded due to failing checksum 0x%04"X16_F"\n",
@@ -314,7 +314,19 @@ tcp_input(struct pbuf *p, struct netif *inp)
            called when new send buffer space is available, we call it
            now. */
         if (pcb->acked > 0) {
+#if LWIP_WND_SCALE
+          /* the sent callback takes an u16_t, so report ACKs for more
+             than that in pieces */
+          tcpwnd_size_t acked = pcb->acked;
+          u16_t acked16;
+          while (acked > 0) {
+            acked16 = (u16_t)LWIP_MIN(acked, 0xffff);
+            acked -= acked16;
+            TCP_EVENT_SENT(pcb, acked16, err);
+          }
+#else /* LWIP_WND_SCALE */
           TCP_EVENT_SENT(pcb, pcb->acked, err);
+#endif /* LWIP_WND_SCALE */
         }
       
         if (recv_data != NULL) {
@@ -393,7 +405,7 @@ static err_t
 tcp_listen_input(struct tcp_pcb_listen *pcb)
 {
   struct tcp_pcb *npcb;
-  u32_t optdata;
+  u32_t optdata[TCP_SYN_OPTIONS_MAXLEN / 4];
 
   /* In the LISTEN state, we check for incoming SYN segments,
      creates a new PCB, and responds with a SYN|ACK. */
@@ -451,10 +463,10 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 
     snmp_inc_tcppassiveopens();
 
-    /* Build an MSS option. */
-    optdata = TCP_BUILD_MSS_OPTION();
-    /* Send a SYN|ACK together with the MSS option. */
-    tcp_enqueue(npcb, NULL, 0, TCP_SYN | TCP_ACK, 0, (u8_t *)&optdata, 4);
+    /* Send a SYN|ACK together with the MSS option, and the window
+       scale and SACK-permitted options if the SYN had them. */
+    tcp_enqueue(npcb, NULL, 0, TCP_SYN | TCP_ACK, 0, (u8_t *)optdata,
+                tcp_syn_options(npcb, optdata));
     return tcp_output(npcb);
   }
   return ERR_OK;
@@ -596,7 +608,7 @@ tcp_process(struct tcp_pcb *pcb)
        !(flags & TCP_RST)) {
       /* expected ACK number? */
       if (TCP_SEQ_BETWEEN(ackno, pcb->lastack+1, pcb->snd_nxt)) {
-        u16_t old_cwnd;
+        tcpwnd_size_t old_cwnd;
         pcb->state = ESTABLISHED;
         LWIP_DEBUGF(TCP_DEBUG, ("TCP connection established %"U16_F" -> %"U16_F".\n", inseg.tcphdr->src, inseg.tcphdr->dest));
 #if LWIP_CALLBACK_API
@@ -728,17 +740,17 @@ tcp_receive(struct tcp_pcb *pcb)
     /* Update window. */
     if (TCP_SEQ_LT(pcb->snd_wl1, seqno) ||
        (pcb->snd_wl1 == seqno && TCP_SEQ_LT(pcb->snd_wl2, ackno)) ||
-       (pcb->snd_wl2 == ackno && tcphdr->wnd > pcb->snd_wnd)) {
-      pcb->snd_wnd = tcphdr->wnd;
+       (pcb->snd_wl2 == ackno && SND_WND_SCALE(pcb, tcphdr->wnd) > pcb->snd_wnd)) {
+      pcb->snd_wnd = SND_WND_SCALE(pcb, tcphdr->wnd);
       pcb->snd_wl1 = seqno;
       pcb->snd_wl2 = ackno;
       if (pcb->snd_wnd > 0 && pcb->persist_backoff > 0) {
           pcb->persist_backoff = 0;
       }
-      LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"U16_F"\n", pcb->snd_wnd));
+      LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"TCPWNDSIZE_F"\n", pcb->snd_wnd));
 #if TCP_WND_DEBUG
     } else {
-      if (pcb->snd_wnd != tcphdr->wnd) {
+      if (pcb->snd_wnd != SND_WND_SCALE(pcb, tcphdr->wnd)) {
         LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: no window update lastack %"U32_F" snd_max %"U32_F" ackno %"U32_F" wl1 %"U32_F" seqno %"U32_F" wl2 %"U32_F"\n",
                                pcb->lastack, pcb->snd_max, ackno, pcb->snd_wl1, seqno, pcb->snd_wl2));
       }
@@ -769,7 +781,7 @@ tcp_receive(struct tcp_pcb *pcb)
 
             /* The minimum value for ssthresh should be 2 MSS */
             if (pcb->ssthresh < 2*pcb->mss) {
-              LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_receive: The minimum value for ssthresh %"U16_F" should be min 2 mss %"U16_F"...\n", pcb->ssthresh, 2*pcb->mss));
+              LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_receive: The minimum value for ssthresh %"TCPWNDSIZE_F" should be min 2 mss %"U16_F"...\n", pcb->ssthresh, 2*pcb->mss));
               pcb->ssthresh = 2*pcb->mss;
             }
 
@@ -778,7 +790,7 @@ tcp_receive(struct tcp_pcb *pcb)
           } else {
             /* Inflate the congestion window, but not if it means that
                the value overflows. */
-            if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+            if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
               pcb->cwnd += pcb->mss;
             }
           }
@@ -804,8 +816,9 @@ tcp_receive(struct tcp_pcb *pcb)
       /* Reset the retransmission time-out. */
       pcb->rto = (pcb->sa >> 3) + pcb->sv;
 
-      /* Update the send buffer space. Diff between the two can never exceed 64K? */
-      pcb->acked = (u16_t)(ackno - pcb->lastack);
+      /* Update the send buffer space. Diff between the two can never
+         exceed the send buffer. */
+      pcb->acked = (tcpwnd_size_t)(ackno - pcb->lastack);
 
       pcb->snd_buf += pcb->acked;
 
@@ -817,16 +830,16 @@ tcp_receive(struct tcp_pcb *pcb)
          ssthresh). */
       if (pcb->state >= ESTABLISHED) {
         if (pcb->cwnd < pcb->ssthresh) {
-          if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+          if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
             pcb->cwnd += pcb->mss;
           }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"U16_F"\n", pcb->cwnd));
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
         } else {
-          u16_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
+          tcpwnd_size_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
           if (new_cwnd > pcb->cwnd) {
             pcb->cwnd = new_cwnd;
           }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"U16_F"\n", pcb->cwnd));
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
         }
       }
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_receive: ACK for %"U32_F", unacked->seqno %"U32_F":%"U32_F"\n",
@@ -1158,6 +1171,9 @@ tcp_receive(struct tcp_pcb *pcb)
 
       } else {
         /* We get here if the incoming segment is out-of-sequence. */
+#if LWIP_TCP_SACK_OUT
+        pcb->ooseq_last = seqno;
+#endif /* LWIP_TCP_SACK_OUT */
         tcp_ack_now(pcb);
 #if TCP_QUEUE_OOSEQ
         /* We queue the segment on the ->ooseq queue. */
@@ -1301,22 +1317,24 @@ tcp_receive(struct tcp_pcb *pcb)
  * from uIP with only small changes.)
  *
  * Called from tcp_listen_input() and tcp_process().
- * Currently, only the MSS option is supported!
+ * Only the MSS, window scale and SACK-permitted options are supported;
+ * the latter two are only taken from SYN segments.
  *
  * @param pcb the tcp_pcb for which a segment arrived
  */
 static void
 tcp_parseopt(struct tcp_pcb *pcb)
 {
-  u8_t c;
+  u8_t c, max_c;
   u8_t *opts, opt;
   u16_t mss;
 
   opts = (u8_t *)tcphdr + TCP_HLEN;
 
-  /* Parse the TCP MSS option, if present. */
+  /* Parse the TCP options, if present. */
   if(TCPH_HDRLEN(tcphdr) > 0x5) {
-    for(c = 0; c < (TCPH_HDRLEN(tcphdr) - 5) << 2 ;) {
+    max_c = (TCPH_HDRLEN(tcphdr) - 5) << 2;
+    for(c = 0; c < max_c ;) {
       opt = opts[c];
       if (opt == 0x00) {
         /* End of options. */
@@ -1324,21 +1342,38 @@ tcp_parseopt(struct tcp_pcb *pcb)
       } else if (opt == 0x01) {
         ++c;
         /* NOP option. */
+      } else if (c + 1 >= max_c || opts[c + 1] < 2 ||
+                 c + opts[c + 1] > max_c) {
+        /* If the length field is missing, too small or runs past the
+           header, the options are malformed and we don't process
+           them further. */
+        break;
       } else if (opt == 0x02 &&
         opts[c + 1] == 0x04) {
         /* An MSS option with the right option length. */
         mss = (opts[c + 2] << 8) | opts[c + 3];
         /* Limit the mss to the configured TCP_MSS and prevent division by zero */
         pcb->mss = ((mss > TCP_MSS) || (mss == 0)) ? TCP_MSS : mss;
-
-        /* And we are done processing options. */
-        break;
+        c += 0x04;
+#if LWIP_WND_SCALE
+      } else if (opt == 0x03 && opts[c + 1] == 0x03 && (flags & TCP_SYN)) {
+        /* A window scale option: both ends scale from now on. */
+        pcb->snd_scale = LWIP_MIN(opts[c + 2], 14);
+        pcb->rcv_scale = TCP_RCV_SCALE;
+        pcb->flags |= TF_WND_SCALE;
+        /* No data has been received yet, so the full window can be
+           offered. */
+        pcb->rcv_wnd = TCP_WND;
+        pcb->rcv_ann_wnd = TCP_WND;
+        c += 0x03;
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+      } else if (opt == 0x04 && opts[c + 1] == 0x02 && (flags & TCP_SYN)) {
+        /* SACK-permitted: we may send SACK blocks. */
+        pcb->flags |= TF_SACK;
+        c += 0x02;
+#endif /* LWIP_TCP_SACK_OUT */
       } else {
-        if (opts[c + 1] == 0) {
-          /* If the length field is zero, the options are malformed
-             and we don't process them further. */
-          break;
-        }
         /* All other options have a length field, so that we easily
            can skip past them. */
         c += opts[c + 1];
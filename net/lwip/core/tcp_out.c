@@ -146,7 +146,7 @@ tcp_enqueue(struct tcp_pcb *pcb, void *arg, u16_t len,
       ((arg == NULL) || (optdata == NULL)), return ERR_ARG;);
   /* fail on too much data */
   if (len > pcb->snd_buf) {
-    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_enqueue: too much data (len=%"U16_F" > snd_buf=%"U16_F")\n", len, pcb->snd_buf));
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_enqueue: too much data (len=%"U16_F" > snd_buf=%"TCPWNDSIZE_F")\n", len, pcb->snd_buf));
     pcb->flags |= TF_NAGLEMEMERR;
     return ERR_MEM;
   }
@@ -400,6 +400,90 @@ memerr:
   return ERR_MEM;
 }
 
+/**
+ * Build the options of a SYN or SYN|ACK segment for tcp_enqueue(): the
+ * MSS, and the window scale and SACK-permitted options if configured.
+ * A SYN offers them all; a SYN|ACK only those the remote host offered.
+ *
+ * @param pcb the tcp_pcb in state SYN_SENT or SYN_RCVD
+ * @param optdata room for TCP_SYN_OPTIONS_MAXLEN bytes of options
+ * @return the length of the options in bytes
+ */
+u8_t
+tcp_syn_options(struct tcp_pcb *pcb, u32_t *optdata)
+{
+  u8_t optlen = 0;
+
+  optdata[optlen++] = TCP_BUILD_MSS_OPTION();
+#if LWIP_WND_SCALE
+  if (pcb->state == SYN_SENT || (pcb->flags & TF_WND_SCALE)) {
+    /* NOP, kind 3, length 3, shift count */
+    optdata[optlen++] = htonl(0x01030300UL | TCP_RCV_SCALE);
+  }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+  if (pcb->state == SYN_SENT || (pcb->flags & TF_SACK)) {
+    /* NOP, NOP, kind 4, length 2 */
+    optdata[optlen++] = htonl(0x01010402UL);
+  }
+#endif /* LWIP_TCP_SACK_OUT */
+  LWIP_UNUSED_ARG(pcb);
+  return optlen * 4;
+}
+
+#if LWIP_TCP_SACK_OUT
+/**
+ * Build a SACK option describing the segments on pcb->ooseq, merged into
+ * contiguous blocks. As RFC 2018 asks, the first block is the one holding
+ * the segment queued last; the others follow in sequence order.
+ *
+ * @param pcb the tcp_pcb with out-of-sequence data queued
+ * @param optdata room for 4 + 8 * LWIP_TCP_MAX_SACK_NUM bytes of options
+ * @return the length of the option in bytes, 0 if there is nothing to report
+ */
+static u8_t
+tcp_sack_options(struct tcp_pcb *pcb, u32_t *optdata)
+{
+  u32_t blocks[2 * LWIP_TCP_MAX_SACK_NUM];
+  u32_t left, right;
+  struct tcp_seg *seg;
+  u8_t n = 1, first = 1, i;
+
+  /* blocks[0..1] are kept for the block holding pcb->ooseq_last */
+  for (seg = pcb->ooseq; seg != NULL; ) {
+    left = seg->tcphdr->seqno;
+    right = left + TCP_TCPLEN(seg);
+    for (seg = seg->next; seg != NULL && seg->tcphdr->seqno == right;
+         seg = seg->next) {
+      right += TCP_TCPLEN(seg);
+    }
+    if (left == right) {
+      continue;
+    }
+    if (first && TCP_SEQ_BETWEEN(pcb->ooseq_last, left, right - 1)) {
+      blocks[0] = left;
+      blocks[1] = right;
+      first = 0;
+    } else if (n < LWIP_TCP_MAX_SACK_NUM) {
+      blocks[2 * n] = left;
+      blocks[2 * n + 1] = right;
+      n++;
+    }
+  }
+  if (n == first) {
+    return 0;
+  }
+
+  /* NOP, NOP, kind 5, length */
+  optdata[0] = htonl(0x01010500UL | (2 + 8 * (n - first)));
+  for (i = first; i < n; i++) {
+    optdata[1 + 2 * (i - first)] = htonl(blocks[2 * i]);
+    optdata[2 + 2 * (i - first)] = htonl(blocks[2 * i + 1]);
+  }
+  return 4 + 8 * (n - first);
+}
+#endif /* LWIP_TCP_SACK_OUT */
+
 /**
  * Find out what we can send and send it
  *
@@ -414,6 +498,10 @@ tcp_output(struct tcp_pcb *pcb)
   struct tcp_hdr *tcphdr;
   struct tcp_seg *seg, *useg;
   u32_t wnd;
+  u8_t optlen = 0;
+#if LWIP_TCP_SACK_OUT
+  u32_t optdata[1 + 2 * LWIP_TCP_MAX_SACK_NUM];
+#endif /* LWIP_TCP_SACK_OUT */
 #if TCP_CWND_DEBUG
   s16_t i = 0;
 #endif /* TCP_CWND_DEBUG */
@@ -445,7 +533,12 @@ tcp_output(struct tcp_pcb *pcb)
   if (pcb->flags & TF_ACK_NOW &&
      (seg == NULL ||
       ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len > wnd)) {
-    p = pbuf_alloc(PBUF_IP, TCP_HLEN, PBUF_RAM);
+#if LWIP_TCP_SACK_OUT
+    if ((pcb->flags & TF_SACK) && pcb->ooseq != NULL) {
+      optlen = tcp_sack_options(pcb, optdata);
+    }
+#endif /* LWIP_TCP_SACK_OUT */
+    p = pbuf_alloc(PBUF_IP, TCP_HLEN + optlen, PBUF_RAM);
     if (p == NULL) {
       LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output: (ACK) could not allocate pbuf\n"));
       return ERR_BUF;
@@ -460,9 +553,14 @@ tcp_output(struct tcp_pcb *pcb)
     tcphdr->seqno = htonl(pcb->snd_nxt);
     tcphdr->ackno = htonl(pcb->rcv_nxt);
     TCPH_FLAGS_SET(tcphdr, TCP_ACK);
-    tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+    tcphdr->wnd = htons(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd));
     tcphdr->urgp = 0;
-    TCPH_HDRLEN_SET(tcphdr, 5);
+    TCPH_HDRLEN_SET(tcphdr, 5 + optlen / 4);
+#if LWIP_TCP_SACK_OUT
+    if (optlen > 0) {
+      SMEMCPY((u8_t *)tcphdr + TCP_HLEN, optdata, optlen);
+    }
+#endif /* LWIP_TCP_SACK_OUT */
 
     tcphdr->chksum = 0;
 #if CHECKSUM_GEN_TCP
@@ -497,13 +595,13 @@ tcp_output(struct tcp_pcb *pcb)
 #endif /* TCP_OUTPUT_DEBUG */
 #if TCP_CWND_DEBUG
   if (seg == NULL) {
-    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"U16_F
-                                 ", cwnd %"U16_F", wnd %"U32_F
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"TCPWNDSIZE_F
+                                 ", cwnd %"TCPWNDSIZE_F", wnd %"U32_F
                                  ", seg == NULL, ack %"U32_F"\n",
                                  pcb->snd_wnd, pcb->cwnd, wnd, pcb->lastack));
   } else {
     LWIP_DEBUGF(TCP_CWND_DEBUG, 
-                ("tcp_output: snd_wnd %"U16_F", cwnd %"U16_F", wnd %"U32_F
+                ("tcp_output: snd_wnd %"TCPWNDSIZE_F", cwnd %"TCPWNDSIZE_F", wnd %"U32_F
                  ", effwnd %"U32_F", seq %"U32_F", ack %"U32_F"\n",
                  pcb->snd_wnd, pcb->cwnd, wnd,
                  ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len,
@@ -527,7 +625,7 @@ tcp_output(struct tcp_pcb *pcb)
       break;
     }
 #if TCP_CWND_DEBUG
-    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"U16_F", cwnd %"U16_F", wnd %"U32_F", effwnd %"U32_F", seq %"U32_F", ack %"U32_F", i %"S16_F"\n",
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"TCPWNDSIZE_F", cwnd %"TCPWNDSIZE_F", wnd %"U32_F", effwnd %"U32_F", seq %"U32_F", ack %"U32_F", i %"S16_F"\n",
                             pcb->snd_wnd, pcb->cwnd, wnd,
                             ntohl(seg->tcphdr->seqno) + seg->len -
                             pcb->lastack,
@@ -606,8 +704,13 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
    wnd fields remain. */
   seg->tcphdr->ackno = htonl(pcb->rcv_nxt);
 
-  /* advertise our receive window size in this TCP segment */
-  seg->tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+  /* advertise our receive window size in this TCP segment; windows
+     in SYN segments are never scaled */
+  if (TCPH_FLAGS(seg->tcphdr) & TCP_SYN) {
+    seg->tcphdr->wnd = htons(TCPWND16(pcb->rcv_ann_wnd));
+  } else {
+    seg->tcphdr->wnd = htons(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd));
+  }
 
   /* If we don't have a local IP address, we get one by
      calling ip_route(). */
@@ -707,7 +810,7 @@ tcp_rst(u32_t seqno, u32_t ackno,
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
   TCPH_FLAGS_SET(tcphdr, TCP_RST | TCP_ACK);
-  tcphdr->wnd = htons(TCP_WND);
+  tcphdr->wnd = htons(TCPWND16(TCP_WND));
   tcphdr->urgp = 0;
   TCPH_HDRLEN_SET(tcphdr, 5);
 
@@ -756,6 +859,7 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
   /* Don't take any RTT measurements after retransmitting. */
   pcb->rttest = 0;
 
+  TCP_STATS_INC(tcp.rexmit);
   /* Do the actual retransmission */
   tcp_output(pcb);
 }
@@ -790,6 +894,7 @@ tcp_rexmit(struct tcp_pcb *pcb)
   pcb->rttest = 0;
 
   /* Do the actual retransmission. */
+  TCP_STATS_INC(tcp.rexmit);
   snmp_inc_tcpretranssegs();
   tcp_output(pcb);
 }
@@ -831,7 +936,7 @@ tcp_keepalive(struct tcp_pcb *pcb)
   tcphdr->seqno = htonl(pcb->snd_nxt - 1);
   tcphdr->ackno = htonl(pcb->rcv_nxt);
   TCPH_FLAGS_SET(tcphdr, 0);
-  tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+  tcphdr->wnd = htons(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd));
   tcphdr->urgp = 0;
   TCPH_HDRLEN_SET(tcphdr, 5);
 
@@ -914,7 +1019,7 @@ tcp_zero_window_probe(struct tcp_pcb *pcb)
   tcphdr->seqno = seg->tcphdr->seqno;
   tcphdr->ackno = htonl(pcb->rcv_nxt);
   TCPH_FLAGS_SET(tcphdr, 0);
-  tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+  tcphdr->wnd = htons(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd));
   tcphdr->urgp = 0;
   TCPH_HDRLEN_SET(tcphdr, 5);
 
@@ -87,6 +87,26 @@ void *memp_malloc(memp_t type);
 #endif
 void  memp_free(memp_t type, void *mem);
 
+#if MEMP_GROW
+/** Usage of one pool, see memp_pool_stats() */
+struct memp_pool_stats {
+  const char *name;
+  u16_t size;       /* element size */
+  u16_t limit;      /* most elements the pool may grow to */
+  u32_t used;       /* elements allocated */
+  u32_t max;        /* high-water mark of used */
+  u32_t slabs;      /* slabs the pool holds */
+  u32_t max_slabs;  /* high-water mark of slabs */
+  u32_t err;        /* failed allocations */
+};
+
+void  memp_pool_stats(memp_t type, struct memp_pool_stats *st);
+
+/* Provided by the port */
+void *memp_slab_alloc(void);
+void  memp_slab_free(void *slab);
+#endif /* MEMP_GROW */
+
 #ifdef __cplusplus
 }
 #endif
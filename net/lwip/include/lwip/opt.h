@@ -136,6 +136,21 @@
 #define MEMP_SANITY_CHECK               0
 #endif
 
+/**
+ * MEMP_GROW==1: memp pools start out empty and grow one slab of
+ * MEMP_GROW_SLAB bytes at a time, as needed, up to MEMP_NUM_xxx elements.
+ * Slabs are got from the port with memp_slab_alloc() and given back with
+ * memp_slab_free() once all their elements are free again. Slabs must be
+ * aligned to their size. Not compatible with MEMP_OVERFLOW_CHECK.
+ */
+#ifndef MEMP_GROW
+#define MEMP_GROW                       0
+#endif
+
+#ifndef MEMP_GROW_SLAB
+#define MEMP_GROW_SLAB                  4096
+#endif
+
 /**
  * MEM_USE_POOLS==1: Use an alternative to malloc() by allocating from a set
  * of memory pools of various sizes. When mem_malloc is called, an element of
@@ -328,6 +343,14 @@
 #define ARP_TABLE_SIZE                  10
 #endif
 
+/**
+ * ARP_HASH_SIZE: Number of hash chains the ARP table is looked up
+ * through. Must be a power of 2.
+ */
+#ifndef ARP_HASH_SIZE
+#define ARP_HASH_SIZE                   16
+#endif
+
 /**
  * ARP_QUEUEING==1: Outgoing packets are queued during hardware address
  * resolution.
@@ -734,6 +757,38 @@
 #define TCP_SNDLOWAT                    (TCP_SND_BUF/2)
 #endif
 
+/**
+ * LWIP_WND_SCALE==1: Enable RFC 7323 window scaling, so that TCP_WND and
+ * TCP_SND_BUF may exceed 64k. TCP_RCV_SCALE is the shift count (0..14) we
+ * announce for our receive window; TCP_WND must fit in 16 bits after it.
+ * Windows then take 32 bits in struct tcp_pcb.
+ */
+#ifndef LWIP_WND_SCALE
+#define LWIP_WND_SCALE                  0
+#endif
+
+#ifndef TCP_RCV_SCALE
+#define TCP_RCV_SCALE                   0
+#endif
+
+/**
+ * LWIP_TCP_SACK_OUT==1: Offer SACK-permitted (RFC 2018) in SYN segments
+ * and, if the remote host offers it too, report the segments queued out
+ * of sequence in SACK blocks of the ACKs we send. SACK blocks received
+ * are ignored: retransmission still goes by cumulative ACKs only.
+ */
+#ifndef LWIP_TCP_SACK_OUT
+#define LWIP_TCP_SACK_OUT               0
+#endif
+
+/**
+ * LWIP_TCP_MAX_SACK_NUM: The maximum number of SACK blocks in one ACK
+ * (at most 4 fit in the TCP options).
+ */
+#ifndef LWIP_TCP_MAX_SACK_NUM
+#define LWIP_TCP_MAX_SACK_NUM           4
+#endif
+
 /**
  * TCP_LISTEN_BACKLOG: Enable the backlog option for tcp listen pcb.
  */
@@ -789,6 +844,15 @@
 #define PBUF_POOL_BUFSIZE               LWIP_MEM_ALIGN_SIZE(TCP_MSS+40+PBUF_LINK_HLEN)
 #endif
 
+/**
+ * LWIP_SUPPORT_CUSTOM_PBUF==1: Support pbufs whose payload memory belongs
+ * to the netif driver, which gets it back through a callback when the
+ * pbuf is freed (see struct pbuf_custom).
+ */
+#ifndef LWIP_SUPPORT_CUSTOM_PBUF
+#define LWIP_SUPPORT_CUSTOM_PBUF        0
+#endif
+
 /*
    ------------------------------------------------
    ---------- Network Interfaces options ----------
@@ -224,7 +224,7 @@ typedef struct ip_mreq {
 
 /*
  * Commands for ioctlsocket(),  taken from the BSD file fcntl.h.
- * lwip_ioctl only supports FIONREAD and FIONBIO, for now
+ * lwip_ioctl only supports FIONREAD, FIONBIO and FIONSPACE, for now
  *
  * Ioctl's have the command encoded in the lower word,
  * and the size of any in or out parameters in the upper
@@ -253,6 +253,9 @@ typedef struct ip_mreq {
 #ifndef FIONBIO
 #define FIONBIO     _IOW('f', 126, unsigned long) /* set/clear non-blocking i/o */
 #endif
+#ifndef FIONSPACE
+#define FIONSPACE   _IOR('f', 118, int)           /* get space in send queue */
+#endif
 
 /* Socket I/O Controls: unimplemented */
 #ifndef SIOCSHIWAT
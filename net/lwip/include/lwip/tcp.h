@@ -77,7 +77,7 @@ void             tcp_err     (struct tcp_pcb *pcb,
                               void (* err)(void *arg, err_t err));
 
 #define          tcp_mss(pcb)      ((pcb)->mss)
-#define          tcp_sndbuf(pcb)   ((pcb)->snd_buf)
+#define          tcp_sndbuf(pcb)   (TCPWND16((pcb)->snd_buf))
 
 #if TCP_LISTEN_BACKLOG
 #define          tcp_accepted(pcb) (((struct tcp_pcb_listen *)(pcb))->accepts_pending--)
@@ -252,6 +252,16 @@ enum tcp_state {
   TIME_WAIT   = 10
 };
 
+/* Window sizes and counts of bytes in flight: with window scaling
+   they no longer fit in 16 bits. */
+#if LWIP_WND_SCALE
+typedef u32_t tcpwnd_size_t;
+#define TCPWNDSIZE_F U32_F
+#else /* LWIP_WND_SCALE */
+typedef u16_t tcpwnd_size_t;
+#define TCPWNDSIZE_F U16_F
+#endif /* LWIP_WND_SCALE */
+
 /** Flags used on input processing, not on pcb->flags
 */
 #define TF_RESET     (u8_t)0x08U   /* Connection was reset. */
@@ -283,6 +293,8 @@ struct tcp_pcb {
 #define TF_ACK_DELAY   (u8_t)0x01U   /* Delayed ACK. */
 #define TF_ACK_NOW     (u8_t)0x02U   /* Immediate ACK. */
 #define TF_INFR        (u8_t)0x04U   /* In fast recovery. */
+#define TF_WND_SCALE   (u8_t)0x08U   /* Window scaling negotiated. */
+#define TF_SACK        (u8_t)0x10U   /* Remote host accepts SACK blocks. */
 #define TF_FIN         (u8_t)0x20U   /* Connection was closed locally (FIN segment enqueued). */
 #define TF_NODELAY     (u8_t)0x40U   /* Disable Nagle algorithm */
 #define TF_NAGLEMEMERR (u8_t)0x80U /* nagle enabled, memerr, try to output to prevent delayed ACK to happen */
@@ -291,8 +303,11 @@ struct tcp_pcb {
      as we have to do some math with them */
   /* receiver variables */
   u32_t rcv_nxt;   /* next seqno expected */
-  u16_t rcv_wnd;   /* receiver window */
-  u16_t rcv_ann_wnd; /* announced receive window */
+  tcpwnd_size_t rcv_wnd;   /* receiver window */
+  tcpwnd_size_t rcv_ann_wnd; /* announced receive window */
+#if LWIP_TCP_SACK_OUT
+  u32_t ooseq_last; /* seqno of the last segment queued on ooseq */
+#endif /* LWIP_TCP_SACK_OUT */
 
   /* Timers */
   u32_t tmr;
@@ -316,20 +331,20 @@ struct tcp_pcb {
   u8_t dupacks;
   
   /* congestion avoidance/control variables */
-  u16_t cwnd;  
-  u16_t ssthresh;
+  tcpwnd_size_t cwnd;
+  tcpwnd_size_t ssthresh;
 
   /* sender variables */
   u32_t snd_nxt,   /* next seqno to be sent */
     snd_max;       /* Highest seqno sent. */
-  u16_t snd_wnd;   /* sender window */
+  tcpwnd_size_t snd_wnd;   /* sender window */
   u32_t snd_wl1, snd_wl2, /* Sequence and acknowledgement numbers of last
                              window update. */
     snd_lbb;       /* Sequence number of next byte to be buffered. */
 
-  u16_t acked;
+  tcpwnd_size_t acked;
   
-  u16_t snd_buf;   /* Available buffer space for sending (in bytes). */
+  tcpwnd_size_t snd_buf;   /* Available buffer space for sending (in bytes). */
 #define TCP_SNDQUEUELEN_OVERFLOW (0xffff-3)
   u16_t snd_queuelen; /* Available buffer space for sending (in tcp_segs). */
   
@@ -412,8 +427,30 @@ struct tcp_pcb {
 
   /* KEEPALIVE counter */
   u8_t keep_cnt_sent;
+
+#if LWIP_WND_SCALE
+  u8_t snd_scale;  /* shift count of the windows the remote host announces */
+  u8_t rcv_scale;  /* shift count of the windows we announce */
+#endif /* LWIP_WND_SCALE */
 };
 
+/* Window scaling: windows in segment headers are shifted right by the
+   scale of their sender, except in SYN segments, which carry them
+   unscaled. Until scaling is negotiated our receive window must fit
+   in the 16-bit header field. */
+#if LWIP_WND_SCALE
+#define RCV_WND_SCALE(pcb, wnd) ((wnd) >> (pcb)->rcv_scale)
+#define SND_WND_SCALE(pcb, wnd) ((tcpwnd_size_t)(wnd) << (pcb)->snd_scale)
+#define TCPWND16(x)             ((u16_t)LWIP_MIN((x), 0xffff))
+#define TCP_WND_MAX(pcb)        ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE) ? \
+                                 TCP_WND : TCPWND16(TCP_WND)))
+#else /* LWIP_WND_SCALE */
+#define RCV_WND_SCALE(pcb, wnd) (wnd)
+#define SND_WND_SCALE(pcb, wnd) (wnd)
+#define TCPWND16(x)             (x)
+#define TCP_WND_MAX(pcb)        TCP_WND
+#endif /* LWIP_WND_SCALE */
+
 struct tcp_pcb_listen {  
 /* Common members of all PCB types */
   IP_PCB;
@@ -522,6 +559,10 @@ err_t tcp_enqueue(struct tcp_pcb *pcb, void *dataptr, u16_t len,
     u8_t flags, u8_t apiflags,
                 u8_t *optdata, u8_t optlen);
 
+/* Room for the MSS, window scale and SACK-permitted options of a SYN */
+#define TCP_SYN_OPTIONS_MAXLEN 12
+u8_t tcp_syn_options(struct tcp_pcb *pcb, u32_t *optdata);
+
 void tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg);
 
 void tcp_rst(u32_t seqno, u32_t ackno,
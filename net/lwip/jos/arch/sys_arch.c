@@ -1,6 +1,7 @@
 #include <inc/lib.h>
 
 #include <lwip/sys.h>
+#include <lwip/memp.h>
 #include <arch/thread.h>
 #include <arch/cc.h>
 #include <arch/sys_arch.h>
@@ -9,9 +10,11 @@
 
 #define debug 0
 
-#define NSEM		256
-#define NMBOX		128
-#define MBOXSLOTS	32
+#define NSEM		1536
+#define NMBOX		512
+// A TCP netconn's recvmbox must hold a full receive window of segments,
+// or the tcpip thread blocks posting to it
+#define MBOXSLOTS	(2 * TCP_WND / TCP_MSS)
 
 struct sys_sem_entry {
     int freed;
@@ -311,6 +314,13 @@ out:
     return &t->tmo;
 }
 
+// Milliseconds since boot, for ARP entry timestamps
+unsigned long
+sys_now(void)
+{
+    return sys_time_msec();
+}
+
 void
 lwip_core_lock(void)
 {
@@ -320,3 +330,47 @@ void
 lwip_core_unlock(void)
 {
 }
+
+// lwIP's memp pools grow and shrink a page at a time in this part of
+// the network server's address space.
+#define MEMP_ARENA		0x20000000
+#define MEMP_ARENA_PAGES	8192	// 32 MB
+
+static uint32_t arena_used[MEMP_ARENA_PAGES / 32];
+static int arena_hint;		// no free page below this index
+
+void *
+memp_slab_alloc(void)
+{
+    void *va;
+    int i;
+
+    for (i = arena_hint; i < MEMP_ARENA_PAGES; i++) {
+	if (i % 32 == 0 && arena_used[i / 32] == ~0U) {
+	    i += 31;
+	    continue;
+	}
+	if (!(arena_used[i / 32] & (1 << (i % 32))))
+	    break;
+    }
+    if (i >= MEMP_ARENA_PAGES)
+	return 0;
+    va = (void *) (MEMP_ARENA + i * PGSIZE);
+    if (sys_page_alloc(0, va, PTE_P|PTE_U|PTE_W) < 0)
+	return 0;
+    arena_used[i / 32] |= 1 << (i % 32);
+    arena_hint = i + 1;
+    return va;
+}
+
+void
+memp_slab_free(void *slab)
+{
+    int i = ((uintptr_t) slab - MEMP_ARENA) / PGSIZE;
+
+    assert(0 <= i && i < MEMP_ARENA_PAGES && PGOFF(slab) == 0);
+    arena_used[i / 32] &= ~(1 << (i % 32));
+    if (i < arena_hint)
+	arena_hint = i;
+    sys_page_unmap(0, slab);
+}
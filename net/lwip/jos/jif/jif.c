@@ -38,19 +38,177 @@
 #include "lwip/opt.h"
 #include "lwip/def.h"
 #include "lwip/mem.h"
+#include "lwip/memp.h"
 #include "lwip/pbuf.h"
 #include "lwip/sys.h"
 #include <lwip/stats.h>
 
+#include <lwip/ip.h>
+#include <lwip/tcp.h>
+
 #include <netif/etharp.h>
 
-#define PKTMAP		0x10000000
+// Longest Ethernet + IP + TCP header we will hand to the NIC for TSO
+#define TSO_MAXHDR	(sizeof(struct eth_hdr) + 60 + 60)
 
 struct jif {
     struct eth_addr *ethaddr;
     envid_t envid;
+    int nqueues;		// NIC queues, each with its own rings
 };
 
+// Pick the transmit ring for the frame whose first bytes are in hdr,
+// hashing IPv4 flows so that each one keeps to a single queue and
+// stays in order.
+static struct jif_ring *
+jif_txring(struct jif *jif, const char *hdr, int len)
+{
+    const struct eth_hdr *ethhdr = (const struct eth_hdr *)hdr;
+    const struct ip_hdr *iph = (const struct ip_hdr *)&hdr[sizeof(struct eth_hdr)];
+    u32_t hash;
+    int l4;
+
+    if (jif->nqueues == 1 || len < sizeof(struct eth_hdr) + IP_HLEN
+	|| ethhdr->type != htons(ETHTYPE_IP))
+	return JIF_TXRING(0);
+    hash = iph->src.addr ^ iph->dest.addr;
+    l4 = sizeof(struct eth_hdr) + IPH_HL(iph) * 4;
+    if ((IPH_PROTO(iph) == IP_PROTO_TCP || IPH_PROTO(iph) == IP_PROTO_UDP)
+	&& !(ntohs(IPH_OFFSET(iph)) & (IP_MF | IP_OFFMASK)) && l4 + 4 <= len)
+	hash ^= *(const u32_t *)&hdr[l4];
+    hash ^= hash >> 16;
+    hash ^= hash >> 8;
+    return JIF_TXRING(hash % jif->nqueues);
+}
+
+// TCP segmentation offload.  lwIP emits one MSS-sized frame per call
+// to low_level_output; back-to-back frames of the same flow are
+// coalesced here into a super-segment built in place in the transmit
+// ring, and the NIC cuts it back into MSS frames.  jif_flush() must be
+// called before the network server blocks so nothing is held back.
+#define TSO_RECLEN	(sizeof(struct jif_txpkt) + TSO_MAXHDR + JIF_TSO_MAXPAYLOAD)
+
+static struct jif_txpkt *tso_pend;	// super-segment being built
+static struct jif_ring *tso_ring;	// transmit ring tso_pend is in
+static int tso_nseg;			// frames merged into tso_pend
+static u32_t tso_nextseq;		// seqno the next frame must carry
+
+// Hand the pending super-segment to the output environment.
+static void
+tso_flush(struct jif *jif)
+{
+    struct jif_txpkt *pkt = tso_pend;
+
+    if (!pkt)
+	return;
+
+    if (tso_nseg > 1) {
+	struct ip_hdr *iph = (struct ip_hdr *)&pkt->jp_data[sizeof(struct eth_hdr)];
+	struct tcp_hdr *tcph = (struct tcp_hdr *)((char *)iph + IPH_HL(iph) * 4);
+	u32_t sum;
+
+	// The NIC fills in IP length and checksum per frame, and wants
+	// the TCP checksum seeded with the pseudo-header sum minus length.
+	IPH_LEN_SET(iph, 0);
+	IPH_CHKSUM_SET(iph, 0);
+	sum = (ntohl(iph->src.addr) >> 16) + (ntohl(iph->src.addr) & 0xffff) +
+	      (ntohl(iph->dest.addr) >> 16) + (ntohl(iph->dest.addr) & 0xffff) +
+	      IP_PROTO_TCP;
+	while (sum >> 16)
+	    sum = (sum & 0xffff) + (sum >> 16);
+	tcph->chksum = htons(sum);
+    } else
+	pkt->jp_mss = 0;
+
+    jif_ring_commit(tso_ring, sizeof(*pkt) + pkt->jp_len);
+    tso_pend = 0;
+}
+
+// Try to put the frame p into the pending super-segment, starting a
+// new one if it does not continue the current flow.  Returns 0 if p is
+// not a plain TCP data frame and must be sent on its own.
+static int
+tso_append(struct jif *jif, struct pbuf *p)
+{
+    char hdr[TSO_MAXHDR];
+    struct eth_hdr *ethhdr = (struct eth_hdr *)hdr;
+    struct ip_hdr *iph = (struct ip_hdr *)&hdr[sizeof(struct eth_hdr)];
+    struct tcp_hdr *tcph;
+    int hdrlen, paylen;
+
+    if (p->tot_len < sizeof(struct eth_hdr) + IP_HLEN + TCP_HLEN)
+	return 0;
+    pbuf_copy_partial(p, hdr, MIN(p->tot_len, TSO_MAXHDR), 0);
+    if (ethhdr->type != htons(ETHTYPE_IP) || IPH_V(iph) != 4
+	|| IPH_PROTO(iph) != IP_PROTO_TCP
+	|| (ntohs(IPH_OFFSET(iph)) & (IP_MF | IP_OFFMASK)))
+	return 0;
+    tcph = (struct tcp_hdr *)((char *)iph + IPH_HL(iph) * 4);
+    hdrlen = (char *)tcph - hdr + TCPH_HDRLEN(tcph) * 4;
+    if (hdrlen > MIN(p->tot_len, TSO_MAXHDR)
+	|| (TCPH_FLAGS(tcph) & ~TCP_PSH) != TCP_ACK)
+	return 0;
+    paylen = p->tot_len - hdrlen;
+    if (paylen <= 0)
+	return 0;
+
+    if (tso_pend) {
+	// Everything but the seqno, IP id and checksums must match,
+	// and only the last frame of a super-segment may be short.
+	char *phdr = tso_pend->jp_data;
+	struct ip_hdr *piph = (struct ip_hdr *)&phdr[sizeof(struct eth_hdr)];
+	struct tcp_hdr *ptcph = (struct tcp_hdr *)((char *)piph + IPH_HL(piph) * 4);
+	int plen = tso_pend->jp_len - tso_pend->jp_hdrlen;
+
+	if (hdrlen != tso_pend->jp_hdrlen
+	    || memcmp(hdr, phdr, sizeof(struct eth_hdr)) != 0
+	    || iph->_v_hl_tos != piph->_v_hl_tos
+	    || iph->_ttl_proto != piph->_ttl_proto
+	    || iph->src.addr != piph->src.addr
+	    || iph->dest.addr != piph->dest.addr
+	    || tcph->src != ptcph->src || tcph->dest != ptcph->dest
+	    || tcph->ackno != ptcph->ackno || tcph->wnd != ptcph->wnd
+	    || memcmp(tcph + 1, ptcph + 1, hdrlen - ((char *)(tcph + 1) - hdr)) != 0
+	    || ntohl(tcph->seqno) != tso_nextseq
+	    || plen % tso_pend->jp_mss != 0
+	    || paylen > tso_pend->jp_mss
+	    || plen + paylen > JIF_TSO_MAXPAYLOAD)
+	    tso_flush(jif);
+    }
+
+    if (!tso_pend) {
+	tso_ring = jif_txring(jif, hdr, hdrlen);
+	tso_pend = jif_ring_reserve(tso_ring, TSO_RECLEN);
+	pbuf_copy_partial(p, tso_pend->jp_data, p->tot_len, 0);
+	tso_pend->jp_len = p->tot_len;
+	tso_pend->jp_hdrlen = hdrlen;
+	tso_pend->jp_mss = paylen;
+	tso_nseg = 1;
+    } else {
+	struct ip_hdr *piph = (struct ip_hdr *)&tso_pend->jp_data[sizeof(struct eth_hdr)];
+	struct tcp_hdr *ptcph = (struct tcp_hdr *)((char *)piph + IPH_HL(piph) * 4);
+
+	pbuf_copy_partial(p, &tso_pend->jp_data[tso_pend->jp_len], paylen, hdrlen);
+	tso_pend->jp_len += paylen;
+	// the NIC only sets PSH on the last frame it cuts
+	if (TCPH_FLAGS(tcph) & TCP_PSH)
+	    TCPH_SET_FLAG(ptcph, TCP_PSH);
+	tso_nseg++;
+    }
+    tso_nextseq = ntohl(tcph->seqno) + paylen;
+
+    // a short frame ends the super-segment
+    if (paylen < tso_pend->jp_mss)
+	tso_flush(jif);
+    return 1;
+}
+
+void
+jif_flush(struct netif *netif)
+{
+    tso_flush(netif->state);
+}
+
 static void
 low_level_init(struct netif *netif)
 {
@@ -80,32 +238,32 @@ low_level_init(struct netif *netif)
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
 {
-    int r = sys_page_alloc(0, (void *)PKTMAP, PTE_U|PTE_W|PTE_P);
-    if (r < 0)
-	panic("jif: could not allocate page of memory");
-    struct jif_pkt *pkt = (struct jif_pkt *)PKTMAP;
-
     struct jif *jif;
+    struct jif_ring *ring;
     jif = netif->state;
 
-    char *txbuf = pkt->jp_data;
-    int txsize = 0;
-    struct pbuf *q;
-    for (q = p; q != NULL; q = q->next) {
-	/* Send the data from the pbuf to the interface, one pbuf at a
-	   time. The size of the data in each pbuf is kept in the ->len
-	   variable. */
-
-	if (txsize + q->len > 2000)
-	    panic("oversized packet, fragment %d txsize %d\n", q->len, txsize);
-	memcpy(&txbuf[txsize], q->payload, q->len);
-	txsize += q->len;
-    }
-
-    pkt->jp_len = txsize;
-
-    ipc_send(jif->envid, NSREQ_OUTPUT, (void *)pkt, PTE_P|PTE_W|PTE_U);
-    sys_page_unmap(0, (void *)pkt);
+    LINK_STATS_INC(link.xmit);
+    if (tso_append(jif, p))
+	return ERR_OK;
+    // keep frames in order behind any pending super-segment
+    tso_flush(jif);
+
+    if (p->tot_len > 2000)
+	panic("oversized packet, txsize %d\n", p->tot_len);
+    if (jif->nqueues > 1) {
+	char hdr[sizeof(struct eth_hdr) + 60 + 4];
+	int n = pbuf_copy_partial(p, hdr, MIN(p->tot_len, sizeof(hdr)), 0);
+	ring = jif_txring(jif, hdr, n);
+    } else
+	ring = JIF_TXRING(0);
+    struct jif_txpkt *pkt = jif_ring_reserve(ring, sizeof(*pkt) + p->tot_len);
+
+    /* Copy the pbuf chain straight into the shared transmit ring. */
+    pbuf_copy_partial(p, pkt->jp_data, p->tot_len, 0);
+    pkt->jp_len = p->tot_len;
+    pkt->jp_hdrlen = 0;
+    pkt->jp_mss = 0;
+    jif_ring_commit(ring, sizeof(*pkt) + pkt->jp_len);
 
     return ERR_OK;
 }
@@ -145,6 +303,68 @@ low_level_input(void *va)
 
     return p;
 }
+
+// Frames from the receive rings are handed to lwIP in place, wrapped
+// in PBUF_REF custom pbufs that give their slot back to the ring when
+// freed.  lwIP keeps some frames for a long time (data waiting on a
+// socket nobody reads, out-of-order segments, fragments) and caches
+// pointers into them, so a held frame never moves.  Its slot is kept
+// (jif_ring_keep) rather than just taken, so the ring carries on around
+// it; once half of a ring's slots are kept, new frames are copied into
+// pool pbufs instead and their slots go straight back.
+#define JIF_NRXBUF	(JIF_MAXQUEUES * JIF_RING_MAXSLOTS)
+
+struct jif_rxbuf {
+    struct pbuf_custom pc;
+    int q;			// receive queue of the frame
+    struct jif_pkt *pkt;	// frame in its ring slot
+    struct jif_rxbuf *next;	// free list
+};
+
+static struct jif_rxbuf rxbufs[JIF_NRXBUF];
+static struct jif_rxbuf *rxbuf_free_list;
+
+// Give the slot of a held frame back to its ring.
+static void
+rxbuf_free(struct pbuf *p)
+{
+    struct jif_rxbuf *rb = (struct jif_rxbuf *)p;
+
+    jif_ring_put(JIF_RXRING(rb->q), rb->pkt);
+    rb->pkt = 0;
+    rb->next = rxbuf_free_list;
+    rxbuf_free_list = rb;
+}
+
+// Take the next frame off receive queue q and wrap it in a pbuf,
+// which is 0 if the frame had to be dropped.  Returns 0 if the ring
+// is empty.
+static int
+low_level_input_ring(int q, struct pbuf **pp)
+{
+    struct jif_ring *ring = JIF_RXRING(q);
+    struct jif_rxbuf *rb;
+    struct jif_pkt *pkt;
+
+    if ((pkt = jif_ring_take(ring)) == NULL)
+	return 0;
+
+    rb = rxbuf_free_list;
+    if (!rb || ring->jr_nkept >= ring->jr_nslots / 2) {
+	*pp = low_level_input(pkt);
+	jif_ring_put(ring, pkt);
+	return 1;
+    }
+    rxbuf_free_list = rb->next;
+    rb->pc.custom_free_function = rxbuf_free;
+    rb->q = q;
+    rb->pkt = pkt;
+    jif_ring_keep(ring, pkt);
+    *pp = pbuf_alloced_custom(PBUF_RAW, pkt->jp_len, PBUF_REF, &rb->pc,
+			      pkt->jp_data, pkt->jp_len);
+    return 1;
+}
+
 /*
  * jif_output():
  *
@@ -172,20 +392,21 @@ jif_output(struct netif *netif, struct pbuf *p,
  *
  */
 
-void
-jif_input(struct netif *netif, void *va)
+static void
+jif_input_pbuf(struct netif *netif, struct pbuf *p)
 {
     struct jif *jif;
     struct eth_hdr *ethhdr;
-    struct pbuf *p;
 
     jif = netif->state;
-  
-    /* move received packet into a new pbuf */
-    p = low_level_input(va);
 
     /* no packet could be read, silently ignore this */
-    if (p == NULL) return;
+    if (p == NULL) {
+	LINK_STATS_INC(link.memerr);
+	LINK_STATS_INC(link.drop);
+	return;
+    }
+    LINK_STATS_INC(link.recv);
     /* points to packet payload, which starts with an Ethernet header */
     ethhdr = p->payload;
 
@@ -205,10 +426,42 @@ jif_input(struct netif *netif, void *va)
 	break;
 
     default:
+	LINK_STATS_INC(link.proterr);
 	pbuf_free(p);
     }
 }
 
+void
+jif_input(struct netif *netif, void *va)
+{
+    /* move received packet into a new pbuf */
+    jif_input_pbuf(netif, low_level_input(va));
+}
+
+/*
+ * jif_input_ring():
+ *
+ * Feed every frame waiting in the receive rings to jif_input. Returns
+ * the number of frames processed.
+ *
+ */
+
+int
+jif_input_ring(struct netif *netif)
+{
+    struct jif *jif = netif->state;
+    struct pbuf *p;
+    int q, i, n = 0;
+
+    // at most a ring's worth from each queue, so none is starved
+    for (q = 0; q < jif->nqueues; q++)
+	for (i = 0; i < JIF_RING_MAXSLOTS && low_level_input_ring(q, &p); i++) {
+	    jif_input_pbuf(netif, p);
+	    n++;
+	}
+    return n;
+}
+
 /*
  * jif_init():
  *
@@ -223,6 +476,7 @@ jif_init(struct netif *netif)
 {
     struct jif *jif;
     envid_t *output_envid; 
+    int i;
 
     jif = mem_malloc(sizeof(struct jif));
 
@@ -240,9 +494,15 @@ jif_init(struct netif *netif)
 
     jif->ethaddr = (struct eth_addr *)&(netif->hwaddr[0]);
     jif->envid = *output_envid; 
+    jif->nqueues = MIN(MAX(sys_net_queues(), 1), JIF_MAXQUEUES);
 
     low_level_init(netif);
 
+    for (i = 0; i < JIF_NRXBUF; i++) {
+	rxbufs[i].next = rxbuf_free_list;
+	rxbuf_free_list = &rxbufs[i];
+    }
+
     etharp_init();
 
     // qemu user-net is dumb; if the host OS does not send and ARP request
@@ -1,4 +1,20 @@
+#include <inc/ns.h>
 #include <lwip/netif.h>
 
 void	jif_input(struct netif *netif, void *va);
 err_t	jif_init(struct netif *netif);
+void	jif_flush(struct netif *netif);
+int	jif_input_ring(struct netif *netif);
+
+int	jif_ring_init(struct jif_ring *r, int nslots, uint32_t wakereq);
+int	jif_ring_attach(struct jif_ring *r);
+int	jif_ring_producer(struct jif_ring *r);
+void	*jif_ring_reserve(struct jif_ring *r, size_t len);
+void	jif_ring_commit(struct jif_ring *r, size_t len);
+void	*jif_ring_take(struct jif_ring *r);
+void	jif_ring_keep(struct jif_ring *r, void *rec);
+void	jif_ring_put(struct jif_ring *r, void *rec);
+void	*jif_ring_peek(struct jif_ring *r);
+void	jif_ring_release(struct jif_ring *r);
+int	jif_ring_sleep(struct jif_ring *r);
+void	jif_ring_wait(struct jif_ring *r);
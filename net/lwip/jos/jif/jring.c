@@ -0,0 +1,223 @@
+#include <inc/lib.h>
+#include <inc/x86.h>
+#include <inc/ns.h>
+
+#include <jif/jif.h>
+
+/*
+ * Single-producer/single-consumer packet rings shared between the
+ * network server and its input/output environments.  See struct
+ * jif_ring in inc/ns.h for the layout.
+ */
+
+static int
+ring_mapped(struct jif_ring *r)
+{
+    return (uvpd[PDX(r)] & PTE_P) && (uvpt[PGNUM(r)] & PTE_P);
+}
+
+// Allocate a ring of nslots slots at r.  Must be called before forking
+// the environment at the other end so it inherits the PTE_SHARE pages.
+int
+jif_ring_init(struct jif_ring *r, int nslots, uint32_t wakereq)
+{
+    int i, r2;
+
+    assert(nslots <= JIF_RING_MAXSLOTS);
+    for (i = 0; i <= nslots; i++)
+	if ((r2 = sys_page_alloc(0, (char *)r + i * PGSIZE,
+				 PTE_U|PTE_W|PTE_P|PTE_SHARE)) < 0)
+	    return r2;
+    r->jr_nslots = nslots;
+    r->jr_wakereq = wakereq;
+    return 0;
+}
+
+// Attach to r as its consumer.  Returns 0 if nobody set the ring up,
+// as in the lab's testinput/testoutput drivers.
+int
+jif_ring_attach(struct jif_ring *r)
+{
+    if (!ring_mapped(r))
+	return 0;
+    r->jr_consumer = thisenv->env_id;
+    return 1;
+}
+
+// Check that r was set up by our parent before producing into it.
+int
+jif_ring_producer(struct jif_ring *r)
+{
+    return ring_mapped(r);
+}
+
+// How many slots from slot on to skip before n free ones: up to the end
+// of the ring if the record would wrap, or past the last kept slot among
+// the next n.  0 if a record of n slots can go at slot.
+static uint32_t
+ring_pad(struct jif_ring *r, uint32_t slot, uint32_t n)
+{
+    uint32_t i;
+
+    if (slot + n > r->jr_nslots)
+	return r->jr_nslots - slot;
+    for (i = n; i > 0; i--)
+	if (r->jr_held[slot + i - 1])
+	    return i;
+    return 0;
+}
+
+// Producer: return room for a record of len bytes, blocking until the
+// consumer frees enough slots.  Publish it with jif_ring_commit.
+void *
+jif_ring_reserve(struct jif_ring *r, size_t len)
+{
+    uint32_t n = ROUNDUP(len, PGSIZE) / PGSIZE;
+    uint32_t slot, pad, tail;
+
+    assert(n > 0 && 2 * n <= r->jr_nslots);
+    while (1) {
+	slot = r->jr_head % r->jr_nslots;
+	pad = ring_pad(r, slot, n);
+	if (r->jr_head + (pad ? pad : n) - r->jr_tail <= r->jr_nslots) {
+	    if (!pad)
+		break;
+	    // records never wrap, nor land on kept slots: skip ahead
+	    // and look again
+	    r->jr_span[slot] = JIF_RING_SKIP | pad;
+	    r->jr_head += pad;
+	    continue;
+	}
+	// the consumer may have gone to sleep with the ring full
+	if (xchg(&r->jr_sleeping, 0))
+	    ipc_send(r->jr_consumer, r->jr_wakereq, 0, 0);
+	// xchg orders the flag before we look at jr_tail again,
+	// pairing with ring_retire
+	tail = r->jr_tail;
+	xchg(&r->jr_full, 1);
+	if (r->jr_tail == tail)
+	    sys_futex_wait(&r->jr_tail, tail, 0);
+    }
+    return JIF_RING_SLOT(r, slot);
+}
+
+// Producer: publish the len-byte record returned by jif_ring_reserve,
+// which may be shorter than reserved, and wake a sleeping consumer.
+void
+jif_ring_commit(struct jif_ring *r, size_t len)
+{
+    r->jr_span[r->jr_head % r->jr_nslots] = ROUNDUP(len, PGSIZE) / PGSIZE;
+    r->jr_head += r->jr_span[r->jr_head % r->jr_nslots];
+    // xchg orders the head update before the check, and makes sure
+    // only one wakeup is sent per sleep
+    if (xchg(&r->jr_sleeping, 0))
+	ipc_send(r->jr_consumer, r->jr_wakereq, 0, 0);
+}
+
+// Consumer: move jr_tail past the records given back or kept and the
+// skips, up to the oldest record still taken, and wake a producer
+// waiting for room.
+static void
+ring_retire(struct jif_ring *r)
+{
+    uint32_t tail = r->jr_tail, slot;
+
+    while (tail != r->jr_next) {
+	slot = tail % r->jr_nslots;
+	if (r->jr_held[slot] == JIF_RING_TAKEN)
+	    break;
+	tail += r->jr_span[slot] & ~JIF_RING_SKIP;
+    }
+    if (tail == r->jr_tail)
+	return;
+    r->jr_tail = tail;
+    // pairs with the xchg in jif_ring_reserve
+    if (xchg(&r->jr_full, 0))
+	sys_futex_wake(&r->jr_tail, 1);
+}
+
+// Consumer: take the next record, or return 0 if there is none.  The
+// record stays in the ring until given back with jif_ring_put, which
+// may happen in any order.
+void *
+jif_ring_take(struct jif_ring *r)
+{
+    uint32_t slot;
+
+    while (r->jr_next != r->jr_head) {
+	slot = r->jr_next % r->jr_nslots;
+	if (!(r->jr_span[slot] & JIF_RING_SKIP)) {
+	    r->jr_held[slot] = JIF_RING_TAKEN;
+	    r->jr_next += r->jr_span[slot];
+	    ring_retire(r);
+	    return JIF_RING_SLOT(r, slot);
+	}
+	r->jr_next += r->jr_span[slot] & ~JIF_RING_SKIP;
+    }
+    ring_retire(r);
+    return 0;
+}
+
+// Consumer: hold on to the record rec returned by jif_ring_take for as
+// long as need be, without holding up the records after it.  The
+// producer works around its slots, so keep few at a time (see
+// jr_nkept); it still has to be given back with jif_ring_put.
+void
+jif_ring_keep(struct jif_ring *r, void *rec)
+{
+    r->jr_held[((uintptr_t)rec - (uintptr_t)r) / PGSIZE - 1] = JIF_RING_KEPT;
+    r->jr_nkept++;
+    ring_retire(r);
+}
+
+// Consumer: give back the record rec returned by jif_ring_take.
+void
+jif_ring_put(struct jif_ring *r, void *rec)
+{
+    uint32_t slot = ((uintptr_t)rec - (uintptr_t)r) / PGSIZE - 1;
+
+    if (r->jr_held[slot] == JIF_RING_KEPT)
+	r->jr_nkept--;
+    r->jr_held[slot] = 0;
+    ring_retire(r);
+}
+
+// Consumer: return the oldest record, or 0 if the ring is empty.  For
+// consumers that handle one record at a time.
+void *
+jif_ring_peek(struct jif_ring *r)
+{
+    if (r->jr_tail != r->jr_next)
+	return JIF_RING_SLOT(r, r->jr_tail % r->jr_nslots);
+    return jif_ring_take(r);
+}
+
+// Consumer: give the record returned by jif_ring_peek back.
+void
+jif_ring_release(struct jif_ring *r)
+{
+    jif_ring_put(r, JIF_RING_SLOT(r, r->jr_tail % r->jr_nslots));
+}
+
+// Consumer: announce that we are about to block in ipc_recv.  Returns
+// 0, and does not sleep, if records arrived in the meantime; a wakeup
+// may then still be delivered later and must be ignored.
+int
+jif_ring_sleep(struct jif_ring *r)
+{
+    xchg(&r->jr_sleeping, 1);
+    if (r->jr_next == r->jr_head)
+	return 1;
+    xchg(&r->jr_sleeping, 0);
+    return 0;
+}
+
+// Consumer: block until the ring is not empty.  Only for environments
+// that receive nothing but the ring's wakeups.
+void
+jif_ring_wait(struct jif_ring *r)
+{
+    while (r->jr_next == r->jr_head)
+	if (jif_ring_sleep(r))
+	    ipc_recv(0, 0, 0);
+}
@@ -10,8 +10,13 @@ void *memcpy(void *dst, const void *src, size_t n);
 
 //#define NO_SYS 1
 
-#define LWIP_STATS		0
+// Plain counters, bumped without locking: lwIP only ever runs on the
+// network server's threads, which do not preempt each other.  Read
+// them with NSREQ_STATS.
+#define LWIP_STATS		1
+#define LWIP_STATS_LARGE	1
 #define LWIP_STATS_DISPLAY	0
+#define SYS_STATS		0
 #define LWIP_DHCP		1
 #define LWIP_COMPAT_SOCKETS	0
 //#define SYS_LIGHTWEIGHT_PROT	1
@@ -22,29 +27,57 @@ void *memcpy(void *dst, const void *src, size_t n);
 
 #define MEM_ALIGNMENT		4
 
-#define MEMP_NUM_PBUF		64
-#define MEMP_NUM_UDP_PCB	8
-#define MEMP_NUM_TCP_PCB	32
-#define MEMP_NUM_TCP_PCB_LISTEN	16
-#define MEMP_NUM_TCP_SEG	TCP_SND_QUEUELEN// at least as big as TCP_SND_QUEUELEN
-#define MEMP_NUM_NETBUF		128
-#define MEMP_NUM_NETCONN	32
+// The memp pools grow a page at a time from an arena in the network
+// server (see memp_slab_alloc in arch/sys_arch.c), so the MEMP_NUM_*
+// below are only limits and cost nothing until used.
+#define MEMP_GROW		1
+#define MEMP_GROW_SLAB		4096	// PGSIZE
+
+#define MEMP_NUM_PBUF		1024
+#define MEMP_NUM_UDP_PCB	64
+#define MEMP_NUM_TCP_PCB	512
+#define MEMP_NUM_TCP_PCB_LISTEN	64
+#define MEMP_NUM_TCP_SEG	4096	// at least as big as TCP_SND_QUEUELEN
+#define MEMP_NUM_NETBUF		1024
+#define MEMP_NUM_NETCONN	512
 #define MEMP_NUM_SYS_TIMEOUT    6
 
 #define PER_TCP_PCB_BUFFER	(16 * 4096)
-#define MEM_SIZE		(PER_TCP_PCB_BUFFER*MEMP_NUM_TCP_SEG + 4096*MEMP_NUM_TCP_SEG)
+// Fixed rather than scaled by TCP_SND_QUEUELEN, which grew with the windows
+#define MEM_SIZE		((PER_TCP_PCB_BUFFER + 4096) * 32)
 
-#define PBUF_POOL_SIZE		512
+#define PBUF_POOL_SIZE		2048
 #define PBUF_POOL_BUFSIZE	2000
+// jif hands received frames to lwIP in their receive ring slots
+#define LWIP_SUPPORT_CUSTOM_PBUF	1
 
 #define TCP_MSS			1460
-#define TCP_WND			24000
-#define TCP_SND_BUF		(16 * TCP_MSS)
+// Windows past 64k need RFC 7323 window scaling; SACK lets the sender
+// repair several losses per round trip.
+#define LWIP_WND_SCALE		1
+#define TCP_RCV_SCALE		2
+#define LWIP_TCP_SACK_OUT	1
+#define TCP_WND			(64 * TCP_MSS)
+#define TCP_SND_BUF		(64 * TCP_MSS)
 // lwip prints a warning if TCP_SND_QUEUELEN < (2 * TCP_SND_BUF/TCP_MSS), 
 // but 16 is faster.. 
 #define TCP_SND_QUEUELEN	(2 * TCP_SND_BUF/TCP_MSS)
 //#define TCP_SND_QUEUELEN	16
 
+// A hashed ARP table, and a per-PCB hint at the entry for the remote
+// address so established connections skip the lookup altogether.
+// Entries expire by their timestamps, with no timer.
+#define ARP_TABLE_SIZE		64
+#define ARP_HASH_SIZE		32
+#define LWIP_NETIF_HWADDRHINT	1
+
+// Packets to 127.0.0.1 or to our own address are queued on the netif
+// and fed back to lwIP by serve(), never reaching jif or the NIC.
+#define LWIP_HAVE_LOOPIF	1
+#define LWIP_NETIF_LOOPBACK	1
+#define LWIP_NETIF_LOOPBACK_MULTITHREADING	0
+#define LWIP_LOOPBACK_MAX_PBUFS	256
+
 // Print error messages when we run out of memory
 #define LWIP_DEBUG	1
 //#define TCP_DEBUG	LWIP_DBG_ON
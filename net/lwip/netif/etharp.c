@@ -51,6 +51,7 @@
 #include "lwip/inet.h"
 #include "lwip/ip.h"
 #include "lwip/stats.h"
+#include "lwip/sys.h"
 #include "lwip/snmp.h"
 #include "lwip/dhcp.h"
 #include "lwip/autoip.h"
@@ -63,18 +64,13 @@
 #include <string.h>
 
 /** the time an ARP entry stays valid after its last update,
- *  for ARP_TMR_INTERVAL = 5000, this is
- *  (240 * 5) seconds = 20 minutes.
+ *  in milliseconds (20 minutes).
  */
-#define ARP_MAXAGE 240
+#define ARP_MAXAGE (20 * 60 * 1000)
 /** the time an ARP entry stays pending after first request,
- *  for ARP_TMR_INTERVAL = 5000, this is
- *  (2 * 5) seconds = 10 seconds.
- * 
- *  @internal Keep this number at least 2, otherwise it might
- *  run out instantly if the timeout occurs directly after a request.
+ *  in milliseconds (10 seconds).
  */
-#define ARP_MAXPENDING 2
+#define ARP_MAXPENDING (10 * 1000)
 
 #define HWTYPE_ETHERNET 1
 
@@ -84,6 +80,10 @@
 #define ARPH_HWLEN_SET(hdr, len) (hdr)->_hwlen_protolen = htons(ARPH_PROTOLEN(hdr) | ((len) << 8))
 #define ARPH_PROTOLEN_SET(hdr, len) (hdr)->_hwlen_protolen = htons((len) | (ARPH_HWLEN(hdr) << 8))
 
+/** the hash chain an IP address is kept on */
+#define ARP_HASH(ipaddr) \
+  ((ntohl((ipaddr)->addr) ^ (ntohl((ipaddr)->addr) >> 8)) & (ARP_HASH_SIZE - 1))
+
 enum etharp_state {
   ETHARP_STATE_EMPTY = 0,
   ETHARP_STATE_PENDING,
@@ -100,13 +100,21 @@ struct etharp_entry {
   struct ip_addr ipaddr;
   struct eth_addr ethaddr;
   enum etharp_state state;
-  u8_t ctime;
+  /** arp_now when the entry was created or last updated */
+  u32_t stamp;
+  /** next entry on the hash chain, plus one; 0 ends the chain */
+  u8_t hnext;
   struct netif *netif;
 };
 
 const struct eth_addr ethbroadcast = {{0xff,0xff,0xff,0xff,0xff,0xff}};
 const struct eth_addr ethzero = {{0,0,0,0,0,0}};
 static struct etharp_entry arp_table[ARP_TABLE_SIZE];
+/** first entry of each hash chain, plus one; 0 for an empty chain.
+ *  Exactly the entries that are not ETHARP_STATE_EMPTY are hashed. */
+static u8_t arp_hash[ARP_HASH_SIZE];
+/** sys_now() as of the last etharp_clock(), so lookups need not read the clock */
+static u32_t arp_now;
 #if !LWIP_NETIF_HWADDRHINT
 static u8_t etharp_cached_entry;
 #endif
@@ -132,6 +140,9 @@ static err_t update_arp_entry(struct netif *netif, struct ip_addr *ipaddr, struc
 #if (LWIP_ARP && (ARP_TABLE_SIZE > 0x7f))
   #error "If you want to use ARP, ARP_TABLE_SIZE must fit in an s8_t, so, you have to reduce it in your lwipopts.h"
 #endif
+#if (LWIP_ARP && ((ARP_HASH_SIZE & (ARP_HASH_SIZE - 1)) != 0))
+  #error "ARP_HASH_SIZE must be a power of 2 in your lwipopts.h"
+#endif
 
 
 #if ARP_QUEUEING
@@ -157,49 +168,86 @@ free_etharp_q(struct etharp_q_entry *q)
 #endif
 
 /**
- * Clears expired entries in the ARP table.
+ * Has a pending or stable ARP entry outlived its time in that state?
+ *
+ * @param i the ARP entry index
+ * @param now the current arp_now
+ */
+static int
+etharp_expired(u8_t i, u32_t now)
+{
+  u32_t age = now - arp_table[i].stamp;
+
+  return ((arp_table[i].state == ETHARP_STATE_STABLE) && (age >= ARP_MAXAGE)) ||
+         ((arp_table[i].state == ETHARP_STATE_PENDING) && (age >= ARP_MAXPENDING));
+}
+
+/**
+ * Take a pending or stable ARP entry off its hash chain and empty it,
+ * freeing any packets still queued on it.
+ *
+ * @param i the ARP entry index
+ */
+static void
+etharp_free_entry(u8_t i)
+{
+  u8_t *link = &arp_hash[ARP_HASH(&arp_table[i].ipaddr)];
+
+  while (*link != i + 1) {
+    LWIP_ASSERT("ARP entry is hashed", *link != 0);
+    link = &arp_table[*link - 1].hnext;
+  }
+  *link = arp_table[i].hnext;
+  arp_table[i].hnext = 0;
+  /* remove from SNMP ARP index tree */
+  snmp_delete_arpidx_tree(arp_table[i].netif, &arp_table[i].ipaddr);
+#if ARP_QUEUEING
+  /* and empty packet queue */
+  if (arp_table[i].q != NULL) {
+    LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_free_entry: freeing entry %"U16_F", packet queue %p.\n", (u16_t)i, (void *)(arp_table[i].q)));
+    free_etharp_q(arp_table[i].q);
+    arp_table[i].q = NULL;
+  }
+#endif
+  /* recycle entry for re-use */
+  arp_table[i].state = ETHARP_STATE_EMPTY;
+}
+
+/**
+ * Advances the clock that ARP entries are stamped and aged with.
+ *
+ * This function should be called often, every few hundred milliseconds;
+ * entry lifetimes are only as precise as its calls.
+ */
+void
+etharp_clock(void)
+{
+  arp_now = sys_now();
+}
+
+/**
+ * Frees the packets queued on unanswered ARP requests.
  *
- * This function should be called every ETHARP_TMR_INTERVAL microseconds (5 seconds),
- * in order to expire entries in the ARP table.
+ * Entries are expired as they are looked up, so the only thing left for
+ * this function, called every ARP_TMR_INTERVAL milliseconds (5 seconds),
+ * is the pending entries nobody looks up again, which would otherwise
+ * hold on to their packet queues.
  */
 void
 etharp_tmr(void)
 {
+#if ARP_QUEUEING
   u8_t i;
 
   LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer\n"));
-  /* remove expired entries from the ARP table */
   for (i = 0; i < ARP_TABLE_SIZE; ++i) {
-    arp_table[i].ctime++;
-    if (((arp_table[i].state == ETHARP_STATE_STABLE) &&
-         (arp_table[i].ctime >= ARP_MAXAGE)) ||
-        ((arp_table[i].state == ETHARP_STATE_PENDING)  &&
-         (arp_table[i].ctime >= ARP_MAXPENDING))) {
-         /* pending or stable entry has become old! */
-      LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer: expired %s entry %"U16_F".\n",
-           arp_table[i].state == ETHARP_STATE_STABLE ? "stable" : "pending", (u16_t)i));
-      /* clean up entries that have just been expired */
-      /* remove from SNMP ARP index tree */
-      snmp_delete_arpidx_tree(arp_table[i].netif, &arp_table[i].ipaddr);
-#if ARP_QUEUEING
-      /* and empty packet queue */
-      if (arp_table[i].q != NULL) {
-        /* remove all queued packets */
-        LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer: freeing entry %"U16_F", packet queue %p.\n", (u16_t)i, (void *)(arp_table[i].q)));
-        free_etharp_q(arp_table[i].q);
-        arp_table[i].q = NULL;
-      }
-#endif
-      /* recycle entry for re-use */      
-      arp_table[i].state = ETHARP_STATE_EMPTY;
+    if (arp_table[i].state == ETHARP_STATE_PENDING && arp_table[i].q != NULL &&
+        etharp_expired(i, arp_now)) {
+      LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer: expired pending entry %"U16_F".\n", (u16_t)i));
+      etharp_free_entry(i);
     }
-#if ARP_QUEUEING
-    /* still pending entry? (not expired) */
-    if (arp_table[i].state == ETHARP_STATE_PENDING) {
-        /* resend an ARP query here? */
-    }
-#endif
   }
+#endif /* ARP_QUEUEING */
 }
 
 /**
@@ -216,6 +264,10 @@ etharp_tmr(void)
  * empty entries are available and ETHARP_TRY_HARD flag is set, recycle
  * old entries. Heuristic choose the least important entry for recycling.
  *
+ * Matching entries are found on their hash chain, or straight away if
+ * the per-pcb (or last) cached entry is the one; only creating an entry
+ * looks at the whole table.  Entries found to have expired are emptied.
+ *
  * @param ipaddr IP address to find in ARP cache, or to add if not found.
  * @param flags
  * - ETHARP_TRY_HARD: Try hard to create a entry by allowing recycling of
@@ -233,12 +285,13 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
 {
   s8_t old_pending = ARP_TABLE_SIZE, old_stable = ARP_TABLE_SIZE;
   s8_t empty = ARP_TABLE_SIZE;
-  u8_t i = 0, age_pending = 0, age_stable = 0;
+  u8_t i = 0, h;
+  u32_t now = arp_now, age_pending = 0, age_stable = 0;
 #if ARP_QUEUEING
   /* oldest entry with packets on queue */
   s8_t old_queue = ARP_TABLE_SIZE;
   /* its age */
-  u8_t age_queue = 0;
+  u32_t age_queue = 0;
 #endif
 
   /* First, test if the last call to this function asked for the
@@ -249,7 +302,8 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
     if ((netif != NULL) && (netif->addr_hint != NULL)) {
       /* per-pcb cached entry was given */
       u8_t per_pcb_cache = *(netif->addr_hint);
-      if ((per_pcb_cache < ARP_TABLE_SIZE) && arp_table[per_pcb_cache].state == ETHARP_STATE_STABLE) {
+      if ((per_pcb_cache < ARP_TABLE_SIZE) && arp_table[per_pcb_cache].state == ETHARP_STATE_STABLE &&
+          !etharp_expired(per_pcb_cache, now)) {
         /* the per-pcb-cached entry is stable */
         if (ip_addr_cmp(ipaddr, &arp_table[per_pcb_cache].ipaddr)) {
           /* per-pcb cached entry was the right one! */
@@ -259,7 +313,8 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
       }
     }
 #else /* #if LWIP_NETIF_HWADDRHINT */
-    if (arp_table[etharp_cached_entry].state == ETHARP_STATE_STABLE) {
+    if (arp_table[etharp_cached_entry].state == ETHARP_STATE_STABLE &&
+        !etharp_expired(etharp_cached_entry, now)) {
       /* the cached entry is stable */
       if (ip_addr_cmp(ipaddr, &arp_table[etharp_cached_entry].ipaddr)) {
         /* cached entry was the right one! */
@@ -268,6 +323,37 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
       }
     }
 #endif /* #if LWIP_NETIF_HWADDRHINT */
+
+    /* look for a pending or stable entry on the address's hash chain */
+    for (h = arp_hash[ARP_HASH(ipaddr)]; h != 0; h = arp_table[h - 1].hnext) {
+      if (ip_addr_cmp(ipaddr, &arp_table[h - 1].ipaddr)) {
+        break;
+      }
+    }
+    if (h != 0) {
+      i = h - 1;
+      if (etharp_expired(i, now)) {
+        LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: matching entry %"U16_F" expired\n", (u16_t)i));
+        etharp_free_entry(i);
+      } else {
+        LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: found matching %s entry %"U16_F"\n",
+          arp_table[i].state == ETHARP_STATE_STABLE ? "stable" : "pending", (u16_t)i));
+#if LWIP_NETIF_HWADDRHINT
+        NETIF_SET_HINT(netif, i);
+#else /* #if LWIP_NETIF_HWADDRHINT */
+        etharp_cached_entry = i;
+#endif /* #if LWIP_NETIF_HWADDRHINT */
+        return i;
+      }
+    }
+  }
+
+  /* { we have no match } => try to create a new entry */
+
+  /* don't create new entry, only search? */
+  if ((flags & ETHARP_FIND_ONLY) != 0) {
+    LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: no matching entry found\n"));
+    return (s8_t)ERR_MEM;
   }
 
   /**
@@ -277,15 +363,17 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
    */
 
   /* a) in a single search sweep, do all of this
-   * 1) remember the first empty entry (if any)
-   * 2) remember the oldest stable entry (if any)
-   * 3) remember the oldest pending entry without queued packets (if any)
-   * 4) remember the oldest pending entry with queued packets (if any)
-   * 5) search for a matching IP entry, either pending or stable
-   *    until 5 matches, or all entries are searched for.
+   * 1) empty any expired entry
+   * 2) remember the first empty entry (if any)
+   * 3) remember the oldest stable entry (if any)
+   * 4) remember the oldest pending entry without queued packets (if any)
+   * 5) remember the oldest pending entry with queued packets (if any)
    */
 
   for (i = 0; i < ARP_TABLE_SIZE; ++i) {
+    if ((arp_table[i].state != ETHARP_STATE_EMPTY) && etharp_expired(i, now)) {
+      etharp_free_entry(i);
+    }
     /* no empty entry found yet and now we do find one? */
     if ((empty == ARP_TABLE_SIZE) && (arp_table[i].state == ETHARP_STATE_EMPTY)) {
       LWIP_DEBUGF(ETHARP_DEBUG, ("find_entry: found empty entry %"U16_F"\n", (u16_t)i));
@@ -294,57 +382,33 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
     }
     /* pending entry? */
     else if (arp_table[i].state == ETHARP_STATE_PENDING) {
-      /* if given, does IP address match IP address in ARP entry? */
-      if (ipaddr && ip_addr_cmp(ipaddr, &arp_table[i].ipaddr)) {
-        LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: found matching pending entry %"U16_F"\n", (u16_t)i));
-        /* found exact IP address match, simply bail out */
-#if LWIP_NETIF_HWADDRHINT
-        NETIF_SET_HINT(netif, i);
-#else /* #if LWIP_NETIF_HWADDRHINT */
-        etharp_cached_entry = i;
-#endif /* #if LWIP_NETIF_HWADDRHINT */
-        return i;
 #if ARP_QUEUEING
       /* pending with queued packets? */
-      } else if (arp_table[i].q != NULL) {
-        if (arp_table[i].ctime >= age_queue) {
+      if (arp_table[i].q != NULL) {
+        if (now - arp_table[i].stamp >= age_queue) {
           old_queue = i;
-          age_queue = arp_table[i].ctime;
+          age_queue = now - arp_table[i].stamp;
         }
+      } else
 #endif
       /* pending without queued packets? */
-      } else {
-        if (arp_table[i].ctime >= age_pending) {
-          old_pending = i;
-          age_pending = arp_table[i].ctime;
-        }
-      }        
+      if (now - arp_table[i].stamp >= age_pending) {
+        old_pending = i;
+        age_pending = now - arp_table[i].stamp;
+      }
     }
     /* stable entry? */
     else if (arp_table[i].state == ETHARP_STATE_STABLE) {
-      /* if given, does IP address match IP address in ARP entry? */
-      if (ipaddr && ip_addr_cmp(ipaddr, &arp_table[i].ipaddr)) {
-        LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: found matching stable entry %"U16_F"\n", (u16_t)i));
-        /* found exact IP address match, simply bail out */
-#if LWIP_NETIF_HWADDRHINT
-        NETIF_SET_HINT(netif, i);
-#else /* #if LWIP_NETIF_HWADDRHINT */
-        etharp_cached_entry = i;
-#endif /* #if LWIP_NETIF_HWADDRHINT */
-        return i;
       /* remember entry with oldest stable entry in oldest, its age in maxtime */
-      } else if (arp_table[i].ctime >= age_stable) {
+      if (now - arp_table[i].stamp >= age_stable) {
         old_stable = i;
-        age_stable = arp_table[i].ctime;
+        age_stable = now - arp_table[i].stamp;
       }
     }
   }
-  /* { we have no match } => try to create a new entry */
-   
+
   /* no empty entry found and not allowed to recycle? */
-  if (((empty == ARP_TABLE_SIZE) && ((flags & ETHARP_TRY_HARD) == 0))
-      /* or don't create new entry, only search? */
-      || ((flags & ETHARP_FIND_ONLY) != 0)) {
+  if ((empty == ARP_TABLE_SIZE) && ((flags & ETHARP_TRY_HARD) == 0)) {
     LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: no empty entry found and not allowed to recycle\n"));
     return (s8_t)ERR_MEM;
   }
@@ -380,11 +444,9 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
 #if ARP_QUEUEING
   /* 4) found recyclable pending entry with queued packets? */
   } else if (old_queue < ARP_TABLE_SIZE) {
-    /* recycle oldest pending */
+    /* recycle oldest pending, its packet queue is freed below */
     i = old_queue;
     LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: selecting oldest pending entry %"U16_F", freeing packet queue %p\n", (u16_t)i, (void *)(arp_table[i].q)));
-    free_etharp_q(arp_table[i].q);
-    arp_table[i].q = NULL;
 #endif
     /* no empty or recyclable entries found */
   } else {
@@ -394,19 +456,21 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
   /* { empty or recyclable entry found } */
   LWIP_ASSERT("i < ARP_TABLE_SIZE", i < ARP_TABLE_SIZE);
 
-  if (arp_table[i].state != ETHARP_STATE_EMPTY)
-  {
-    snmp_delete_arpidx_tree(arp_table[i].netif, &arp_table[i].ipaddr);
-  }
   /* recycle entry (no-op for an already empty entry) */
-  arp_table[i].state = ETHARP_STATE_EMPTY;
+  if (arp_table[i].state != ETHARP_STATE_EMPTY) {
+    etharp_free_entry(i);
+  }
 
   /* IP address given? */
   if (ipaddr != NULL) {
     /* set IP address */
     ip_addr_set(&arp_table[i].ipaddr, ipaddr);
   }
-  arp_table[i].ctime = 0;
+  arp_table[i].stamp = now;
+  /* hash it now: the caller makes it pending or stable right away */
+  h = ARP_HASH(&arp_table[i].ipaddr);
+  arp_table[i].hnext = arp_hash[h];
+  arp_hash[h] = i + 1;
 #if LWIP_NETIF_HWADDRHINT
   NETIF_SET_HINT(netif, i);
 #else /* #if LWIP_NETIF_HWADDRHINT */
@@ -508,7 +572,7 @@ update_arp_entry(struct netif *netif, struct ip_addr *ipaddr, struct eth_addr *e
     arp_table[i].ethaddr.addr[k] = ethaddr->addr[k];
   }
   /* reset time stamp */
-  arp_table[i].ctime = 0;
+  arp_table[i].stamp = arp_now;
 #if ARP_QUEUEING
   /* this is where we will send out queued packets! */
   while (arp_table[i].q != NULL) {
@@ -2,8 +2,30 @@
 #include <inc/error.h>
 #include <inc/assert.h>
 #include <inc/lib.h>
+#include <jif/jif.h>
 extern union Nsipc nsipcbuf;
 
+// Hand frames from the shared transmit ring to the device driver.
+static void
+output_ring(struct jif_ring *ring)
+{
+	struct jif_txpkt *pkt;
+	int r;
+
+	while (1) {
+		jif_ring_wait(ring);
+		pkt = jif_ring_peek(ring);
+		if (pkt->jp_mss)
+			while ((r = sys_net_try_transmit_tso(pkt->jp_data, pkt->jp_len,
+							     pkt->jp_hdrlen, pkt->jp_mss)) == -E_NO_TX);
+		else
+			while ((r = sys_net_try_transmit(pkt->jp_data, pkt->jp_len)) == -E_NO_TX);
+		if (r < 0)
+			panic("sys_net_try_transmit: %e", r);
+		jif_ring_release(ring);
+	}
+}
+
 void
 output(envid_t ns_envid)
 {
@@ -12,6 +34,10 @@ output(envid_t ns_envid)
 	// LAB 6: Your code here:
 	// 	- read a packet from the network server
 	//	- send the packet to the device driver
+	// the network server picked our NIC queue before starting us
+	if (jif_ring_attach(JIF_TXRING(thisenv->env_net_queue)))
+		output_ring(JIF_TXRING(thisenv->env_net_queue));
+
 	while (1) {
 		int perm = 0;
 		int whom = 0;
@@ -22,6 +22,7 @@
 #include <lwip/stats.h>
 #include <lwip/netbuf.h>
 #include <netif/etharp.h>
+#include <netif/loopif.h>
 #include <jif/jif.h>
 
 #include "ns.h"
@@ -30,22 +31,27 @@
 int errno;
 
 struct netif nif;
+// 127.0.0.1
+static struct netif loif;
 
 #define debug 0
 
+// Receive ring passes before serve() lets IPC clients in
+#define RX_MAXPASSES 16
+
 struct timer_thread {
 	uint32_t msec;
 	void (*func)(void);
 	const char *name;
 };
 
-static struct timer_thread t_arp;
 static struct timer_thread t_tcpf;
 static struct timer_thread t_tcps;
 
 static envid_t timer_envid;
-static envid_t input_envid;
-static envid_t output_envid;
+static envid_t input_envid[JIF_MAXQUEUES];
+static envid_t output_envid[JIF_MAXQUEUES];
+static int nqueues;
 
 static bool buse[QUEUE_SIZE];
 static int next_i(int i) { return (i+1) % QUEUE_SIZE; }
@@ -95,6 +101,43 @@ lwip_init(struct netif *nif, void *if_state,
 	netif_set_up(nif);
 }
 
+static void
+loop_init(struct netif *lo)
+{
+	struct ip_addr ipaddr, netmask, gateway;
+	IP4_ADDR(&ipaddr, 127, 0, 0, 1);
+	IP4_ADDR(&netmask, 255, 0, 0, 0);
+	IP4_ADDR(&gateway, 0, 0, 0, 0);
+
+	if (0 == netif_add(lo, &ipaddr, &netmask, &gateway, 0, loopif_init,
+			   ip_input))
+		panic("loop_init: error in netif_add\n");
+	netif_set_up(lo);
+}
+
+// Has lwIP looped back packets to one of our own addresses?
+static int
+loop_pending(void)
+{
+	struct netif *n;
+
+	for (n = netif_list; n; n = n->next)
+		if (n->loop_first)
+			return 1;
+	return 0;
+}
+
+// Feed looped back packets to lwIP again, as jif_input_ring does with
+// frames off the wire.  Returns whether there were any.
+static int
+loop_input(void)
+{
+	if (!loop_pending())
+		return 0;
+	netif_poll_all();
+	return 1;
+}
+
 static void __attribute__((noreturn))
 net_timer(uint32_t arg)
 {
@@ -122,6 +165,26 @@ start_timer(struct timer_thread *t, void (*func)(void), const char *name, int ms
 		panic("cannot create timer thread: %s", e2s(r));
 }
 
+// The TCP fast timer also keeps the ARP table's clock going.
+static void
+fast_timer(void)
+{
+	tcp_fasttmr();
+	etharp_clock();
+}
+
+// The TCP slow timer also frees packets queued on unanswered ARP
+// requests every ARP_TMR_INTERVAL.
+static void
+slow_timer(void)
+{
+	static int ticks;
+
+	tcp_slowtmr();
+	if (++ticks % (ARP_TMR_INTERVAL / TCP_SLOW_INTERVAL) == 0)
+		etharp_tmr();
+}
+
 static void
 tcpip_init_done(void *arg)
 {
@@ -142,11 +205,11 @@ serve_init(uint32_t ipaddr, uint32_t netmask, uint32_t gw)
 	thread_wait(&done, 0, (uint32_t)~0);
 	lwip_core_lock();
 
-	lwip_init(&nif, &output_envid, ipaddr, netmask, gw);
+	lwip_init(&nif, &output_envid[0], ipaddr, netmask, gw);
+	loop_init(&loif);
 
-	start_timer(&t_arp, &etharp_tmr, "arp timer", ARP_TMR_INTERVAL);
-	start_timer(&t_tcpf, &tcp_fasttmr, "tcp f timer", TCP_FAST_INTERVAL);
-	start_timer(&t_tcps, &tcp_slowtmr, "tcp s timer", TCP_SLOW_INTERVAL);
+	start_timer(&t_tcpf, &fast_timer, "tcp f timer", TCP_FAST_INTERVAL);
+	start_timer(&t_tcps, &slow_timer, "tcp s timer", TCP_SLOW_INTERVAL);
 
 	struct in_addr ia = {ipaddr};
 	cprintf("ns: %02x:%02x:%02x:%02x:%02x:%02x"
@@ -177,17 +240,240 @@ process_timer(envid_t envid) {
 	ipc_send(envid, to, 0, 0);
 }
 
+// Requests are served by a fixed pool of worker threads.  A request
+// that would block in lwIP waiting for the peer is parked rather than
+// holding on to a worker, and retried whenever frames come in or the
+// timer ticks.
+#define NS_NWORKERS	8
+
 struct st_args {
 	int32_t reqno;
+	uint32_t value;		// the whole IPC value, for NSREQ_SENDPAGE
 	uint32_t whom;
 	union Nsipc *req;
 };
 
+// at most QUEUE_SIZE requests are in flight, one per request buffer
+static struct st_args reqs[QUEUE_SIZE];
+static struct st_args *runq[QUEUE_SIZE];
+static volatile uint32_t runq_head;
+static uint32_t runq_tail;
+static struct st_args *parked[QUEUE_SIZE];
+static int nparked;
+
+static void
+run_request(struct st_args *args)
+{
+	runq[runq_head % QUEUE_SIZE] = args;
+	runq_head++;
+	thread_wakeup(&runq_head);
+}
+
 static void
-serve_thread(uint32_t a) {
-	struct st_args *args = (struct st_args *)a;
+unpark_requests(void)
+{
+	while (nparked > 0)
+		run_request(parked[--nparked]);
+}
+
+// How much of a len-byte send on s lwIP queues without waiting for the
+// peer: what a TCP socket's send queue has room for, or all of it.
+static int
+send_space(int s, int len)
+{
+	int space;
+
+	if (lwip_ioctl(s, FIONSPACE, &space) < 0)
+		return len;
+	return MIN(len, space);
+}
+
+// Would the request wait in lwIP for the peer?  Checks for a pending
+// connection or send buffer space without blocking itself; calls on
+// bad sockets are let through to fail.
+static bool
+request_would_block(struct st_args *args)
+{
+	struct timeval tv = {0, 0};
+	fd_set fds;
+	u16_t avail;
+	int s;
+
+	switch (args->reqno) {
+	case NSREQ_ACCEPT:
+		s = args->req->accept.req_s;
+		break;
+	case NSREQ_SEND:
+		s = args->req->send.req_s;
+		break;
+	case NSREQ_SENDPAGE:
+		s = NSREQ_SENDPAGE_SOCK(args->value);
+		break;
+	case NSREQ_SENDMMSG:
+		s = args->req->mmsg.req_s;
+		break;
+	default:
+		return 0;
+	}
+	if (lwip_ioctl(s, FIONREAD, &avail) < 0)
+		return 0;
+	FD_ZERO(&fds);
+	FD_SET(s, &fds);
+	if (args->reqno == NSREQ_ACCEPT)
+		return lwip_select(s + 1, &fds, 0, 0, &tv) == 0;
+	return lwip_select(s + 1, 0, &fds, 0, &tv) == 0
+		|| send_space(s, 1) == 0;
+}
+
+// Did the client ask for -E_AGAIN rather than waiting?
+static bool
+request_dontwait(struct st_args *args)
+{
+	switch (args->reqno) {
+	case NSREQ_ACCEPT:
+		return args->req->accept.req_flags & MSG_DONTWAIT;
+	case NSREQ_SEND:
+		return args->req->send.req_flags & MSG_DONTWAIT;
+	case NSREQ_SENDMMSG:
+		return args->req->mmsg.req_flags & MSG_DONTWAIT;
+	default:
+		return 0;
+	}
+}
+
+// Fill in the revents of a poll request's sockets without blocking.
+// Returns the number of ready sockets.
+static int
+poll_sockets(struct Nsreq_poll *req)
+{
+	struct timeval tv = {0, 0};
+	fd_set rfds, wfds;
+	struct pollfd *pfd;
+	u16_t avail;
+	int i, n, maxfd = 0;
+
+	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
+	for (i = 0; i < req->req_nfds; i++) {
+		pfd = &req->req_fds[i];
+		pfd->revents = 0;
+		if (pfd->fd < 0 || pfd->fd >= FD_SETSIZE
+		    || lwip_ioctl(pfd->fd, FIONREAD, &avail) < 0) {
+			pfd->revents = POLLNVAL;
+			continue;
+		}
+		if (pfd->events & POLLIN)
+			FD_SET(pfd->fd, &rfds);
+		if (pfd->events & POLLOUT)
+			FD_SET(pfd->fd, &wfds);
+		maxfd = MAX(maxfd, pfd->fd + 1);
+	}
+	if (maxfd > 0)
+		lwip_select(maxfd, &rfds, &wfds, 0, &tv);
+
+	for (i = n = 0; i < req->req_nfds; i++) {
+		pfd = &req->req_fds[i];
+		if (!(pfd->revents & POLLNVAL)) {
+			if (FD_ISSET(pfd->fd, &rfds))
+				pfd->revents |= POLLIN;
+			if (FD_ISSET(pfd->fd, &wfds))
+				pfd->revents |= POLLOUT;
+		}
+		if (pfd->revents)
+			n++;
+	}
+	return n;
+}
+
+// Send the datagrams of a SendMmsg request.  Returns how many were
+// sent, or -1 with errno set if the first one could not be.
+static int
+serve_sendmmsg(struct Nsreq_mmsg *req)
+{
+	char *p = req->req_msgs, *end = (char *)req + PGSIZE;
+	struct Nsmsg *m;
+	int n, r;
+
+	for (n = 0; n < req->req_n; n++) {
+		m = (struct Nsmsg *)p;
+		if (end - p < (int)sizeof(*m) || m->m_len < 0
+		    || m->m_len > end - p - (int)sizeof(*m))
+			return n ? n : -E_INVAL;
+		if (m->m_addr.sin_family)
+			r = lwip_sendto(req->req_s, m->m_data, m->m_len,
+					req->req_flags, (struct sockaddr *)&m->m_addr,
+					sizeof(m->m_addr));
+		else
+			r = lwip_sendto(req->req_s, m->m_data, m->m_len,
+					req->req_flags, 0, 0);
+		if (r < 0)
+			return n ? n : r;
+		p += NSMSG_SIZE(m->m_len);
+	}
+	return n;
+}
+
+// Receive as many datagrams as are waiting, up to req_n and as long as
+// one of req_len bytes still fits, into the page after the request.
+// Longer ones are cut short.  Returns how many were received, or -1
+// with errno set if there were none.
+static int
+serve_recvmmsg(struct Nsreq_mmsg *req)
+{
+	char *p = req->req_msgs, *end = (char *)req + PGSIZE;
+	struct Nsmsg *m;
+	socklen_t alen;
+	int n, r;
+
+	if (req->req_n < 1 || req->req_len < 0
+	    || req->req_len > NSMMSG_SPACE - sizeof(*m))
+		return -E_INVAL;
+	for (n = 0; n < req->req_n && p + NSMSG_SIZE(req->req_len) <= end; n++) {
+		m = (struct Nsmsg *)p;
+		alen = sizeof(m->m_addr);
+		r = lwip_recvfrom(req->req_s, m->m_data, req->req_len,
+				  req->req_flags | MSG_DONTWAIT,
+				  (struct sockaddr *)&m->m_addr, &alen);
+		if (r < 0)
+			return n ? n : r;
+		m->m_len = r;
+		p += NSMSG_SIZE(r);
+	}
+	return n;
+}
+
+// Take a snapshot of the lwIP counters and pool usage.
+static int
+serve_stats(struct Nsret_stats *ret)
+{
+	int i;
+
+	ret->ret_msec = sys_time_msec();
+	ret->ret_lwip = lwip_stats;
+	for (i = 0; i < MEMP_MAX; i++) {
+		memp_pool_stats(i, &ret->ret_pool[i]);
+		strncpy(ret->ret_pool_name[i], ret->ret_pool[i].name,
+			sizeof(ret->ret_pool_name[i]) - 1);
+		ret->ret_pool_name[i][sizeof(ret->ret_pool_name[i]) - 1] = 0;
+		// meaningless outside the network server
+		ret->ret_pool[i].name = 0;
+	}
+	return 0;
+}
+
+// Serve one request.  Returns 0 if it would block and must be parked.
+static bool
+serve_request(struct st_args *args)
+{
 	union Nsipc *req = args->req;
-	int r;
+	int r, s;
+
+	if (request_would_block(args)) {
+		if (!request_dontwait(args))
+			return 0;
+		r = -E_AGAIN;
+		goto reply;
+	}
 
 	switch (args->reqno) {
 	case NSREQ_ACCEPT:
@@ -217,19 +503,62 @@ serve_thread(uint32_t a) {
 		r = lwip_listen(req->listen.req_s, req->listen.req_backlog);
 		break;
 	case NSREQ_RECV:
+		// Never wait inside lwIP; the request fields are left
+		// alone if there is nothing to read, so it can be retried.
 		// Note that we read the request fields before we
 		// overwrite it with the response data.
 		r = lwip_recv(req->recv.req_s, req->recvRet.ret_buf,
-			      req->recv.req_len, req->recv.req_flags);
+			      MIN(req->recv.req_len, PGSIZE),
+			      req->recv.req_flags | MSG_DONTWAIT);
+		if (r < 0 && errno == EWOULDBLOCK) {
+			if (!(req->recv.req_flags & MSG_DONTWAIT))
+				return 0;
+			r = -E_AGAIN;
+		}
 		break;
 	case NSREQ_SEND:
+		// Sends queue no more than there is room for, so lwIP
+		// never waits for the peer; the client gets a short count.
 		r = lwip_send(req->send.req_s, &req->send.req_buf,
-			      req->send.req_size, req->send.req_flags);
+			      send_space(req->send.req_s, req->send.req_size),
+			      req->send.req_flags);
+		break;
+	case NSREQ_SENDMMSG:
+		r = serve_sendmmsg(&req->mmsg);
+		break;
+	case NSREQ_RECVMMSG:
+		// like NSREQ_RECV, park only if nothing at all came in
+		r = serve_recvmmsg(&req->mmsg);
+		if (r < 0 && r != -E_INVAL && errno == EWOULDBLOCK) {
+			if (!(req->mmsg.req_flags & MSG_DONTWAIT))
+				return 0;
+			r = -E_AGAIN;
+		}
 		break;
 	case NSREQ_SOCKET:
 		r = lwip_socket(req->socket.req_domain, req->socket.req_type,
 				req->socket.req_protocol);
 		break;
+	case NSREQ_SENDPAGE:
+		// the page is the client's own buffer, lent for the call
+		s = NSREQ_SENDPAGE_SOCK(args->value);
+		r = lwip_send(s, req, send_space(s,
+			      MIN(NSREQ_SENDPAGE_LEN(args->value), PGSIZE)), 0);
+		break;
+	case NSREQ_POLL:
+		if (req->poll.req_nfds < 0 || req->poll.req_nfds > NSPOLL_MAXFDS) {
+			r = -E_INVAL;
+			break;
+		}
+		// parked polls are retried as frames come in, on timer
+		// ticks, and when the earliest deadline passes
+		r = poll_sockets(&req->poll);
+		if (r == 0 && sys_time_msec() < req->poll.req_deadline)
+			return 0;
+		break;
+	case NSREQ_STATS:
+		r = serve_stats(&req->statsRet);
+		break;
 	case NSREQ_INPUT:
 		jif_input(&nif, (void *)&req->pkt);
 		r = 0;
@@ -240,6 +569,7 @@ serve_thread(uint32_t a) {
 		break;
 	}
 
+reply:
 	if (r == -1) {
 		char buf[100];
 		snprintf(buf, sizeof buf, "ns req type %d", args->reqno);
@@ -251,16 +581,81 @@ serve_thread(uint32_t a) {
 
 	put_buffer(args->req);
 	sys_page_unmap(0, (void*) args->req);
-	free(args);
+	return 1;
+}
+
+// The earliest deadline of a parked poll, 0 if there is none.
+static unsigned int
+poll_deadline(void)
+{
+	unsigned int d, deadline = 0;
+	int i;
+
+	for (i = 0; i < nparked; i++) {
+		if (parked[i]->reqno != NSREQ_POLL)
+			continue;
+		d = parked[i]->req->poll.req_deadline;
+		if (d != ~0U && (!deadline || d < deadline))
+			deadline = d;
+	}
+	return deadline;
+}
+
+static void
+serve_worker(uint32_t arg)
+{
+	struct st_args *args;
+
+	while (1) {
+		while (runq_tail == runq_head)
+			thread_wait(&runq_head, runq_tail, ~0);
+		args = runq[runq_tail % QUEUE_SIZE];
+		runq_tail++;
+		if (!serve_request(args))
+			parked[nparked++] = args;
+	}
+}
+
+static void
+rx_set_sleeping(uint32_t sleeping)
+{
+	int q;
+
+	for (q = 0; q < nqueues; q++)
+		xchg(&JIF_RXRING(q)->jr_sleeping, sleeping);
+}
+
+// Ask every input environment to wake us.  Returns 0, and asks none,
+// if frames are already waiting in one of the receive rings.
+static int
+rx_sleep(void)
+{
+	int q;
+
+	for (q = 0; q < nqueues; q++)
+		if (!jif_ring_sleep(JIF_RXRING(q))) {
+			rx_set_sleeping(0);
+			return 0;
+		}
+	return 1;
 }
 
 void
 serve(void) {
 	int32_t reqno;
 	uint32_t whom;
-	int i, perm;
+	int i, n, perm;
+	int rxpasses = 0;
 	void *va;
 
+	for (i = 0; i < nqueues; i++)
+		if (!jif_ring_attach(JIF_RXRING(i)))
+			panic("serve: no receive ring %d", i);
+
+	for (i = 0; i < NS_NWORKERS; i++)
+		if ((n = thread_create(0, "serve_worker", serve_worker, 0)) < 0)
+			panic("cannot create worker thread: %s", e2s(n));
+
 	while (1) {
 		// ipc_recv will block the entire process, so we flush
 		// all pending work from other threads.  We limit the
@@ -268,17 +663,59 @@ serve(void) {
 		for (i = 0; thread_wakeups_pending() && i < 32; ++i)
 			thread_yield();
 
+		// Drain the receive ring and the loopback queues, and let
+		// the threads they woke run before blocking.  Bound the
+		// number of passes so busy traffic cannot starve our IPC
+		// clients.  New packets may let parked requests go on.
+		n = jif_input_ring(&nif) + loop_input();
+		if (n > 0)
+			unpark_requests();
+		if (n > 0 && ++rxpasses < RX_MAXPASSES)
+			continue;
+
+		// Push out any TSO super-segment lwIP left pending.
+		jif_flush(&nif);
+
+		// Ask the input environment to wake us.  After a long busy
+		// stretch block even if frames are waiting, so that our IPC
+		// clients get a turn; the next frame will wake us.
+		if (!rx_sleep()) {
+			if (rxpasses < RX_MAXPASSES)
+				continue;
+			rx_set_sleeping(1);
+		}
+		rxpasses = 0;
+
+		// Nothing wakes us for looped back packets, so only let
+		// IPC clients in for a moment if some are left.
 		perm = 0;
 		va = get_buffer();
-		reqno = ipc_recv((int32_t *) &whom, (void *) va, &perm);
+		reqno = ipc_recv_until((int32_t *) &whom, (void *) va, &perm,
+				       loop_pending() ? sys_time_msec() + 1
+				       : poll_deadline());
+		rx_set_sleeping(0);
 		if (debug) {
 			cprintf("ns req %d from %08x\n", reqno, whom);
 		}
 
+		// a parked poll has run out of time
+		if (reqno == -E_TIMEOUT) {
+			put_buffer(va);
+			unpark_requests();
+			continue;
+		}
+
 		// first take care of requests that do not contain an argument page
 		if (reqno == NSREQ_TIMER) {
 			process_timer(whom);
 			put_buffer(va);
+			// lwIP's timers may have closed connections
+			unpark_requests();
+			continue;
+		}
+		if (reqno == NSREQ_INPUT && !(perm & PTE_P)) {
+			// just a receive ring wakeup
+			put_buffer(va);
 			continue;
 		}
 
@@ -288,21 +725,37 @@ serve(void) {
 			continue; // just leave it hanging...
 		}
 
-		// Since some lwIP socket calls will block, create a thread and
-		// process the rest of the request in the thread.
-		struct st_args *args = malloc(sizeof(struct st_args));
-		if (!args)
-			panic("could not allocate thread args structure");
-
-		args->reqno = reqno;
+		// Since some lwIP socket calls will block, hand the request
+		// to a worker thread.
+		struct st_args *args = &reqs[((uint32_t)va - REQVA) / PGSIZE];
+		args->reqno = NSREQ_TYPE(reqno);
+		args->value = reqno;
 		args->whom = whom;
 		args->req = va;
 
-		thread_create(0, "serve_thread", serve_thread, (uint32_t)args);
-		thread_yield(); // let the thread created run
+		run_request(args);
+		thread_yield(); // let a worker pick it up
 	}
 }
 
+// Attach the calling input or output environment to NIC queue q and
+// pin it to CPU q, wrapping around if there are fewer CPUs than queues,
+// so each queue's interrupts and copies stay on one CPU.
+static void
+queue_helper_init(int q)
+{
+	int ncpu, r;
+
+	if ((r = sys_net_set_queue(q)) < 0)
+		panic("sys_net_set_queue: %e", r);
+	// a mask naming no CPU is refused, which tells us how many there are
+	for (ncpu = 1; ncpu < 32; ncpu++)
+		if (sys_env_set_affinity(0, 1 << ncpu) == -E_INVAL)
+			break;
+	if ((r = sys_env_set_affinity(0, 1 << (q % ncpu))) < 0)
+		panic("sys_env_set_affinity: %e", r);
+}
+
 static void
 tmain(uint32_t arg) {
 	serve_init(inet_addr(IP),
@@ -315,6 +768,7 @@ void
 umain(int argc, char **argv)
 {
 	envid_t ns_envid = sys_getenvid();
+	int q, r;
 
 	binaryname = "ns";
 
@@ -327,24 +781,36 @@ umain(int argc, char **argv)
 		return;
 	}
 
-	// fork off the input thread which will poll the NIC driver for input
-	// packets
-	input_envid = fork();
-	if (input_envid < 0)
-		panic("error forking");
-	else if (input_envid == 0) {
-		input(ns_envid);
-		return;
-	}
+	// each NIC queue gets its own input and output environment, and
+	// its own pair of packet rings shared with them
+	nqueues = MIN(MAX(sys_net_queues(), 1), JIF_MAXQUEUES);
+	for (q = 0; q < nqueues; q++) {
+		if ((r = jif_ring_init(JIF_RXRING(q), JIF_RING_MAXSLOTS, NSREQ_INPUT)) < 0)
+			panic("jif_ring_init: %e", r);
+		if ((r = jif_ring_init(JIF_TXRING(q), JIF_RING_MAXSLOTS, NSREQ_OUTPUT)) < 0)
+			panic("jif_ring_init: %e", r);
+
+		// fork off the input thread which will poll the NIC driver for input
+		// packets
+		input_envid[q] = fork();
+		if (input_envid[q] < 0)
+			panic("error forking");
+		else if (input_envid[q] == 0) {
+			queue_helper_init(q);
+			input(ns_envid);
+			return;
+		}
 
-	// fork off the output thread that will send the packets to the NIC
-	// driver
-	output_envid = fork();
-	if (output_envid < 0)
-		panic("error forking");
-	else if (output_envid == 0) {
-		output(ns_envid);
-		return;
+		// fork off the output thread that will send the packets to the NIC
+		// driver
+		output_envid[q] = fork();
+		if (output_envid[q] < 0)
+			panic("error forking");
+		else if (output_envid[q] == 0) {
+			queue_helper_init(q);
+			output(ns_envid);
+			return;
+		}
 	}
 
 	// lwIP requires a user threading library; start the library and jump
@@ -1,25 +1,55 @@
-// Demonstrate lack of fairness in IPC.
-// Start three instances of this program as envs 1, 2, and 3.
-// (user/idle is env 0).
+// Measure file server latency under CPU load.  Time stat() calls,
+// each a few IPC round trips to the fs server, with the CPU idle, then
+// with CPU-bound envs competing in the normal class, then with the
+// same envs demoted to the batch class.
 
 #include <inc/lib.h>
 
+#define NSPIN	4
+#define NREQ	50
+
+static void
+measure(const char *what)
+{
+	struct Stat st;
+	uint64_t start;
+	unsigned int d, total = 0, max = 0;
+	int i, r;
+
+	for (i = 0; i < NREQ; i++) {
+		start = sys_time_usec();
+		if ((r = stat("/motd", &st)) < 0)
+			panic("stat /motd: %e", r);
+		d = sys_time_usec() - start;
+		total += d;
+		if (d > max)
+			max = d;
+	}
+	cprintf("%s: stat avg %u us, max %u us\n", what, total / NREQ, max);
+}
+
 void
 umain(int argc, char **argv)
 {
-	envid_t who, id;
-
-	id = sys_getenvid();
-
-	if (thisenv == &envs[1]) {
-		while (1) {
-			ipc_recv(&who, 0, 0);
-			cprintf("%x recv from %x\n", id, who);
-		}
-	} else {
-		cprintf("%x loop sending to %x\n", id, envs[1].env_id);
-		while (1)
-			ipc_send(envs[1].env_id, 0, 0, 0);
+	envid_t spin[NSPIN];
+	int i, r;
+
+	measure("idle");
+
+	for (i = 0; i < NSPIN; i++) {
+		if ((spin[i] = fork()) < 0)
+			panic("fork: %e", spin[i]);
+		if (spin[i] == 0)
+			while (1)
+				/* do nothing */;
 	}
-}
+	measure("normal spinners");
 
+	for (i = 0; i < NSPIN; i++)
+		if ((r = sys_env_set_priority(spin[i], ENV_PRIO_BATCH)) < 0)
+			panic("sys_env_set_priority: %e", r);
+	measure("batch spinners");
+
+	for (i = 0; i < NSPIN; i++)
+		sys_env_destroy(spin[i]);
+}
@@ -4,17 +4,20 @@
 
 #define PORT 80
 #define VERSION "0.1"
-#define HTTP_VERSION "1.0"
+#define HTTP_VERSION "1.1"
 
 #define E_BAD_REQ	1000
 
-#define BUFFSIZE 512
-#define MAXPENDING 5	// Max connection requests
+#define BUFFSIZE 2048
+#define MAXPENDING 16	// Max connection requests
+#define NWORKERS 4	// Processes accepting connections, us included
+#define MAXKEEPALIVE 100	// Requests served per connection
 
 struct http_request {
 	int sock;
 	char *url;
 	char *version;
+	bool keepalive;
 };
 
 struct responce_header {
@@ -45,73 +48,21 @@ die(char *m)
 	exit();
 }
 
-static void
-req_free(struct http_request *req)
-{
-	free(req->url);
-	free(req->version);
-}
-
+// Write all n bytes to the client.  Page-aligned data is sent a page
+// at a time, so the network server can borrow the page.
 static int
-send_header(struct http_request *req, int code)
+write_all(int sock, const void *buf, size_t n)
 {
-	struct responce_header *h = headers;
-	while (h->code != 0 && h->header!= 0) {
-		if (h->code == code)
-			break;
-		h++;
-	}
-
-	if (h->code == 0)
-		return -1;
-
-	int len = strlen(h->header);
-	if (write(req->sock, h->header, len) != len) {
-		die("Failed to send bytes to client");
-	}
-
-	return 0;
-}
-
-static int
-send_data(struct http_request *req, int fd)
-{
-	// LAB 6: Your code here.
-	assert(fd >= 0);
-	struct Stat stat;
-	int	r = fstat(fd, &stat);
-	if(r != 0){
-		return -1;
-	}
-	int len = stat.st_size;
-	char *buff = malloc(len);
-	if(buff == NULL) {
-		return -1;
-	}
-	r = read(fd, buff, len);
-	if(r < len) {
-		return -1;
-	}
-	if (write(req->sock, buff, len) != len) {
-		die("Failed to send bytes to client");
-	}
-	free(buff);
-	return 0;
-}
-
-static int
-send_size(struct http_request *req, off_t size)
-{
-	char buf[64];
+	const char *p = buf;
 	int r;
 
-	r = snprintf(buf, 64, "Content-Length: %ld\r\n", (long)size);
-	if (r > 63)
-		panic("buffer too small!");
-
-	if (write(req->sock, buf, r) != r)
-		return -1;
-
+	while (n > 0) {
+		r = write(sock, p, MIN(n, PGOFF(p) ? 1024 : PGSIZE));
+		if (r <= 0)
+			return -1;
+		p += r;
+		n -= r;
+	}
 	return 0;
 }
 
@@ -122,46 +73,76 @@ mime_type(const char *file)
 	return "text/html";
 }
 
+// Send the status line and all header fields in a single write.
 static int
-send_content_type(struct http_request *req)
+send_header(struct http_request *req, int code, off_t size)
 {
-	char buf[128];
+	struct responce_header *h = headers;
+	char buf[256];
 	int r;
-	const char *type;
 
-	type = mime_type(req->url);
-	if (!type)
+	while (h->code != 0 && h->header!= 0) {
+		if (h->code == code)
+			break;
+		h++;
+	}
+
+	if (h->code == 0)
 		return -1;
 
-	r = snprintf(buf, 128, "Content-Type: %s\r\n", type);
-	if (r > 127)
+	r = snprintf(buf, sizeof(buf), "%s"
+		     "Content-Length: %ld\r\n"
+		     "Content-Type: %s\r\n"
+		     "Connection: %s\r\n"
+		     "\r\n",
+		     h->header, (long) size, mime_type(req->url),
+		     req->keepalive ? "keep-alive" : "close");
+	if (r >= sizeof(buf))
 		panic("buffer too small!");
 
-	if (write(req->sock, buf, r) != r)
-		return -1;
-
-	return 0;
+	return write_all(req->sock, buf, r);
 }
 
 static int
-send_header_fin(struct http_request *req)
+send_data(struct http_request *req, int fd, off_t size)
 {
-	const char *fin = "\r\n";
-	int fin_len = strlen(fin);
-
-	if (write(req->sock, fin, fin_len) != fin_len)
+	// the file goes out page by page, straight from the file server's
+	// cache, however large it is
+	if (sendfile(req->sock, fd, 0, size) != size)
 		return -1;
-
 	return 0;
 }
 
+// Case-insensitive match of the header field name at s; returns the
+// start of the field's value.
+static char *
+header_field(char *s, const char *name)
+{
+	for (; *name; s++, name++)
+		if ((*s | 0x20) != (*name | 0x20))
+			return 0;
+	if (*s++ != ':')
+		return 0;
+	while (*s == ' ' || *s == '\t')
+		s++;
+	return s;
+}
+
+static bool
+value_is(const char *s, const char *token)
+{
+	for (; *token; s++, token++)
+		if ((*s | 0x20) != *token)
+			return 0;
+	return *s == '\r' || *s == ' ' || *s == '\0';
+}
+
 // given a request, this function creates a struct http_request
+// The request header is parsed in place, and must end in "\r\n\r\n".
 static int
 http_request_parse(struct http_request *req, char *request)
 {
-	const char *url;
-	const char *version;
-	int url_len, version_len;
+	char *line, *v;
 
 	if (!req)
 		return -1;
@@ -173,26 +154,38 @@ http_request_parse(struct http_request *req, char *request)
 	request += 4;
 
 	// get the url
-	url = request;
-	while (*request && *request != ' ')
+	req->url = request;
+	while (*request != ' ' && *request != '\r')
 		request++;
-	url_len = request - url;
-
-	req->url = malloc(url_len + 1);
-	memmove(req->url, url, url_len);
-	req->url[url_len] = '\0';
-
-	// skip space
-	request++;
+	if (*request != ' ')
+		return -E_BAD_REQ;
+	*request++ = '\0';
 
-	version = request;
-	while (*request && *request != '\n')
+	// the version runs to the end of the line
+	req->version = request;
+	while (*request != '\r')
 		request++;
-	version_len = request - version;
+	*request = '\0';
+	request += 2;
+
+	// HTTP/1.1 connections persist unless the client says otherwise,
+	// HTTP/1.0 ones only if it asks
+	if (strcmp(req->version, "HTTP/1.1") == 0)
+		req->keepalive = 1;
+	else if (strcmp(req->version, "HTTP/1.0") != 0)
+		return -E_BAD_REQ;
 
-	req->version = malloc(version_len + 1);
-	memmove(req->version, version, version_len);
-	req->version[version_len] = '\0';
+	for (line = request; *line != '\r'; line = request) {
+		while (*request != '\n')
+			request++;
+		request++;
+		if (!(v = header_field(line, "connection")))
+			continue;
+		if (value_is(v, "close"))
+			req->keepalive = 0;
+		else if (value_is(v, "keep-alive"))
+			req->keepalive = 1;
+	}
 
 	// no entity parsing
 
@@ -203,7 +196,8 @@ static int
 send_error(struct http_request *req, int code)
 {
 	char buf[512];
-	int r;
+	char body[128];
+	int r, n;
 
 	struct error_messages *e = errors;
 	while (e->code != 0 && e->msg != 0) {
@@ -215,18 +209,20 @@ send_error(struct http_request *req, int code)
 	if (e->code == 0)
 		return -1;
 
+	n = snprintf(body, sizeof(body),
+		     "<html><body><p>%d - %s</p></body></html>\r\n",
+		     e->code, e->msg);
 	r = snprintf(buf, 512, "HTTP/" HTTP_VERSION" %d %s\r\n"
 			       "Server: jhttpd/" VERSION "\r\n"
-			       "Connection: close"
+			       "Content-Length: %d\r\n"
 			       "Content-type: text/html\r\n"
+			       "Connection: %s\r\n"
 			       "\r\n"
-			       "<html><body><p>%d - %s</p></body></html>\r\n",
-			       e->code, e->msg, e->code, e->msg);
-
-	if (write(req->sock, buf, r) != r)
-		return -1;
+			       "%s",
+			       e->code, e->msg, n,
+			       req->keepalive ? "keep-alive" : "close", body);
 
-	return 0;
+	return write_all(req->sock, buf, r);
 }
 
 static int
@@ -244,65 +240,83 @@ send_file(struct http_request *req)
 	// LAB 6: Your code here.
 	// not exist or dir
 	struct Stat statbuff;
-	if((r = stat(req->url, &statbuff)) < 0 || statbuff.st_isdir){
-		send_error(req, 404);
-		goto end;
-	}
+	if((r = stat(req->url, &statbuff)) < 0 || statbuff.st_isdir)
+		return send_error(req, 404);
 	file_size = statbuff.st_size;
-	fd = open(req->url, O_RDONLY);
-	assert(fd >= 0);
-	if ((r = send_header(req, 200)) < 0)
-		goto end;
+	if ((fd = open(req->url, O_RDONLY)) < 0)
+		return send_error(req, 404);
 
-	if ((r = send_size(req, file_size)) < 0)
+	if ((r = send_header(req, 200, file_size)) < 0)
 		goto end;
 
-	if ((r = send_content_type(req)) < 0)
-		goto end;
-
-	if ((r = send_header_fin(req)) < 0)
-		goto end;
-
-	r = send_data(req, fd);
+	r = send_data(req, fd, file_size);
 
 end:
 	close(fd);
 	return r;
 }
 
+// Find the end of the request header in the len bytes at buf.
+static char *
+header_end(char *buf, int len)
+{
+	int i;
+
+	for (i = 3; i < len; i++)
+		if (buf[i] == '\n' && buf[i - 1] == '\r'
+		    && buf[i - 2] == '\n' && buf[i - 3] == '\r')
+			return buf + i + 1;
+	return 0;
+}
+
+// Serve requests on sock until the client or we close the connection.
+// Requests the client pipelined behind the current one stay in buffer.
 static void
 handle_client(int sock)
 {
 	struct http_request con_d;
-	int r;
+	int r, nreq;
 	char buffer[BUFFSIZE];
-	int received = -1;
+	char *end;
+	int len = 0, received;
 	struct http_request *req = &con_d;
 
-	while (1)
+	for (nreq = 1; nreq <= MAXKEEPALIVE; nreq++)
 	{
-		// Receive message
-		if ((received = read(sock, buffer, BUFFSIZE)) < 0)
-			panic("failed to read");
-
-		memset(req, 0, sizeof(req));
-
+		memset(req, 0, sizeof(*req));
 		req->sock = sock;
 
+		// Receive a whole request header
+		while (!(end = header_end(buffer, len))) {
+			if (len == BUFFSIZE) {
+				send_error(req, 400);
+				goto done;
+			}
+			if ((received = read(sock, buffer + len,
+					     BUFFSIZE - len)) <= 0)
+				goto done;
+			len += received;
+		}
+
 		r = http_request_parse(req, buffer);
-		if (r == -E_BAD_REQ)
-			send_error(req, 400);
-		else if (r < 0)
+		if (nreq == MAXKEEPALIVE)
+			req->keepalive = 0;
+		if (r == -E_BAD_REQ) {
+			req->keepalive = 0;
+			r = send_error(req, 400);
+		} else if (r < 0)
 			panic("parse failed");
 		else
-			send_file(req);
+			r = send_file(req);
 
-		req_free(req);
+		if (r < 0 || !req->keepalive)
+			break;
 
-		// no keep alive
-		break;
+		len -= end - buffer;
+		memmove(buffer, end, len);
 	}
 
+done:
 	close(sock);
 }
 
@@ -311,6 +325,7 @@ umain(int argc, char **argv)
 {
 	int serversock, clientsock;
 	struct sockaddr_in server, client;
+	int i;
 
 	binaryname = "jhttpd";
 
@@ -335,7 +350,18 @@ umain(int argc, char **argv)
 	if (listen(serversock, MAXPENDING) < 0)
 		die("Failed to listen on server socket");
 
-	cprintf("Waiting for http connections...\n");
+	// Every worker accepts on the shared listening socket; the network
+	// server hands each connection to one of them.
+	for (i = 1; i < NWORKERS; i++) {
+		int r = fork();
+		if (r < 0)
+			die("Failed to fork worker");
+		if (r == 0)
+			break;
+	}
+
+	if (i == NWORKERS)
+		cprintf("Waiting for http connections...\n");
 
 	while (1) {
 		unsigned int clientlen = sizeof(client);
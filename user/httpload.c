@@ -0,0 +1,266 @@
+// HTTP load generator.  Keeps -c connections to an httpd busy with -n
+// requests each, -d of them pipelined at a time, and reports requests
+// per second and latency percentiles.
+//
+// Unless told otherwise with -s, it starts /httpd itself, and by
+// default reaches it on 127.0.0.1, inside the network server.
+
+#include <inc/lib.h>
+#include <lwip/sockets.h>
+#include <lwip/inet.h>
+
+#define HTTPLOAD_PORT	80
+#define IPADDR		"127.0.0.1"
+#define BUFFSIZE	4096
+#define MAXCONNS	32
+#define MAXDEPTH	16
+
+// Latencies in microseconds, shared with the connection processes;
+// connection i owns samples i * nreq up to (i + 1) * nreq.
+#define SAMPLES		((uint32_t *) 0x30000000)
+#define SAMPLEPAGES	16
+#define MAXSAMPLES	(SAMPLEPAGES * PGSIZE / sizeof(uint32_t))
+#define FAILED		0xffffffff
+
+struct conn {
+	int sock;
+	bool closing;		// server said Connection: close
+	int len;
+	char buf[BUFFSIZE];
+};
+
+static struct conn conn;
+static struct sockaddr_in server;
+static char request[BUFFSIZE];
+static int reqlen;
+
+static void
+die(char *m)
+{
+	cprintf("httpload: %s\n", m);
+	exit();
+}
+
+static int
+open_conn(void)
+{
+	int s, try;
+
+	// httpd may still be starting up
+	for (try = 0; try < 50; try++) {
+		if ((s = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+			return s;
+		if (connect(s, (struct sockaddr *) &server, sizeof(server)) >= 0)
+			return s;
+		close(s);
+		sys_sleep_until(sys_time_msec() + 100);
+	}
+	return -1;
+}
+
+static char *
+header_end(char *buf, int len)
+{
+	int i;
+
+	for (i = 3; i < len; i++)
+		if (buf[i] == '\n' && buf[i - 1] == '\r'
+		    && buf[i - 2] == '\n' && buf[i - 3] == '\r')
+			return buf + i + 1;
+	return 0;
+}
+
+// Read one response off c and throw it away.  Returns 0 if it was a
+// 200, -1 on any error.
+static int
+read_response(struct conn *c)
+{
+	char *end, *line;
+	int n, r, clen = -1;
+
+	while (!(end = header_end(c->buf, c->len))) {
+		if (c->len == BUFFSIZE)
+			return -1;
+		if ((r = read(c->sock, c->buf + c->len, BUFFSIZE - c->len)) <= 0)
+			return -1;
+		c->len += r;
+	}
+	if (strncmp(c->buf, "HTTP/1.1 200 ", 13) != 0)
+		return -1;
+	for (line = c->buf; line < end; line = strchr(line, '\n') + 1) {
+		if (strncmp(line, "Content-Length: ", 16) == 0)
+			clen = strtol(line + 16, 0, 10);
+		else if (strncmp(line, "Connection: close", 17) == 0)
+			c->closing = 1;
+	}
+	if (clen < 0)
+		return -1;
+
+	// skip header and body, which may run past the buffer
+	n = end - c->buf + clen;
+	while (c->len < n) {
+		n -= c->len;
+		if ((c->len = read(c->sock, c->buf, BUFFSIZE)) <= 0)
+			return -1;
+	}
+	c->len -= n;
+	memmove(c->buf, c->buf + n, c->len);
+	return 0;
+}
+
+// Issue nreq requests, depth at a time, recording their latencies in
+// lat.  Reconnects when the server closes the connection.
+static void
+run_conn(uint32_t *lat, int nreq, int depth)
+{
+	uint64_t start;
+	int done, n, i;
+
+	conn.sock = -1;
+	for (done = 0; done < nreq; ) {
+		if (conn.sock < 0) {
+			if ((conn.sock = open_conn()) < 0)
+				break;
+			conn.closing = 0;
+			conn.len = 0;
+		}
+
+		n = MIN(depth, nreq - done);
+		start = sys_time_usec();
+		for (i = 0; i < n; i++)
+			if (write(conn.sock, request, reqlen) != reqlen)
+				break;
+		for (i = 0; i < n && !conn.closing; i++) {
+			if (read_response(&conn) < 0)
+				goto out;
+			lat[done++] = sys_time_usec() - start;
+		}
+		// requests the server did not answer go out again
+		if (conn.closing) {
+			close(conn.sock);
+			conn.sock = -1;
+		}
+	}
+
+out:
+	if (conn.sock >= 0)
+		close(conn.sock);
+	while (done < nreq)
+		lat[done++] = FAILED;
+}
+
+static void
+sort(uint32_t *a, int n)
+{
+	int gap, i, j;
+	uint32_t v;
+
+	for (gap = n / 2; gap > 0; gap /= 2)
+		for (i = gap; i < n; i++) {
+			v = a[i];
+			for (j = i; j >= gap && a[j - gap] > v; j -= gap)
+				a[j] = a[j - gap];
+			a[j] = v;
+		}
+}
+
+static void
+usage(void)
+{
+	cprintf("usage: httpload [-s] [-a address] [-p port] [-c connections] "
+		"[-n requests] [-d depth] [url]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	const char *addr = IPADDR, *url = "/index.html";
+	int port = HTTPLOAD_PORT, nconn = 4, nreq = 100, depth = 1;
+	bool spawn_httpd = 1;
+	envid_t child[MAXCONNS];
+	struct Argstate args;
+	unsigned int msec;
+	uint64_t start;
+	int i, n, nok;
+
+	binaryname = "httpload";
+
+	argstart(&argc, argv, &args);
+	while ((i = argnext(&args)) >= 0)
+		switch (i) {
+		case 's':
+			spawn_httpd = 0;
+			break;
+		case 'a':
+		case 'p':
+		case 'c':
+		case 'n':
+		case 'd':
+			if (!argvalue(&args))
+				usage();
+			if (i == 'a')
+				addr = argvalue(&args);
+			else if (i == 'p')
+				port = strtol(argvalue(&args), 0, 0);
+			else if (i == 'c')
+				nconn = strtol(argvalue(&args), 0, 0);
+			else if (i == 'n')
+				nreq = strtol(argvalue(&args), 0, 0);
+			else
+				depth = strtol(argvalue(&args), 0, 0);
+			break;
+		default:
+			usage();
+		}
+	if (argc > 2)
+		usage();
+	if (argc == 2)
+		url = argv[1];
+	if (nconn < 1 || nconn > MAXCONNS || nreq < 1 || depth < 1
+	    || depth > MAXDEPTH || nconn * nreq > MAXSAMPLES)
+		usage();
+
+	memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_addr.s_addr = inet_addr(addr);
+	server.sin_port = htons(port);
+	reqlen = snprintf(request, sizeof(request),
+			  "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", url, addr);
+
+	if (spawn_httpd && spawnl("/httpd", "httpd", 0) < 0)
+		die("cannot spawn /httpd");
+
+	for (i = 0; i < SAMPLEPAGES; i++)
+		if (sys_page_alloc(0, (char *) SAMPLES + i * PGSIZE,
+				   PTE_P|PTE_U|PTE_W|PTE_SHARE) < 0)
+			die("out of memory");
+
+	cprintf("httpload: %d connections x %d requests, depth %d, "
+		"to %s:%d%s\n", nconn, nreq, depth, addr, port, url);
+
+	start = sys_time_usec();
+	for (i = 0; i < nconn; i++) {
+		if ((child[i] = fork()) < 0)
+			die("fork failed");
+		if (child[i] == 0) {
+			run_conn(SAMPLES + i * nreq, nreq, depth);
+			exit();
+		}
+	}
+	for (i = 0; i < nconn; i++)
+		wait(child[i]);
+	msec = (sys_time_usec() - start) / 1000;
+
+	n = nconn * nreq;
+	sort(SAMPLES, n);
+	for (nok = 0; nok < n && SAMPLES[nok] != FAILED; nok++)
+		;
+	if (nok == 0)
+		die("no request succeeded");
+	cprintf("httpload: %d requests in %u ms, %u failed: %u req/s\n",
+		nok, msec, n - nok,
+		(unsigned int) ((uint64_t) nok * 1000 / MAX(msec, 1)));
+	cprintf("httpload: latency p50 %u us, p99 %u us, max %u us\n",
+		SAMPLES[nok / 2], SAMPLES[nok * 99 / 100], SAMPLES[nok - 1]);
+}
@@ -0,0 +1,246 @@
+// TCP bulk throughput test, after iperf.  "iperf -s" accepts
+// connections and reads them to the end, reporting each one's rate;
+// the client keeps -c connections writing -l byte chunks for -t
+// seconds and reports the rate of each and their sum.
+//
+// Unless told otherwise with -S, the client starts "/iperf -s" itself
+// and reaches it by way of QEMU's user-mode network: 10.0.2.2 is the
+// host, whose port IPERF_PORT (PORT5001 in GNUmakefile) is forwarded
+// back to our port 5001.  "-a 127.0.0.1 -p 5001" measures the network
+// server's loopback path instead.
+
+#include <inc/lib.h>
+#include <lwip/sockets.h>
+#include <lwip/inet.h>
+
+#define LISTEN_PORT	5001
+#ifndef IPERF_PORT
+#define IPERF_PORT	LISTEN_PORT
+#endif
+
+#define IPADDR		"10.0.2.2"
+#define MAXLEN		(64 * 1024)
+#define MAXCONNS	32
+
+// Per-connection results, shared with the connection processes
+struct result {
+	uint64_t bytes;
+	uint32_t usec;
+	int failed;
+};
+#define RESULTS		((struct result *) 0x30000000)
+
+// page-aligned so writes are lent to the network server a page at a time
+static char buf[MAXLEN] __attribute__((aligned(PGSIZE)));
+
+static void
+die(char *m)
+{
+	cprintf("iperf: %s\n", m);
+	exit();
+}
+
+// Kilobytes per second for n bytes in usec microseconds.
+static unsigned int
+kbps(uint64_t n, uint32_t usec)
+{
+	return n * 1000000 / 1024 / MAX(usec, 1);
+}
+
+// Read sock to the end and report how fast it came in.
+static void
+serve_conn(int sock, struct sockaddr_in *peer)
+{
+	uint64_t start, n = 0;
+	uint32_t usec;
+	int r;
+
+	start = sys_time_usec();
+	while ((r = read(sock, buf, sizeof(buf))) > 0)
+		n += r;
+	usec = sys_time_usec() - start;
+	close(sock);
+	cprintf("iperf: from %s:%d: %llu bytes in %u ms: %u KB/s\n",
+		inet_ntoa(peer->sin_addr), ntohs(peer->sin_port),
+		n, usec / 1000, kbps(n, usec));
+}
+
+static void
+serve(int port)
+{
+	struct sockaddr_in addr, peer;
+	int s, sock;
+	socklen_t len;
+	envid_t child;
+
+	if ((s = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+		die("cannot create socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		die("cannot bind socket");
+	if (listen(s, MAXCONNS) < 0)
+		die("cannot listen on socket");
+
+	while (1) {
+		len = sizeof(peer);
+		if ((sock = accept(s, (struct sockaddr *) &peer, &len)) < 0)
+			die("accept failed");
+		if ((child = fork()) < 0)
+			die("fork failed");
+		if (child == 0) {
+			close(s);
+			serve_conn(sock, &peer);
+			exit();
+		}
+		close(sock);
+	}
+}
+
+static int
+open_conn(struct sockaddr_in *server)
+{
+	int s, try;
+
+	// the server may still be starting up
+	for (try = 0; try < 50; try++) {
+		if ((s = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+			return s;
+		if (connect(s, (struct sockaddr *) server, sizeof(*server)) >= 0)
+			return s;
+		close(s);
+		sys_sleep_until(sys_time_msec() + 100);
+	}
+	return -1;
+}
+
+// Write len-byte chunks to server for msec milliseconds.
+static void
+run_conn(struct result *res, struct sockaddr_in *server, int len,
+	 unsigned int msec)
+{
+	uint64_t start;
+	int sock;
+
+	if ((sock = open_conn(server)) < 0) {
+		res->failed = 1;
+		return;
+	}
+	start = sys_time_usec();
+	while (sys_time_usec() - start < (uint64_t) msec * 1000) {
+		if (write(sock, buf, len) != len) {
+			res->failed = 1;
+			break;
+		}
+		res->bytes += len;
+	}
+	close(sock);
+	res->usec = sys_time_usec() - start;
+}
+
+static void
+usage(void)
+{
+	cprintf("usage: iperf -s [-p port]\n"
+		"       iperf [-S] [-a address] [-p port] [-c connections] "
+		"[-t seconds] [-l length]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	const char *addr = IPADDR;
+	int port = -1, nconn = 1, secs = 5, len = 16384;
+	bool listener = 0, spawn_server = 1;
+	envid_t child[MAXCONNS];
+	struct sockaddr_in server;
+	struct Argstate args;
+	uint64_t total = 0;
+	uint32_t usec = 0;
+	int i, nok = 0;
+
+	binaryname = "iperf";
+
+	argstart(&argc, argv, &args);
+	while ((i = argnext(&args)) >= 0)
+		switch (i) {
+		case 's':
+			listener = 1;
+			break;
+		case 'S':
+			spawn_server = 0;
+			break;
+		case 'a':
+		case 'p':
+		case 'c':
+		case 't':
+		case 'l':
+			if (!argvalue(&args))
+				usage();
+			if (i == 'a')
+				addr = argvalue(&args);
+			else if (i == 'p')
+				port = strtol(argvalue(&args), 0, 0);
+			else if (i == 'c')
+				nconn = strtol(argvalue(&args), 0, 0);
+			else if (i == 't')
+				secs = strtol(argvalue(&args), 0, 0);
+			else
+				len = strtol(argvalue(&args), 0, 0);
+			break;
+		default:
+			usage();
+		}
+	if (argc > 1 || nconn < 1 || nconn > MAXCONNS || secs < 1
+	    || len < 1 || len > MAXLEN)
+		usage();
+
+	if (listener)
+		serve(port < 0 ? LISTEN_PORT : port);
+
+	memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_addr.s_addr = inet_addr(addr);
+	server.sin_port = htons(port < 0 ? IPERF_PORT : port);
+
+	if (spawn_server && spawnl("/iperf", "iperf", "-s", 0) < 0)
+		die("cannot spawn /iperf -s");
+
+	if (sys_page_alloc(0, RESULTS, PTE_P|PTE_U|PTE_W|PTE_SHARE) < 0)
+		die("out of memory");
+
+	cprintf("iperf: %d connections x %d s, %d byte writes, to %s:%d\n",
+		nconn, secs, len, addr, ntohs(server.sin_port));
+
+	for (i = 0; i < nconn; i++) {
+		if ((child[i] = fork()) < 0)
+			die("fork failed");
+		if (child[i] == 0) {
+			run_conn(&RESULTS[i], &server, len, secs * 1000);
+			exit();
+		}
+	}
+	for (i = 0; i < nconn; i++)
+		wait(child[i]);
+
+	for (i = 0; i < nconn; i++) {
+		if (RESULTS[i].failed && !RESULTS[i].bytes) {
+			cprintf("iperf: connection %d failed\n", i);
+			continue;
+		}
+		cprintf("iperf: connection %d: %llu bytes in %u ms: %u KB/s%s\n",
+			i, RESULTS[i].bytes, RESULTS[i].usec / 1000,
+			kbps(RESULTS[i].bytes, RESULTS[i].usec),
+			RESULTS[i].failed ? " (write failed)" : "");
+		total += RESULTS[i].bytes;
+		usec = MAX(usec, RESULTS[i].usec);
+		nok++;
+	}
+	if (nok == 0)
+		die("no connection succeeded");
+	cprintf("iperf: total %llu bytes in %u ms: %u KB/s\n",
+		total, usec / 1000, kbps(total, usec));
+}
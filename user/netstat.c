@@ -0,0 +1,130 @@
+// Print the network server's lwIP counters and memory pool usage.
+// With -i msec, print rates over successive intervals of that length
+// instead, -n times, or until killed if no count is given.
+
+#include <inc/lib.h>
+
+static const struct {
+	const char *name;
+	size_t off;
+} protos[] = {
+	{ "link", offsetof(struct stats_, link) },
+	{ "etharp", offsetof(struct stats_, etharp) },
+	{ "ip", offsetof(struct stats_, ip) },
+	{ "ip_frag", offsetof(struct stats_, ip_frag) },
+	{ "icmp", offsetof(struct stats_, icmp) },
+	{ "udp", offsetof(struct stats_, udp) },
+	{ "tcp", offsetof(struct stats_, tcp) },
+};
+#define NPROTOS	(sizeof(protos) / sizeof(protos[0]))
+
+static struct Nsret_stats snap[2];
+
+static void
+usage(void)
+{
+	cprintf("usage: netstat [-i msec] [-n count]\n");
+	exit();
+}
+
+// Events per second if msec is not 0, or the plain count otherwise.
+static uint32_t
+rate(uint32_t n, unsigned int msec)
+{
+	return msec ? (uint64_t) n * 1000 / msec : n;
+}
+
+static uint32_t
+errors(const struct stats_proto *p)
+{
+	return p->chkerr + p->lenerr + p->memerr + p->rterr + p->proterr
+		+ p->opterr + p->err;
+}
+
+// Print the counters of n: totals if o is 0, or else rates since o.
+static void
+print_stats(const struct Nsret_stats *o, const struct Nsret_stats *n)
+{
+	static const struct stats_proto zero;
+	const struct stats_proto *po, *pn;
+	unsigned int msec = 0;
+	const char *unit = "";
+	int i;
+
+	if (o) {
+		msec = MAX(n->ret_msec - o->ret_msec, 1);
+		unit = "/s";
+		printf("--- %u ms\n", msec);
+	}
+	printf("%-8s %8s%-2s %8s%-2s %8s%-2s %8s%-2s %8s%-2s\n", "",
+	       "xmit", unit, "recv", unit, "drop", unit, "rexmit", unit,
+	       "errors", unit);
+	for (i = 0; i < NPROTOS; i++) {
+		pn = (const void *) ((const char *) &n->ret_lwip + protos[i].off);
+		po = o ? (const void *) ((const char *) &o->ret_lwip + protos[i].off)
+		       : &zero;
+		printf("%-8s %10u %10u %10u %10u %10u\n", protos[i].name,
+		       rate(pn->xmit - po->xmit, msec),
+		       rate(pn->recv - po->recv, msec),
+		       rate(pn->drop - po->drop, msec),
+		       rate(pn->rexmit - po->rexmit, msec),
+		       rate(errors(pn) - errors(po), msec));
+	}
+
+	printf("%-12s %6s %6s %6s %6s %6s %8s%-2s\n", "pool", "size",
+	       "limit", "used", "max", "slabs", "fails", unit);
+	for (i = 0; i < MEMP_MAX; i++)
+		printf("%-12s %6u %6u %6u %6u %6u %10u\n", n->ret_pool_name[i],
+		       n->ret_pool[i].size, n->ret_pool[i].limit,
+		       n->ret_pool[i].used, n->ret_pool[i].max,
+		       n->ret_pool[i].slabs,
+		       rate(n->ret_pool[i].err - (o ? o->ret_pool[i].err : 0),
+			    msec));
+	printf("%-12s %6s %6s %6u %6u %6s %10u\n", "heap", "",
+	       "", n->ret_lwip.mem.used, n->ret_lwip.mem.max, "",
+	       rate(n->ret_lwip.mem.err - (o ? o->ret_lwip.mem.err : 0), msec));
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct Nsret_stats *o, *n;
+	unsigned int interval = 0;
+	int i, r, count = 0;
+	struct Argstate args;
+
+	binaryname = "netstat";
+
+	argstart(&argc, argv, &args);
+	while ((i = argnext(&args)) >= 0)
+		switch (i) {
+		case 'i':
+		case 'n':
+			if (!argvalue(&args))
+				usage();
+			if (i == 'i')
+				interval = strtol(argvalue(&args), 0, 0);
+			else
+				count = strtol(argvalue(&args), 0, 0);
+			break;
+		default:
+			usage();
+		}
+	if (argc > 1 || count < 0)
+		usage();
+
+	if ((r = nsipc_stats(&snap[0])) < 0)
+		panic("nsipc_stats: %e", r);
+	if (!interval) {
+		print_stats(0, &snap[0]);
+		return;
+	}
+	for (i = 0; !count || i < count; i++) {
+		o = &snap[i % 2];
+		n = &snap[(i + 1) % 2];
+		sys_sleep_until(o->ret_msec + interval);
+		if ((r = nsipc_stats(n)) < 0)
+			panic("nsipc_stats: %e", r);
+		print_stats(o, n);
+	}
+}
@@ -0,0 +1,62 @@
+// Measure pipe throughput: a child writes TOTAL bytes in CHUNK-sized
+// writes and the parent reads them, for a few pipe buffer sizes.
+// Usage: pipebw [megabytes]
+
+#include <inc/lib.h>
+
+#define CHUNK	PGSIZE
+
+static char buf[CHUNK];
+
+static void
+run(size_t bufsize, size_t total)
+{
+	int p[2], r;
+	envid_t child;
+	size_t n;
+	uint64_t start;
+	unsigned int usec;
+
+	if ((r = pipe_sized(p, bufsize)) < 0)
+		panic("pipe_sized: %e", r);
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		close(p[0]);
+		for (n = 0; n < total; n += CHUNK)
+			if ((r = write(p[1], buf, CHUNK)) != CHUNK)
+				panic("write: %e", r);
+		exit();
+	}
+	close(p[1]);
+
+	start = sys_time_usec();
+	for (n = 0; (r = read(p[0], buf, sizeof(buf))) > 0; n += r)
+		;
+	usec = sys_time_usec() - start;
+	if (r < 0)
+		panic("read: %e", r);
+	if (n != total)
+		panic("read %d bytes, want %d", n, total);
+	close(p[0]);
+	wait(child);
+
+	cprintf("pipebw: %6d byte buffer: %d KB in %u us, %u KB/s\n",
+		bufsize, total / 1024, usec,
+		(unsigned int) ((uint64_t) total * 1000000 / 1024 / (usec ? usec : 1)));
+}
+
+void
+umain(int argc, char **argv)
+{
+	size_t total = 4 * 1024 * 1024;
+
+	if (argc > 1)
+		total = strtol(argv[1], 0, 0) * 1024 * 1024;
+	memset(buf, 'x', sizeof(buf));
+
+	run(PGSIZE, total);
+	run(16 * PGSIZE, total);
+	run(64 * 1024, total);
+	run(256 * 1024, total);
+}
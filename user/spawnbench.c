@@ -0,0 +1,28 @@
+// Measure how long it takes to spawn a short-lived program and wait
+// for it to exit.
+// Usage: spawnbench [count]
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	int i, n = 20, r;
+	envid_t child;
+	uint64_t start;
+	unsigned int usec;
+
+	if (argc > 1)
+		n = strtol(argv[1], 0, 0);
+
+	start = sys_time_usec();
+	for (i = 0; i < n; i++) {
+		if ((child = spawnl("/echo", "echo", "-n", (char *) 0)) < 0)
+			panic("spawn /echo: %e", child);
+		if ((r = wait(child)) != 0)
+			panic("/echo exited with %d", r);
+	}
+	usec = sys_time_usec() - start;
+	cprintf("spawnbench: %d spawns in %u us, %u us each\n",
+		n, usec, usec / (n ? n : 1));
+}
@@ -0,0 +1,21 @@
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	int i, r;
+
+	if ((r = sys_env_set_affinity(0, 0)) != -E_INVAL)
+		panic("empty affinity mask: got %e", r);
+
+	// pin ourselves to CPU 0 and check that we stay there
+	if ((r = sys_env_set_affinity(0, 1)) < 0)
+		panic("sys_env_set_affinity: %e", r);
+	for (i = 0; i < 100; i++) {
+		sys_yield();
+		if (thisenv->env_cpunum != 0)
+			panic("pinned to CPU 0 but ran on CPU %d",
+			      thisenv->env_cpunum);
+	}
+	cprintf("testaffinity: OK\n");
+}
@@ -0,0 +1,44 @@
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define WORD	((volatile uint32_t *) 0x0ffff000)
+
+void
+umain(int argc, char **argv)
+{
+	envid_t child;
+	unsigned int start;
+	int r;
+
+	if ((r = sys_page_alloc(0, (void *) WORD, PTE_P|PTE_U|PTE_W|PTE_SHARE)) < 0)
+		panic("sys_page_alloc: %e", r);
+
+	// a changed value returns at once; an unchanged one times out
+	*WORD = 1;
+	if ((r = sys_futex_wait(WORD, 0, 0)) != 0)
+		panic("futex_wait on a changed word: %e", r);
+	start = sys_time_msec();
+	if ((r = sys_futex_wait(WORD, 1, start + 100)) != -E_TIMEOUT)
+		panic("futex_wait: got %e, want timeout", r);
+	if (sys_time_msec() < start + 100)
+		panic("futex_wait timed out early");
+
+	// the child blocks until we change the word and wake it
+	*WORD = 0;
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		while (*WORD == 0)
+			sys_futex_wait(WORD, 0, 0);
+		exit_with(*WORD);
+	}
+	sys_sleep_until(sys_time_msec() + 100);
+	if (envs[ENVX(child)].env_status != ENV_NOT_RUNNABLE)
+		panic("child is not blocked in futex_wait");
+	*WORD = 42;
+	if ((r = sys_futex_wake(WORD, 1)) != 1)
+		panic("futex_wake woke %d", r);
+	if ((r = wait(child)) != 42)
+		panic("child exited with %d", r);
+	cprintf("testfutex: OK\n");
+}
@@ -1,5 +1,110 @@
+// Interactive malloc/free tester.  "bench", or running it as
+// "testmalloc bench", times a few allocation patterns instead.
+
 #include <inc/lib.h>
 
+#define NSLOTS	512
+#define NOPS	100000
+
+static void *slot[NSLOTS];
+static size_t slotsize[NSLOTS];
+static uint32_t seed = 1;
+
+static uint32_t
+rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static void
+check(int i)
+{
+	uint8_t *p = slot[i];
+	size_t j;
+
+	for (j = 0; j < slotsize[i]; j += 61)
+		if (p[j] != (uint8_t) (i + j))
+			panic("block %d of %d bytes at %08x corrupted at %d",
+			      i, slotsize[i], p, j);
+}
+
+static void
+fill(int i, size_t n)
+{
+	uint8_t *p;
+	size_t j;
+
+	if (!(p = slot[i] = malloc(n)))
+		panic("malloc(%d) failed", n);
+	slotsize[i] = n;
+	for (j = 0; j < n; j += 61)
+		p[j] = i + j;
+}
+
+// Replace random ones of the first nslots slots with blocks of up to
+// maxsize bytes, checking the contents of each block before freeing it.
+static void
+churn(const char *name, int nslots, size_t maxsize, int nops)
+{
+	uint64_t start;
+	unsigned int usec;
+	int i, k;
+
+	start = sys_time_usec();
+	for (k = 0; k < nops; k++) {
+		i = rnd() % nslots;
+		if (slot[i]) {
+			check(i);
+			free(slot[i]);
+		}
+		fill(i, 1 + rnd() % maxsize);
+	}
+	for (i = 0; i < NSLOTS; i++) {
+		if (slot[i]) {
+			check(i);
+			free(slot[i]);
+		}
+		slot[i] = 0;
+	}
+	usec = sys_time_usec() - start;
+	cprintf("testmalloc: %-12s %6d ops in %7u us, %4u ns/op\n",
+		name, nops, usec, (unsigned int) ((uint64_t) usec * 1000 / nops));
+}
+
+static void
+bench(void)
+{
+	uint64_t start;
+	unsigned int usec;
+	void *v, *w;
+	int k;
+
+	// a free chunk must be handed out again
+	v = malloc(100);
+	free(v);
+	if ((w = malloc(100)) != v)
+		panic("freed chunk %08x not reused, got %08x", v, w);
+	free(w);
+	v = malloc(3 * 1024 * 1024);
+	if (!v)
+		panic("3 MB malloc failed");
+	free(v);
+
+	start = sys_time_usec();
+	for (k = 0; k < NOPS; k++)
+		free(malloc(64));
+	usec = sys_time_usec() - start;
+	cprintf("testmalloc: %-12s %6d ops in %7u us, %4u ns/op\n",
+		"64 b pairs", NOPS, usec,
+		(unsigned int) ((uint64_t) usec * 1000 / NOPS));
+
+	churn("small", NSLOTS, 256, NOPS);
+	churn("medium", NSLOTS, 2048, NOPS);
+	churn("large", 64, 64 * 1024, NOPS / 10);
+	cprintf("testmalloc: OK\n");
+}
+
 void
 umain(int argc, char **argv)
 {
@@ -7,6 +112,11 @@ umain(int argc, char **argv)
 	int n;
 	void *v;
 
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		bench();
+		return;
+	}
+
 	while (1) {
 		buf = readline("> ");
 		if (buf == 0)
@@ -18,7 +128,9 @@ umain(int argc, char **argv)
 			n = strtol(buf + 7, 0, 0);
 			v = malloc(n);
 			printf("\t0x%x\n", (uintptr_t) v);
-		} else
+		} else if (strcmp(buf, "bench") == 0)
+			bench();
+		else
 			printf("?unknown command\n");
 	}
 }
@@ -0,0 +1,103 @@
+// Test O_NONBLOCK and poll on pipes and sockets.
+
+#include <inc/lib.h>
+#include <lwip/sockets.h>
+#include <lwip/inet.h>
+
+static void
+test_pipe(void)
+{
+	struct pollfd pfd[2];
+	unsigned int start;
+	envid_t child;
+	char c;
+	int p[2], r;
+
+	if ((r = pipe(p)) < 0)
+		panic("pipe: %e", r);
+
+	// an empty pipe is writable but not readable
+	pfd[0].fd = p[0];
+	pfd[0].events = POLLIN;
+	pfd[1].fd = p[1];
+	pfd[1].events = POLLOUT;
+	if ((r = poll(pfd, 2, 0)) != 1 || pfd[0].revents || pfd[1].revents != POLLOUT)
+		panic("poll on empty pipe: %d %x %x", r, pfd[0].revents, pfd[1].revents);
+
+	if ((r = fcntl(p[0], F_SETFL, O_NONBLOCK)) < 0)
+		panic("fcntl: %e", r);
+	if ((r = read(p[0], &c, 1)) != -E_AGAIN)
+		panic("non-blocking read of empty pipe returned %d", r);
+
+	start = sys_time_msec();
+	if ((r = poll(pfd, 1, 50)) != 0)
+		panic("poll on empty pipe returned %d", r);
+	if (sys_time_msec() - start < 50)
+		panic("poll returned after %d ms, not 50", sys_time_msec() - start);
+
+	// a write from another env wakes the poll up
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		sys_sleep_until(sys_time_msec() + 20);
+		write(p[1], "x", 1);
+		exit();
+	}
+	if ((r = poll(pfd, 1, -1)) != 1 || pfd[0].revents != POLLIN)
+		panic("poll for a write: %d %x", r, pfd[0].revents);
+	if ((r = read(p[0], &c, 1)) != 1 || c != 'x')
+		panic("read after poll: %d", r);
+	wait(child);
+
+	// the other end going away is reported too
+	close(p[1]);
+	if ((r = poll(pfd, 1, 0)) != 1 || !(pfd[0].revents & POLLHUP))
+		panic("poll after close: %d %x", r, pfd[0].revents);
+	close(p[0]);
+	cprintf("pipe poll OK\n");
+}
+
+static void
+test_sock(void)
+{
+	struct pollfd pfd;
+	struct sockaddr_in addr;
+	unsigned int start;
+	char c;
+	int s, r;
+
+	if ((s = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
+		panic("socket: %e", s);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(7777);
+	if ((r = bind(s, (struct sockaddr *) &addr, sizeof(addr))) < 0)
+		panic("bind: %e", r);
+
+	pfd.fd = s;
+	pfd.events = POLLIN | POLLOUT;
+	if ((r = poll(&pfd, 1, 0)) != 1 || pfd.revents != POLLOUT)
+		panic("poll on idle socket: %d %x", r, pfd.revents);
+
+	// nothing ever arrives, so this waits in the network server
+	pfd.events = POLLIN;
+	start = sys_time_msec();
+	if ((r = poll(&pfd, 1, 100)) != 0)
+		panic("poll on idle socket returned %d", r);
+	if (sys_time_msec() - start < 100)
+		panic("poll returned after %d ms, not 100", sys_time_msec() - start);
+
+	fcntl(s, F_SETFL, O_NONBLOCK);
+	if ((r = read(s, &c, 1)) != -E_AGAIN)
+		panic("non-blocking read of idle socket returned %d", r);
+	close(s);
+	cprintf("socket poll OK\n");
+}
+
+void
+umain(int argc, char **argv)
+{
+	test_pipe();
+	test_sock();
+}
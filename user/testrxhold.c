@@ -0,0 +1,60 @@
+// Check that frames held by a socket nobody reads do not stop the
+// network server's receive rings.  Binds UDP port 7 and never reads
+// from it, then echoes a TCP connection on port 7.  The grader fills
+// the UDP socket first, then pushes many rings' worth of data through
+// the echo; before frames could be kept out of order, the first unread
+// datagram pinned its ring and the echo stalled.
+
+#include <inc/lib.h>
+#include <lwip/sockets.h>
+#include <lwip/inet.h>
+
+#define PORT	7
+
+static char buf[PGSIZE] __attribute__((aligned(PGSIZE)));
+
+static void
+die(char *m)
+{
+	cprintf("testrxhold: %s\n", m);
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct sockaddr_in addr, client;
+	socklen_t clientlen = sizeof(client);
+	int usock, lsock, sock, n, total = 0;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(PORT);
+
+	// datagrams to this socket stay queued for good
+	if ((usock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
+		die("cannot create UDP socket");
+	if (bind(usock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		die("cannot bind UDP socket");
+
+	if ((lsock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+		die("cannot create TCP socket");
+	if (bind(lsock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		die("cannot bind TCP socket");
+	if (listen(lsock, 1) < 0)
+		die("cannot listen");
+	cprintf("testrxhold: bound\n");
+
+	if ((sock = accept(lsock, (struct sockaddr *) &client, &clientlen)) < 0)
+		die("cannot accept");
+	while ((n = read(sock, buf, sizeof(buf))) > 0) {
+		if (write(sock, buf, n) != n)
+			die("short write");
+		total += n;
+	}
+	if (n < 0)
+		die("read failed");
+	close(sock);
+	cprintf("testrxhold: echoed %d bytes, OK\n", total);
+}
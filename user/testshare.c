@@ -0,0 +1,48 @@
+// Check that instances of a spawned program share its text pages and
+// do not share its data.  Each child exits with the physical page
+// number of its code.
+
+#include <inc/lib.h>
+
+#define NCHILD	4
+
+static int counter = 1;
+
+static void
+child(void)
+{
+	pte_t pte = uvpt[PGNUM(child)];
+
+	if (pte & PTE_W)
+		panic("text page %08x is writable", pte);
+	// writes to data must stay private to this instance
+	if (counter++ != 1)
+		panic("counter is %d, not 1", counter - 1);
+	exit_with(PGNUM(PTE_ADDR(pte)));
+}
+
+void
+umain(int argc, char **argv)
+{
+	int i, ppn[NCHILD];
+	envid_t env;
+	uint64_t start;
+	unsigned int usec;
+
+	if (argc > 1 && strcmp(argv[1], "child") == 0)
+		child();
+
+	for (i = 0; i < NCHILD; i++) {
+		start = sys_time_usec();
+		if ((env = spawnl("/testshare", "testshare", "child", (char *) 0)) < 0)
+			panic("spawn: %e", env);
+		if ((ppn[i] = wait(env)) <= 0)
+			panic("child %d exited with %d", i, ppn[i]);
+		usec = sys_time_usec() - start;
+		cprintf("testshare: child %d ran in %u us, text at page %x\n",
+			i, usec, ppn[i]);
+		if (ppn[i] != ppn[0])
+			panic("children do not share text");
+	}
+	cprintf("testshare: OK\n");
+}
@@ -0,0 +1,54 @@
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	unsigned int start, now;
+	envid_t who, child;
+	int r;
+
+	// sys_sleep_until
+	start = sys_time_msec();
+	if ((r = sys_sleep_until(start + 500)) < 0)
+		panic("sys_sleep_until: %e", r);
+	now = sys_time_msec();
+	if (now < start + 500)
+		panic("woke up early: slept %u ms", now - start);
+	cprintf("slept %u ms\n", now - start);
+
+	// short sleeps are not rounded up to a scheduler tick
+	for (r = 0; r < 5; r++) {
+		uint64_t ustart = sys_time_usec(), uslept;
+
+		sys_sleep_until(sys_time_msec() + 2);
+		uslept = sys_time_usec() - ustart;
+		if (uslept < 1000)
+			panic("2 ms sleep took %u us", (unsigned int) uslept);
+		cprintf("2 ms sleep took %u us\n", (unsigned int) uslept);
+	}
+
+	// a timed ipc_recv that nobody answers
+	start = sys_time_msec();
+	r = ipc_recv_until(&who, 0, 0, start + 300);
+	now = sys_time_msec();
+	if (r != -E_TIMEOUT || who != 0)
+		panic("ipc_recv_until: got %e from %08x", r, who);
+	if (now < start + 300)
+		panic("ipc_recv_until timed out early after %u ms", now - start);
+	cprintf("recv timed out after %u ms\n", now - start);
+
+	// a timed ipc_recv that is answered in time
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		sys_sleep_until(sys_time_msec() + 100);
+		ipc_send(thisenv->env_parent_id, 42, 0, 0);
+		return;
+	}
+	start = sys_time_msec();
+	r = ipc_recv_until(&who, 0, 0, start + 5000);
+	if (r != 42 || who != child)
+		panic("ipc_recv_until: got %e from %08x", r, who);
+	cprintf("recv got %d after %u ms\n", r, sys_time_msec() - start);
+	cprintf("testsleep: OK\n");
+}
@@ -0,0 +1,46 @@
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	envid_t child;
+	int r, runs;
+
+	// exit status of a child that is still running when we wait
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		sys_sleep_until(sys_time_msec() + 500);
+		exit_with(7);
+	}
+	runs = thisenv->env_runs;
+	if ((r = wait(child)) != 7)
+		panic("wait: got %d, want 7", r);
+	// we were blocked, not polling, for those 500 ms
+	cprintf("waited with %d runs\n", thisenv->env_runs - runs);
+	if (thisenv->env_runs - runs > 5)
+		panic("wait kept the parent running");
+
+	// a child that has already exited
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0)
+		exit_with(-3);
+	sys_sleep_until(sys_time_msec() + 100);
+	if ((r = wait(child)) != -3)
+		panic("wait: got %d, want -3", r);
+
+	// a child that the kernel kills
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		volatile int zero = 0;
+		r = 1 / zero;
+	}
+	if ((r = wait(child)) != -E_FAULT)
+		panic("wait: got %d, want %e", r, -E_FAULT);
+
+	if ((r = wait(thisenv->env_id)) != -E_INVAL)
+		panic("wait for self: got %d", r);
+	cprintf("testwait: OK\n");
+}
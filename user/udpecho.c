@@ -0,0 +1,195 @@
+// UDP echo server and round-trip benchmark, moving datagrams in
+// batches with sendmmsg/recvmmsg.  "udpecho -s" echoes every datagram
+// on port 7 back to where it came from, taking up to -b of them per
+// request to the network server.  The client keeps a window of -b
+// datagrams of -l bytes in flight for -t seconds, sending and receiving
+// each window in as few requests as possible, and reports the round
+// trip rate.  -b 1 gives the one-datagram-per-request baseline.
+//
+// Unless told otherwise with -S, the client starts "/udpecho -s" itself
+// and reaches it by way of QEMU's user-mode network: 10.0.2.2 is the
+// host, whose UDP port UDPECHO_PORT (PORT7 in GNUmakefile) is forwarded
+// back to our port 7.  "-a 127.0.0.1 -p 7" stays inside the network
+// server.
+
+#include <inc/lib.h>
+#include <lwip/sockets.h>
+#include <lwip/inet.h>
+
+#define LISTEN_PORT	7
+#ifndef UDPECHO_PORT
+#define UDPECHO_PORT	LISTEN_PORT
+#endif
+
+#define IPADDR		"10.0.2.2"
+#define MAXBATCH	64
+#define MAXLEN		1024
+// how long to wait for the rest of a window before counting it lost
+#define TIMEOUT		200
+
+static char bufs[MAXBATCH][MAXLEN];
+static struct mmsg msgs[MAXBATCH];
+
+static void
+die(char *m)
+{
+	cprintf("udpecho: %s\n", m);
+	exit();
+}
+
+static void
+serve(int port, int batch)
+{
+	struct sockaddr_in addr;
+	int s, i, n;
+
+	if ((s = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
+		die("cannot create socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		die("cannot bind socket");
+
+	while (1) {
+		for (i = 0; i < batch; i++) {
+			msgs[i].mm_buf = bufs[i];
+			msgs[i].mm_len = MAXLEN;
+		}
+		if ((n = recvmmsg(s, msgs, batch)) < 0)
+			die("recvmmsg failed");
+		// each goes back to the mm_addr it came from
+		if (sendmmsg(s, msgs, n) != n)
+			die("sendmmsg failed");
+	}
+}
+
+static void
+usage(void)
+{
+	cprintf("usage: udpecho -s [-p port] [-b batch]\n"
+		"       udpecho [-S] [-a address] [-p port] [-b batch] "
+		"[-t seconds] [-l length]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	const char *addr = IPADDR;
+	int port = -1, batch = MAXBATCH, secs = 5, len = 64;
+	bool listener = 0, spawn_server = 1;
+	unsigned int nreqs = 0, nsent = 0, nrecv = 0;
+	struct sockaddr_in server;
+	struct Argstate args;
+	struct pollfd pfd;
+	uint64_t start, usec;
+	int s, i, n, got;
+	char batchstr[16];
+
+	binaryname = "udpecho";
+
+	argstart(&argc, argv, &args);
+	while ((i = argnext(&args)) >= 0)
+		switch (i) {
+		case 's':
+			listener = 1;
+			break;
+		case 'S':
+			spawn_server = 0;
+			break;
+		case 'a':
+		case 'p':
+		case 'b':
+		case 't':
+		case 'l':
+			if (!argvalue(&args))
+				usage();
+			if (i == 'a')
+				addr = argvalue(&args);
+			else if (i == 'p')
+				port = strtol(argvalue(&args), 0, 0);
+			else if (i == 'b')
+				batch = strtol(argvalue(&args), 0, 0);
+			else if (i == 't')
+				secs = strtol(argvalue(&args), 0, 0);
+			else
+				len = strtol(argvalue(&args), 0, 0);
+			break;
+		default:
+			usage();
+		}
+	if (argc > 1 || batch < 1 || batch > MAXBATCH || secs < 1
+	    || len < 1 || len > MAXLEN)
+		usage();
+
+	if (listener)
+		serve(port < 0 ? LISTEN_PORT : port, batch);
+
+	memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_addr.s_addr = inet_addr(addr);
+	server.sin_port = htons(port < 0 ? UDPECHO_PORT : port);
+
+	if (spawn_server) {
+		snprintf(batchstr, sizeof(batchstr), "%d", batch);
+		if (spawnl("/udpecho", "udpecho", "-s", "-b", batchstr, 0) < 0)
+			die("cannot spawn /udpecho -s");
+		// give it time to bind before the first window goes out
+		sys_sleep_until(sys_time_msec() + 500);
+	}
+
+	if ((s = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
+		die("cannot create socket");
+	if (connect(s, (struct sockaddr *) &server, sizeof(server)) < 0)
+		die("cannot connect socket");
+	if (fcntl(s, F_SETFL, O_NONBLOCK) < 0)
+		die("cannot make socket non-blocking");
+
+	cprintf("udpecho: %d byte datagrams in windows of %d for %d s, to %s:%d\n",
+		len, batch, secs, addr, ntohs(server.sin_port));
+
+	start = sys_time_usec();
+	while (sys_time_usec() - start < (uint64_t) secs * 1000000) {
+		for (i = 0; i < batch; i++) {
+			memset(bufs[i], 'a' + i % 26, len);
+			msgs[i].mm_buf = bufs[i];
+			msgs[i].mm_len = len;
+			// sin_family 0: to the connected server
+			memset(&msgs[i].mm_addr, 0, sizeof(msgs[i].mm_addr));
+		}
+		if ((n = sendmmsg(s, msgs, batch)) <= 0)
+			die("sendmmsg failed");
+		nreqs++;
+		nsent += n;
+
+		for (got = 0; got < n; got += i) {
+			pfd.fd = s;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, TIMEOUT) <= 0)
+				break;
+			for (i = 0; i < n - got; i++) {
+				msgs[i].mm_buf = bufs[i];
+				msgs[i].mm_len = MAXLEN;
+			}
+			if ((i = recvmmsg(s, msgs, n - got)) < 0) {
+				if (i == -E_AGAIN) {
+					i = 0;
+					continue;
+				}
+				die("recvmmsg failed");
+			}
+			nreqs++;
+			nrecv += i;
+		}
+	}
+	usec = sys_time_usec() - start;
+	close(s);
+
+	cprintf("udpecho: %u sent, %u echoed, %u lost in %u ms\n",
+		nsent, nrecv, nsent - nrecv, (uint32_t) (usec / 1000));
+	cprintf("udpecho: %u round trips/s, %u datagrams per request\n",
+		(uint32_t) ((uint64_t) nrecv * 1000000 / MAX(usec, 1)),
+		(nsent + nrecv) / MAX(nreqs, 1));
+}